@@ -26,6 +26,8 @@
 #include "dbhelpers.h"
 #include "curop.h"
 #include "stats/counters.h"
+#include "keystring.h"
+#include "filever.h"
 
 namespace mongo {
 
@@ -33,7 +35,7 @@ namespace mongo {
 
     KeyNode::KeyNode(const BucketBasics& bb, const _KeyNode &k) :
             prevChildBucket(k.prevChildBucket),
-            recordLoc(k.recordLoc), key(bb.data+k.keyDataOfs())
+            recordLoc(k.recordLoc), key(bb.keyObj(k))
     { }
 
     const int KeyMax = BucketSize / 10;
@@ -186,16 +188,23 @@ namespace mongo {
         return (int) (Size() - (data-(char*)this));
     }
 
+    int BucketBasics::keyDataSize(const _KeyNode& kn) const {
+        const char *p = data + kn.keyDataOfs();
+        if ( compactKeys() )
+            return sizeof(unsigned short) + *(unsigned short*)p;
+        return BSONObj(p).objsize();
+    }
+
     void BucketBasics::init() {
         parent.Null();
         nextChild.Null();
         _wasSize = BucketSize;
-        _reserved1 = 0;
         flags = Packed;
         n = 0;
         emptySize = totalDataSize();
         topSize = 0;
-        reserved = 0;
+        _prefixOfs = 0;
+        _prefixLen = 0;
     }
 
     /* see _alloc */
@@ -235,7 +244,7 @@ namespace mongo {
         KeyNode kn = keyNode(n-1);
         recLoc = kn.recordLoc;
         key = kn.key;
-        int keysize = kn.key.objsize();
+        int keysize = keyDataSize(k(n-1));
 
 		massert( 10283 , "rchild not null in btree popBack()", nextChild.isNull());
 
@@ -248,7 +257,14 @@ namespace mongo {
     }
 
     /* add a key.  must be > all existing.  be careful to set next ptr right. */
-    bool BucketBasics::_pushBack(const DiskLoc& recordLoc, BSONObj& key, const Ordering &order, DiskLoc prevChild) {
+    bool BucketBasics::_pushBack(const DiskLoc& recordLoc, const BSONObj& key, const Ordering &order, DiskLoc prevChild) {
+        if ( compactKeys() ) {
+            dassert( n == 0 || keyNode(n-1).key.woCompare(key, order) <= 0 );
+            if ( !_insertCompact(n, recordLoc, key, order) )
+                return false;
+            k(n-1).prevChildBucket = prevChild;
+            return true;
+        }
         int bytesNeeded = key.objsize() + sizeof(_KeyNode);
         if ( bytesNeeded > emptySize )
             return false;
@@ -272,6 +288,8 @@ namespace mongo {
     bool BucketBasics::basicInsert(const DiskLoc& thisLoc, int keypos, const DiskLoc& recordLoc, const BSONObj& key, const Ordering &order) {
         modified(thisLoc);
         assert( keypos >= 0 && keypos <= n );
+        if ( compactKeys() )
+            return _insertCompact(keypos, recordLoc, key, order);
         int bytesNeeded = key.objsize() + sizeof(_KeyNode);
         if ( bytesNeeded > emptySize ) {
             pack( order );
@@ -298,6 +316,20 @@ namespace mongo {
         if ( flags & Packed )
             return;
 
+        if ( compactKeys() ) {
+            // every key gets rewritten anyway, so make the prefix all they have in common now
+            char first[BucketSize];
+            int len = 0;
+            if ( n > 0 ) {
+                len = fullKeySize(k(0));
+                fullKey(k(0), first);
+            }
+            bool ok = _setPrefix(first, commonPrefix(first, len));
+            assert( ok );
+            assertValid( order );
+            return;
+        }
+
         int tdz = totalDataSize();
         char temp[BucketSize];
         int ofs = tdz;
@@ -325,6 +357,197 @@ namespace mongo {
         pack( order );
     }
 
+    /* CompactKeys ---------------------------------------------------- */
+
+    void BucketBasics::storedKey(const BSONObj& key, const Ordering &order, BufBuilder& b, int& comparableSize) {
+        if ( KeyString::encode(key, order, b, &comparableSize) )
+            return;
+        comparableSize = 0;
+        b.append( (char) 0xff );
+        b.append( (void *) key.objdata(), key.objsize() );
+    }
+
+    inline int BucketBasics::fullKeySize(const _KeyNode& kn) const {
+        return _prefixLen + *(unsigned short*)(data + kn.keyDataOfs());
+    }
+
+    inline void BucketBasics::fullKey(const _KeyNode& kn, char *dest) const {
+        const char *p = data + kn.keyDataOfs();
+        memcpy(dest, prefix(), _prefixLen);
+        memcpy(dest + _prefixLen, p + sizeof(unsigned short), *(unsigned short*)p);
+    }
+
+    BSONObj BucketBasics::keyObj(const _KeyNode& kn) const {
+        if ( !compactKeys() )
+            return BSONObj(data + kn.keyDataOfs());
+        const char *p = data + kn.keyDataOfs() + sizeof(unsigned short);
+        if ( _prefixLen == 0 && (unsigned char) *p == 0xff )
+            return BSONObj(p + 1); // whole in the bucket, as keys of the old format are
+        char buf[BucketSize];
+        if ( _prefixLen ) {
+            fullKey(kn, buf);
+            p = buf;
+        }
+        if ( (unsigned char) *p == 0xff )
+            return BSONObj(p + 1).copy();
+        return KeyString::toBSON(p);
+    }
+
+    int BucketBasics::keySize(const BSONObj& key, const Ordering &order) {
+        if ( !compactKeys() )
+            return key.objsize();
+        BufBuilder b;
+        int comparableSize;
+        storedKey(key, order, b, comparableSize);
+        return sizeof(unsigned short) + b.len();
+    }
+
+    int BucketBasics::compareKey(int i, const BSONObj& key, const char *stored, int comparableSize, const Ordering &order) const {
+        const _KeyNode& kn = k(i);
+        if ( !compactKeys() )
+            return key.woCompare(BSONObj(data + kn.keyDataOfs()), order);
+
+        const char *p = data + kn.keyDataOfs();
+        int len = *(unsigned short*)p;
+        p += sizeof(unsigned short);
+        unsigned char first = (unsigned char) ( _prefixLen ? *prefix() : *p );
+        if ( first == 0xff ) {
+            // stored as BSON.  put it together on the stack rather than copy it out with keyObj()
+            if ( _prefixLen == 0 )
+                return key.woCompare(BSONObj(p + 1), order);
+            char buf[BucketSize];
+            fullKey(kn, buf);
+            return key.woCompare(BSONObj(buf + 1), order);
+        }
+        if ( comparableSize == 0 ) {
+            // key can't be a KeyString but this one is.  rare: the two are of different types
+            return key.woCompare(keyObj(kn), order);
+        }
+
+        /* both are KeyStrings.  they can only differ within the comparable part of both, so we 
+           never need to know where this key's comparable part ends. */
+        int x = memcmp(stored, prefix(), min(comparableSize, _prefixLen));
+        if ( x || comparableSize <= _prefixLen )
+            return x;
+        return memcmp(stored + _prefixLen, p, min(comparableSize - _prefixLen, len));
+    }
+
+    bool BucketBasics::keyEquals(int i, const BSONObj& key, const Ordering &order, BufBuilder& stored) const {
+        if ( i >= n )
+            return false;
+        const _KeyNode& kn = k(i);
+        if ( !compactKeys() )
+            return key.woEqual(BSONObj(data + kn.keyDataOfs()));
+        if ( stored.len() == 0 ) {
+            int comparableSize;
+            storedKey(key, order, stored, comparableSize);
+        }
+        // the encoding keeps each element's type, so the bytes are equal just when the BSON is
+        if ( fullKeySize(kn) != stored.len() )
+            return false;
+        const char *p = data + kn.keyDataOfs() + sizeof(unsigned short);
+        return memcmp(stored.buf(), prefix(), _prefixLen) == 0 &&
+               memcmp(stored.buf() + _prefixLen, p, stored.len() - _prefixLen) == 0;
+    }
+
+    /* @return length of the longest prefix of s that every key in the bucket has.  if s doesn't 
+       have all of prefix(), that is how much of prefix() it has.
+    */
+    int BucketBasics::commonPrefix(const char *s, int len) const {
+        const char *pre = prefix();
+        int c = 0;
+        while ( c < _prefixLen && c < len && s[c] == pre[c] )
+            c++;
+        if ( c < _prefixLen )
+            return c;
+        c = len;
+        for ( int i = 0; i < n && c > _prefixLen; i++ ) {
+            const char *p = data + k(i).keyDataOfs();
+            int m = min( (int) *(unsigned short*)p, c - _prefixLen );
+            p += sizeof(unsigned short);
+            int j = 0;
+            while ( j < m && p[j] == s[_prefixLen + j] )
+                j++;
+            c = _prefixLen + j;
+        }
+        return c;
+    }
+
+    /* rewrite the key data with the first len bytes of src as the prefix.  those bytes must be
+       common to every key.  also packs.
+       @return false, leaving the bucket alone, if the keys would no longer fit.
+    */
+    bool BucketBasics::_setPrefix(const char *src, int len) {
+        int tdz = totalDataSize();
+        int needed = len + n * sizeof(_KeyNode);
+        for ( int j = 0; j < n; j++ )
+            needed += sizeof(unsigned short) + fullKeySize(k(j)) - len;
+        if ( needed > tdz )
+            return false;
+
+        char temp[BucketSize];
+        char full[BucketSize];
+        int ofs = tdz - len;
+        memcpy(temp + ofs, src, len);
+        int prefixOfs = ofs;
+        for ( int j = 0; j < n; j++ ) {
+            int sz = fullKeySize(k(j)) - len;
+            fullKey(k(j), full);
+            ofs -= sizeof(unsigned short) + sz;
+            *(unsigned short*)(temp + ofs) = (unsigned short) sz;
+            memcpy(temp + ofs + sizeof(unsigned short), full + len, sz);
+            k(j).setKeyDataOfsSavingUse( ofs );
+        }
+        int dataUsed = tdz - ofs;
+        memcpy(data + ofs, temp + ofs, dataUsed);
+        topSize = dataUsed;
+        emptySize = tdz - dataUsed - n * sizeof(_KeyNode);
+        assert( emptySize >= 0 );
+        _prefixOfs = (unsigned short) prefixOfs;
+        _prefixLen = len;
+        setPacked();
+        return true;
+    }
+
+    /* the CompactKeys version of basicInsert() */
+    bool BucketBasics::_insertCompact(int keypos, const DiskLoc& recordLoc, const BSONObj& key, const Ordering &order) {
+        BufBuilder b;
+        int comparableSize;
+        storedKey(key, order, b, comparableSize);
+        const char *s = b.buf();
+        int len = b.len();
+
+        int c = commonPrefix(s, len);
+        if ( c < _prefixLen ) {
+            // this key doesn't have the whole prefix.  give the part it lacks back to the other keys.
+            if ( !_setPrefix(s, c) )
+                return false;
+        }
+        int bytesNeeded = sizeof(_KeyNode) + sizeof(unsigned short) + len - _prefixLen;
+        if ( bytesNeeded > emptySize && ( c > _prefixLen || !( flags & Packed ) ) ) {
+            // reclaim deleted space, and move anything new all the keys share into the prefix
+            bool ok = _setPrefix(s, c);
+            assert( ok );
+            bytesNeeded = sizeof(_KeyNode) + sizeof(unsigned short) + len - _prefixLen;
+        }
+        if ( bytesNeeded > emptySize )
+            return false;
+
+        for ( int j = n; j > keypos; j-- ) // make room
+            k(j) = k(j-1);
+        n++;
+        emptySize -= sizeof(_KeyNode);
+        _KeyNode& kn = k(keypos);
+        kn.prevChildBucket.Null();
+        kn.recordLoc = recordLoc;
+        int sz = len - _prefixLen;
+        kn.setKeyDataOfs( (short) _alloc(sizeof(unsigned short) + sz) );
+        char *p = dataAt(kn.keyDataOfs());
+        *(unsigned short*)p = (unsigned short) sz;
+        memcpy(p + sizeof(unsigned short), s + _prefixLen, sz);
+        return true;
+    }
+
     /* - BtreeBucket --------------------------------------------------- */
 
     /* return largest key in the subtree. */
@@ -349,6 +572,7 @@ namespace mongo {
         int pos;
         bool found;
         DiskLoc b = locate(idx, thisLoc, key, order, pos, found, minDiskLoc);
+        BufBuilder stored(0);
 
         // skip unused keys
         while ( 1 ) {
@@ -357,7 +581,7 @@ namespace mongo {
             BtreeBucket *bucket = b.btree();
             _KeyNode& kn = bucket->k(pos);
             if ( kn.isUsed() )
-                return bucket->keyAt(pos).woEqual(key);
+                return bucket->keyEquals(pos, key, order, stored);
             b = bucket->advance(b, pos, 1, "BtreeBucket::exists");
         }
         return false;
@@ -374,13 +598,14 @@ namespace mongo {
         int pos;
         bool found;
         DiskLoc b = locate(idx, thisLoc, key, order, pos, found, minDiskLoc);
+        BufBuilder stored(0);
 
         while ( !b.isNull() ) {
             // we skip unused keys
             BtreeBucket *bucket = b.btree();
             _KeyNode& kn = bucket->k(pos);
             if ( kn.isUsed() ) {
-                if( bucket->keyAt(pos).woEqual(key) )
+                if( bucket->keyEquals(pos, key, order, stored) )
                     return kn.recordLoc != self;
                 break;
             }
@@ -427,6 +652,12 @@ namespace mongo {
 #endif
         
         globalIndexCounters.btree( (char*)this );
+
+        BufBuilder b(0);
+        int comparableSize = 0;
+        if ( compactKeys() )
+            storedKey(key, order, b, comparableSize);
+        const char *stored = b.buf();
         
         /* binary search for this key */
         bool dupsChecked = false;
@@ -434,8 +665,8 @@ namespace mongo {
         int h=n-1;
         while ( l <= h ) {
             int m = (l+h)/2;
-            KeyNode M = keyNode(m);
-            int x = key.woCompare(M.key, order);
+            const _KeyNode& M = k(m);
+            int x = compareKey(m, key, stored, comparableSize, order);
             if ( x == 0 ) { 
                 if( assertIfDup ) {
                     if( k(m).isUnused() ) { 
@@ -477,10 +708,9 @@ namespace mongo {
         // not found
         pos = l;
         if ( pos != n ) {
-            BSONObj keyatpos = keyNode(pos).key;
-            wassert( key.woCompare(keyatpos, order) <= 0 );
+            wassert( compareKey(pos, key, stored, comparableSize, order) <= 0 );
             if ( pos > 0 ) {
-                wassert( keyNode(pos-1).key.woCompare(key, order) <= 0 );
+                wassert( compareKey(pos-1, key, stored, comparableSize, order) >= 0 );
             }
         }
 
@@ -560,7 +790,7 @@ found:
 
     /* remove a key from the index */
     bool BtreeBucket::unindex(const DiskLoc& thisLoc, IndexDetails& id, BSONObj& key, const DiskLoc& recordLoc ) {
-        if ( key.objsize() > KeyMax ) {
+        if ( keySize(key, Ordering::make(id.keyPattern())) > KeyMax ) {
             OCCASIONALLY problem() << "unindex: key too large to index, skipping " << id.indexNamespace() << /* ' ' << key.toString() << */ endl;
             return false;
         }
@@ -744,6 +974,12 @@ found:
         DiskLoc loc = btreeStore->insert(id.indexNamespace().c_str(), 0, BucketSize, true);
         BtreeBucket *b = loc.btreemod();
         b->init();
+        NamespaceDetails *d = nsdetails( id.parentNS().c_str() );
+        if ( d ) {
+            checkIndexFileVersion( *d );
+            if ( d->indexFileVersion >= 1 )
+                b->flags |= CompactKeys;
+        }
         return loc;
     }
 
@@ -835,8 +1071,8 @@ found:
     int BtreeBucket::_insert(DiskLoc thisLoc, DiskLoc recordLoc,
                              const BSONObj& key, const Ordering &order, bool dupsAllowed,
                              DiskLoc lChild, DiskLoc rChild, IndexDetails& idx) {
-        if ( key.objsize() > KeyMax ) {
-            problem() << "ERROR: key too large len:" << key.objsize() << " max:" << KeyMax << ' ' << key.objsize() << ' ' << idx.indexNamespace() << endl;
+        if ( keySize(key, order) > KeyMax ) {
+            problem() << "ERROR: key too large len:" << keySize(key, order) << " max:" << KeyMax << ' ' << key.objsize() << ' ' << idx.indexNamespace() << endl;
             return 2;
         }
         assert( key.objsize() > 0 );
@@ -903,8 +1139,8 @@ found:
                             IndexDetails& idx, bool toplevel)
     {
         if ( toplevel ) {
-            if ( key.objsize() > KeyMax ) {
-                problem() << "Btree::insert: key too large to index, skipping " << idx.indexNamespace().c_str() << ' ' << key.objsize() << ' ' << key.toString() << endl;
+            if ( keySize(key, order) > KeyMax ) {
+                problem() << "Btree::insert: key too large to index, skipping " << idx.indexNamespace().c_str() << ' ' << keySize(key, order) << ' ' << key.toString() << endl;
                 return 3;
             }
         }
@@ -922,8 +1158,8 @@ found:
     DiskLoc BtreeBucket::findSingle( const IndexDetails& indexdetails , const DiskLoc& thisLoc, const BSONObj& key ){
         int pos;
         bool found;
-        /* TODO: is it really ok here that the order is a default? */
-        Ordering o = Ordering::make(BSONObj());
+        // the index's own order: CompactKeys buckets hold keys encoded with it
+        Ordering o = Ordering::make(indexdetails.keyPattern());
         DiskLoc bucket = locate( indexdetails , indexdetails.head , key , o , pos , found , minDiskLoc );
         if ( bucket.isNull() )
             return bucket;
@@ -938,10 +1174,13 @@ found:
                 return bucket;
             b = bucket.btree();
         }
-        KeyNode kn = b->keyNode( pos );
-        if ( key.woCompare( kn.key ) != 0 )
+        BufBuilder stored(0);
+        int comparableSize = 0;
+        if ( b->compactKeys() )
+            storedKey(key, o, stored, comparableSize);
+        if ( b->compareKey( pos, key, stored.buf(), comparableSize, o ) != 0 )
             return DiskLoc();
-        return kn.recordLoc;
+        return b->k(pos).recordLoc;
     }
 
 } // namespace mongo
@@ -1032,8 +1271,8 @@ namespace mongo {
 
         if ( ! b->_pushBack(loc, key, ordering, DiskLoc()) ){
             // no room
-            if ( key.objsize() > KeyMax ) {
-                problem() << "Btree::insert: key too large to index, skipping " << idx.indexNamespace().c_str() << ' ' << key.objsize() << ' ' << key.toString() << endl;
+            if ( b->keySize(key, ordering) > KeyMax ) {
+                problem() << "Btree::insert: key too large to index, skipping " << idx.indexNamespace().c_str() << ' ' << b->keySize(key, ordering) << ' ' << key.toString() << endl;
             }
             else { 
                 // bucket was full
@@ -111,8 +111,8 @@ namespace mongo {
         /**
          * @return true if works, false if not enough space
          */
-        bool _pushBack(const DiskLoc& recordLoc, BSONObj& key, const Ordering &order, DiskLoc prevChild);
-        void pushBack(const DiskLoc& recordLoc, BSONObj& key, const Ordering &order, DiskLoc prevChild){
+        bool _pushBack(const DiskLoc& recordLoc, const BSONObj& key, const Ordering &order, DiskLoc prevChild);
+        void pushBack(const DiskLoc& recordLoc, const BSONObj& key, const Ordering &order, DiskLoc prevChild){
             bool ok = _pushBack( recordLoc , key , order , prevChild );
             assert(ok);
         }
@@ -122,14 +122,22 @@ namespace mongo {
         /* !Packed means there is deleted fragment space within the bucket.
            We "repack" when we run out of space before considering the node
            to be full.
+
+           CompactKeys means keys are stored as KeyStrings rather than BSON, with the
+           bytes every key in the bucket has in common stored once (see _setPrefix).
+           Each key's data is then a 2 byte length followed by the rest of its KeyString.
+           Keys that can't be encoded are stored as 0xff followed by the BSON key.
            */
-        enum Flags { Packed=1 };
+        enum Flags { Packed=1, CompactKeys=2 };
+
+        bool compactKeys() const { return flags & CompactKeys; }
 
         DiskLoc& childForPos(int p) {
             return p == n ? nextChild : k(p).prevChildBucket;
         }
 
         int totalDataSize() const;
+        int keyDataSize(const _KeyNode& kn) const;
         void pack( const Ordering &order );
         void setNotPacked();
         void setPacked();
@@ -138,6 +146,27 @@ namespace mongo {
         void truncateTo(int N, const Ordering &order);
         void markUnused(int keypos);
 
+        /* CompactKeys buckets ------------------------------------------------- */
+
+        /* key as it is stored in a CompactKeys bucket, before prefix compression.
+           comparableSize is 0 if the key is stored as BSON.
+        */
+        static void storedKey(const BSONObj& key, const Ordering &order, BufBuilder& b, int& comparableSize);
+        BSONObj keyObj(const _KeyNode& kn) const;
+        /* bytes key takes up in this bucket, which is what KeyMax limits */
+        int keySize(const BSONObj& key, const Ordering &order);
+        const char * prefix() const { return data + _prefixOfs; }
+        int fullKeySize(const _KeyNode& kn) const;
+        void fullKey(const _KeyNode& kn, char *dest) const;
+        /* like key.woCompare(keyNode(i).key, order), but with memcmp when both keys are KeyStrings */
+        int compareKey(int i, const BSONObj& key, const char *stored, int comparableSize, const Ordering &order) const;
+        /* like keyNode(i).key.woEqual(key), false if i is out of range.  a CompactKeys key is compared
+           as stored, with stored: key from storedKey(), which is filled in here if empty */
+        bool keyEquals(int i, const BSONObj& key, const Ordering &order, BufBuilder& stored) const;
+        int commonPrefix(const char *s, int len) const;
+        bool _setPrefix(const char *src, int len);
+        bool _insertCompact(int keypos, const DiskLoc& recordLoc, const BSONObj& key, const Ordering &order);
+
         /* BtreeBuilder uses the parent var as a temp place to maintain a linked list chain. 
            we use tempNext() when we do that to be less confusing. (one might have written a union in C)
            */
@@ -167,7 +196,7 @@ namespace mongo {
 
     private:
         unsigned short _wasSize; // can be reused, value is 8192 in current pdfile version Apr2010
-        unsigned short _reserved1; // zero
+        unsigned short _prefixOfs; // CompactKeys only, else zero
 
     protected:
         int Size() const;
@@ -175,7 +204,7 @@ namespace mongo {
         int emptySize; // size of the empty region
         int topSize; // size of the data at the top of the bucket (keys are at the beginning or 'bottom')
         int n; // # of keys so far.
-        int reserved;
+        int _prefixLen; // CompactKeys only, else zero
         const _KeyNode& k(int i) const {
             return ((_KeyNode*)data)[i];
         }
@@ -246,7 +275,7 @@ namespace mongo {
         void delBucket(const DiskLoc& thisLoc, IndexDetails&);
         void delKeyAtPos(const DiskLoc& thisLoc, IndexDetails& id, int p);
         BSONObj keyAt(int keyOfs) {
-            return keyOfs >= n ? BSONObj() : keyNode(keyOfs).key;
+            return keyOfs >= n ? BSONObj() : keyObj(k(keyOfs));
         }
         static BtreeBucket* allocTemp(); /* caller must release with free() */
         void insertHere(DiskLoc thisLoc, int keypos,
@@ -306,14 +335,18 @@ namespace mongo {
             assert( !bucket.isNull() );
             return bucket.btree()->keyNode(keyOfs);
         }
-        virtual BSONObj currKey() const {
-            return currKeyNode().key;
-        }
+        virtual BSONObj currKey() const;
 
         virtual BSONObj indexKeyPattern() {
             return indexDetails.keyPattern();
         }
 
+        virtual bool isMultiKey() const {
+            // not 'multikey', which is only updated on getMore.  an index built before 
+            // multiKeyExactBits may hold {a:[5]} as 5 without being marked, so assume the worst
+            return d->isMultikey( idxNo ) || !d->isMultikeyExact( idxNo );
+        }
+
         virtual void aboutToDeleteBucket(const DiskLoc& b) {
             if ( bucket == b )
                 keyOfs = -1;
@@ -356,6 +389,16 @@ namespace mongo {
         
         void forgetEndKey() { endKey = BSONObj(); }
 
+        /* true if the cursor covers a single key in forward order, so it returns records in DiskLoc order */
+        bool singleKey() const {
+            if ( bounds_.size() > 1 || direction < 0 )
+                return false;
+            return endKeyInclusive_ && startKey.woCompare( endKey, BSONObj(), false ) == 0;
+        }
+
+        /* position the cursor at the first entry at or after loc.  only for singleKey() cursors */
+        void skipTo( const DiskLoc &loc );
+
         virtual CoveredIndexMatcher *matcher() const { return _matcher.get(); }
         
         virtual void setMatcher( auto_ptr< CoveredIndexMatcher > matcher ) {
@@ -391,6 +434,9 @@ namespace mongo {
 
         const IndexDetails& indexDetails;
         BSONObj order;
+        Ordering _ordering;
+        string _endKeyStored; // endKey as stored in CompactKeys buckets, so checkEnd() can memcmp
+        int _endKeyComparable;
         DiskLoc bucket;
         int keyOfs;
         int direction; // 1=fwd,-1=reverse
@@ -400,8 +446,49 @@ namespace mongo {
         unsigned boundIndex_;
         const IndexSpec& _spec;
         auto_ptr< CoveredIndexMatcher > _matcher;
+        /* currKey() of a CompactKeys bucket, decoded once for the position it was at.  forgotten by
+           checkLocation(), as the bucket may have changed */
+        mutable BSONObj _currKey;
+        mutable DiskLoc _currKeyBucket;
+        mutable int _currKeyOfs;
     };
 
+    /* Returns the records found by all of several BtreeCursors, each over a single key.
+       Within a key the btree is ordered by DiskLoc, so the cursors are walked together,
+       each skipping ahead to the largest DiskLoc any of them is at.
+    */
+    class IntersectCursor : public Cursor {
+    public:
+        IntersectCursor( const vector< shared_ptr< BtreeCursor > > &cursors );
+        virtual bool ok() { return !_curr.isNull(); }
+        virtual Record* _current() {
+            assert( ok() );
+            return _curr.rec();
+        }
+        virtual BSONObj current() { return BSONObj( _current() ); }
+        virtual DiskLoc currLoc() { return _curr; }
+        virtual DiskLoc refLoc() { return _curr; }
+        virtual bool advance();
+        virtual void noteLocation();
+        virtual void checkLocation();
+        virtual void aboutToDeleteBucket( const DiskLoc& b );
+        virtual bool supportGetMore() { return true; }
+        // an index holds a key only once per record, so each cursor returns a record at most once
+        virtual bool getsetdup( DiskLoc loc ) { return false; }
+        virtual bool isMultiKey() const;
+        virtual string toString();
+        virtual BSONArray prettyIndexBounds() const;
+        virtual CoveredIndexMatcher *matcher() const { return _matcher.get(); }
+        virtual void setMatcher( auto_ptr< CoveredIndexMatcher > matcher ) {
+            _matcher = matcher;
+        }
+    private:
+        /* move the cursors forward until they agree on a DiskLoc after _curr */
+        void align();
+        vector< shared_ptr< BtreeCursor > > _cursors;
+        DiskLoc _curr;
+        auto_ptr< CoveredIndexMatcher > _matcher;
+    };
 
     inline bool IndexDetails::hasKey(const BSONObj& key) { 
         return head.btree()->exists(*this, head, key, Ordering::make(keyPattern()));
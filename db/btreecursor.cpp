@@ -21,6 +21,7 @@
 #include "pdfile.h"
 #include "jsobj.h"
 #include "curop.h"
+#include "filever.h"
 
 namespace mongo {
 
@@ -35,9 +36,11 @@ namespace mongo {
             multikey( d->isMultikey( idxNo ) ),
             indexDetails( _id ),
             order( _id.keyPattern() ),
+            _ordering( Ordering::make( order ) ),
             direction( _direction ),
             boundIndex_(),
-            _spec( _id.getSpec() )
+            _spec( _id.getSpec() ),
+            _currKeyOfs( -1 )
     {
         audit();
         init();
@@ -51,10 +54,12 @@ namespace mongo {
             multikey( d->isMultikey( idxNo ) ),
             indexDetails( _id ),
             order( _id.keyPattern() ),
+            _ordering( Ordering::make( order ) ),
             direction( _direction ),
             bounds_( _bounds ),
             boundIndex_(),
-            _spec( _id.getSpec() )
+            _spec( _id.getSpec() ),
+            _currKeyOfs( -1 )
     {
         assert( !bounds_.empty() );
         audit();
@@ -78,13 +83,19 @@ namespace mongo {
     }
 
     void BtreeCursor::init() {
+        checkIndexFileVersion( *d );
         if ( _spec.getType() ){
             startKey = _spec.getType()->fixKey( startKey );
             endKey = _spec.getType()->fixKey( endKey );
         }
+        {
+            BufBuilder b;
+            BtreeBucket::storedKey( endKey, _ordering, b, _endKeyComparable );
+            _endKeyStored = string( b.buf(), b.len() );
+        }
         bool found;
         bucket = indexDetails.head.btree()->
-            locate(indexDetails, indexDetails.head, startKey, Ordering::make(order), keyOfs, found, direction > 0 ? minDiskLoc : maxDiskLoc, direction);
+            locate(indexDetails, indexDetails.head, startKey, _ordering, keyOfs, found, direction > 0 ? minDiskLoc : maxDiskLoc, direction);
         skipUnusedKeys();
         checkEnd();        
     }
@@ -126,7 +137,7 @@ namespace mongo {
         if ( bucket.isNull() )
             return;
         if ( !endKey.isEmpty() ) {
-            int cmp = sgn( endKey.woCompare( currKey(), order ) );
+            int cmp = sgn( bucket.btree()->compareKey( keyOfs, endKey, _endKeyStored.c_str(), _endKeyComparable, _ordering ) );
             if ( ( cmp != 0 && cmp != direction ) ||
                 ( cmp == 0 && !endKeyInclusive_ ) )
                 bucket = DiskLoc();
@@ -145,9 +156,22 @@ namespace mongo {
         return !bucket.isNull();
     }
 
+    BSONObj BtreeCursor::currKey() const {
+        assert( !bucket.isNull() );
+        BtreeBucket *b = bucket.btree();
+        if ( !b->compactKeys() )
+            return b->keyAt(keyOfs); // points into the bucket, nothing to decode
+        if ( bucket != _currKeyBucket || keyOfs != _currKeyOfs ) {
+            _currKey = b->keyAt(keyOfs);
+            _currKeyBucket = bucket;
+            _currKeyOfs = keyOfs;
+        }
+        return _currKey;
+    }
+
     void BtreeCursor::noteLocation() {
         if ( !eof() ) {
-            BSONObj o = bucket.btree()->keyAt(keyOfs).copy();
+            BSONObj o = currKey().getOwned();
             keyAtKeyOfs = o;
             locAtKeyOfs = bucket.btree()->k(keyOfs).recordLoc;
         }
@@ -167,17 +191,19 @@ namespace mongo {
             return;
 
         multikey = d->isMultikey(idxNo);
+        _currKeyBucket = DiskLoc();
 
         if ( keyOfs >= 0 ) {
             BtreeBucket *b = bucket.btree();
 
             assert( !keyAtKeyOfs.isEmpty() );
 
-            // Note keyAt() returns an empty BSONObj if keyOfs is now out of range,
+            // Note keyEquals() is false if keyOfs is now out of range,
             // which is possible as keys may have been deleted.
+            BufBuilder stored(0);
             int x = 0;
             while( 1 ) {
-                if ( b->keyAt(keyOfs).woEqual(keyAtKeyOfs) &&
+                if ( b->keyEquals(keyOfs, keyAtKeyOfs, _ordering, stored) &&
                     b->k(keyOfs).recordLoc == locAtKeyOfs ) {
                         if ( !b->k(keyOfs).isUsed() ) {
                             /* we were deleted but still exist as an unused
@@ -204,13 +230,104 @@ namespace mongo {
         bool found;
 
         /* TODO: Switch to keep indexdetails and do idx.head! */
-        bucket = indexDetails.head.btree()->locate(indexDetails, indexDetails.head, keyAtKeyOfs, Ordering::make(order), keyOfs, found, locAtKeyOfs, direction);
+        bucket = indexDetails.head.btree()->locate(indexDetails, indexDetails.head, keyAtKeyOfs, _ordering, keyOfs, found, locAtKeyOfs, direction);
         RARELY log() << "  key seems to have moved in the index, refinding. found:" << found << endl;
         if ( ! bucket.isNull() )
             skipUnusedKeys();
 
     }
 
+    void BtreeCursor::skipTo( const DiskLoc &loc ) {
+        dassert( singleKey() );
+        if ( eof() )
+            return;
+        bool found;
+        bucket = indexDetails.head.btree()->locate(indexDetails, indexDetails.head, startKey, _ordering, keyOfs, found, loc, direction);
+        skipUnusedKeys();
+        checkEnd();
+    }
+
+    /* ----------------------------------------------------------------------------- */
+
+    IntersectCursor::IntersectCursor( const vector< shared_ptr< BtreeCursor > > &cursors ) : _cursors( cursors ) {
+        assert( _cursors.size() > 1 );
+        align();
+    }
+
+    void IntersectCursor::align() {
+        while( 1 ) {
+            DiskLoc target;
+            for( vector< shared_ptr< BtreeCursor > >::iterator i = _cursors.begin(); i != _cursors.end(); ++i ) {
+                if ( !(*i)->ok() ) {
+                    _curr = DiskLoc();
+                    return;
+                }
+                if ( target.isNull() || target < (*i)->currLoc() )
+                    target = (*i)->currLoc();
+            }
+            bool aligned = true;
+            for( vector< shared_ptr< BtreeCursor > >::iterator i = _cursors.begin(); i != _cursors.end(); ++i ) {
+                if ( (*i)->currLoc() < target ) {
+                    (*i)->skipTo( target );
+                    aligned = false;
+                }
+            }
+            if ( aligned ) {
+                _curr = target;
+                return;
+            }
+        }
+    }
+
+    bool IntersectCursor::advance() {
+        killCurrentOp.checkForInterrupt();
+        if ( eof() )
+            return false;
+        _cursors[ 0 ]->advance();
+        align();
+        return ok();
+    }
+
+    void IntersectCursor::noteLocation() {
+        for( vector< shared_ptr< BtreeCursor > >::iterator i = _cursors.begin(); i != _cursors.end(); ++i )
+            (*i)->noteLocation();
+    }
+
+    void IntersectCursor::checkLocation() {
+        if ( eof() )
+            return;
+        for( vector< shared_ptr< BtreeCursor > >::iterator i = _cursors.begin(); i != _cursors.end(); ++i )
+            (*i)->checkLocation();
+        // if our record was deleted some cursors will have moved past it
+        align();
+    }
+
+    void IntersectCursor::aboutToDeleteBucket( const DiskLoc& b ) {
+        for( vector< shared_ptr< BtreeCursor > >::iterator i = _cursors.begin(); i != _cursors.end(); ++i )
+            (*i)->aboutToDeleteBucket( b );
+    }
+
+    bool IntersectCursor::isMultiKey() const {
+        for( vector< shared_ptr< BtreeCursor > >::const_iterator i = _cursors.begin(); i != _cursors.end(); ++i )
+            if ( (*i)->isMultiKey() )
+                return true;
+        return false;
+    }
+
+    string IntersectCursor::toString() {
+        string s = "IntersectCursor";
+        for( vector< shared_ptr< BtreeCursor > >::iterator i = _cursors.begin(); i != _cursors.end(); ++i )
+            s += ( i == _cursors.begin() ? " " : ", " ) + (*i)->toString();
+        return s;
+    }
+
+    BSONArray IntersectCursor::prettyIndexBounds() const {
+        BSONArrayBuilder ba;
+        for( vector< shared_ptr< BtreeCursor > >::const_iterator i = _cursors.begin(); i != _cursors.end(); ++i )
+            ba << (*i)->prettyIndexBounds();
+        return ba.arr();
+    }
+
     /* ----------------------------------------------------------------------------- */
 
     struct BtreeCursorUnitTest {
@@ -158,6 +158,9 @@ namespace mongo {
         OpTime _lastOp;
         BSONObj _handshake;
         BSONObj _remoteId;
+        bool _compressReplies;
+        bool _mayDeferGetMore;
+        int _awaitDataPasses;
 
     public:
         string clientAddress() const;
@@ -210,6 +213,18 @@ namespace mongo {
 
         BSONObj getRemoteID() const { return _remoteId; }
         BSONObj getHandshake() const { return _handshake; }
+
+        /* replies to this connection go out compressed -- see setCompression */
+        bool compressReplies() const { return _compressReplies; }
+        void setCompressReplies( bool c ) { _compressReplies = c; }
+
+        /* a getMore waiting for data (QueryOption_AwaitData) may give up its thread between passes
+           by throwing MessageDeferred -- set for connections read by an event loop.  
+           awaitDataPasses() is how many passes the deferred getMore has had, so that it waits 
+           as long either way. */
+        bool mayDeferGetMore() const { return _mayDeferGetMore; }
+        void setMayDeferGetMore( bool d ) { _mayDeferGetMore = d; }
+        int& awaitDataPasses() { return _awaitDataPasses; }
     };
     
     inline Client& cc() { 
@@ -248,8 +263,10 @@ namespace mongo {
 #endif
 
             _writelock = true;
+            _timer.relocking( 1 );
             dbMutex.unlock_shared();
             dbMutex.lock();
+            _timer.acquired();
 
             if ( cc().getContext() )
                 cc().getContext()->unlocked();
@@ -200,10 +200,15 @@ namespace mongo {
         }
     }
     
-    bool ClientCursor::yield() {
+    bool ClientCursor::_yield( const Record *waitFor ) {
         // need to store on the stack in case this gets deleted
         CursorId id = cursorid;
 
+        // how much to wait for.  only the header's page if that one isn't in either
+        int waitLen = 0;
+        if ( waitFor )
+            waitLen = MemoryMappedFile::resident( waitFor, Record::HeaderSize ) ? waitFor->lengthWithHeaders : Record::HeaderSize;
+
         bool doingDeletes = _doingDeletes;
         _doingDeletes = false;
 
@@ -233,8 +238,18 @@ namespace mongo {
             
         {
             dbtempreleasecond unlock;
-            if ( unlock.unlocked() )
-                sleepmicros( Client::recommendedYieldMicros() );
+            if ( unlock.unlocked() ) {
+                if ( waitFor ) {
+                    // the record could go away while we're unlocked, so it is only advised and 
+                    // checked on here, never read
+                    MemoryMappedFile::willNeed( waitFor, waitLen );
+                    for( int i = 0; i < 100 && !MemoryMappedFile::resident( waitFor, waitLen ); i++ )
+                        sleepmicros( 100 );
+                }
+                else {
+                    sleepmicros( Client::recommendedYieldMicros() );
+                }
+            }
             else
                 log() << "ClientCursor::yield can't unlock b/c of recursive lock" << endl;
         }
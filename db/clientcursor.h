@@ -145,7 +145,17 @@ namespace mongo {
          *         if false is returned, then this ClientCursor should be considered deleted - 
          *         in fact, the whole database could be gone.
          */
-        bool yield();
+        bool yield() { return _yield( 0 ); }
+
+        /**
+         * like yield(), but while unlocked wait (briefly) for rec, which the caller is about to read and 
+         * which is not in physical memory, to be read in -- so that the disk read doesn't hold up 
+         * everyone else behind the lock.  rec is not touched while unlocked.
+         * the cursor may have moved on return, so the caller must look at its position again.
+         * a getMore calls this with the cursor pinned by a Pointer; on false that Pointer must be 
+         * dropped without release().
+         */
+        bool yieldForPageFault( const Record *rec ) { return _yield( rec ); }
 
         struct YieldLock : boost::noncopyable {
             explicit YieldLock( ptr<ClientCursor> cc )
@@ -232,7 +242,11 @@ namespace mongo {
             recursive_scoped_lock lock(ccmutex);
             ClientCursor *cc = find_inlock(id);
             if ( cc ) {
-                assert( cc->_pinValue < 100 ); // you can't still have an active ClientCursor::Pointer
+                if ( cc->_pinValue >= 100 ) {
+                    // a getMore has it and yielded, see yieldForPageFault().  that one goes on with it
+                    log() << "can't kill cursor " << id << ", in use" << endl;
+                    return false;
+                }
                 delete cc;
                 return true;
             }
@@ -270,6 +284,8 @@ namespace mongo {
 
         static void idleTimeReport(unsigned millis);
 private:
+        bool _yield( const Record *waitFor );
+
         // cursors normally timeout after an inactivy period to prevent excess memory use
         // setting this prevents timeout of the cursor in question.
         void noTimeout() { 
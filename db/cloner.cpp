@@ -33,10 +33,16 @@ namespace mongo {
 
     bool replAuthenticate(DBClientConnection *);
 
+    class CollectionFetcher;
+
+    /* how many collections an initial sync or clone reads from the source at once */
+    const unsigned ClonerFetchAhead = 4;
+
     class Cloner: boost::noncopyable {
         auto_ptr< DBClientWithCommands > conn;
         void copy(const char *from_ns, const char *to_ns, bool isindex, bool logForRepl,
                   bool masterSameProcess, bool slaveOk, Query q = Query());
+        void copy(CollectionFetcher& f, const char *from_ns, const char *to_ns, bool logForRepl);
         void replayOpLog( DBClientCursor *c, const BSONObj &query );
     public:
         Cloner() { }
@@ -86,6 +92,150 @@ namespace mongo {
         return res;
     }
 
+    /* assure object is valid.  note this will slow us down a little. */
+    static bool validCloned(const BSONObj& tmp, const char *from_collection) {
+        if ( tmp.valid() )
+            return true;
+        stringstream ss;
+        ss << "Cloner: skipping corrupt object from " << from_collection;
+        BSONElement e = tmp.firstElement();
+        try {
+            e.validate();
+            ss << " firstElement: " << e;
+        }
+        catch( ... ){
+            ss << " firstElement corrupt";
+        }
+        out() << ss.str() << endl;
+        return false;
+    }
+
+    static void insertCloned(const char *from_collection, const char *to_collection, BSONObj js, bool logForRepl) {
+        try { 
+            theDataFileMgr.insertWithObjMod(to_collection, js);
+            if ( logForRepl )
+                logOp("i", to_collection, js);
+        }
+        catch( UserException& e ) { 
+            log() << "warning: exception cloning object in " << from_collection << ' ' << e.what() << " obj:" << js.toString() << '\n';
+        }
+    }
+
+    /* reads one collection from the source, over a connection of its own and on a thread of its
+       own.  while the cloner holds the lock inserting one collection, the next few are already
+       coming over the network.  at most BufferBytes of documents are held waiting.
+    */
+    class CollectionFetcher : boost::noncopyable {
+    public:
+        enum { BufferBytes = 16 * 1024 * 1024, BatchDocs = 128 };
+
+        CollectionFetcher(DBClientConnection *conn, const string& ns, const Query& q, bool slaveOk) :
+            _conn(conn), _ns(ns), _query(q), _slaveOk(slaveOk), _m("CollectionFetcher"),
+            _bytes(0), _done(false), _stop(false),
+            _thread( boost::bind( &CollectionFetcher::run, this ) ) { }
+
+        /* joins the thread, which may be waiting on the network -- so call without the db lock
+           unless the collection was read to the end. */
+        ~CollectionFetcher() {
+            stop();
+            _thread.join();
+        }
+
+        /* don't read any further */
+        void stop() {
+            scoped_lock lk( _m );
+            _stop = true;
+            _changed.notify_all();
+        }
+
+        /* the next documents of the collection, blocking until there are some.  call without
+           the db lock.
+           @return false at the end
+        */
+        bool next(vector<BSONObj>& batch) {
+            batch.clear();
+            scoped_lock lk( _m );
+            while( _buf.empty() && !_done )
+                _changed.wait( lk.boost() );
+            while( !_buf.empty() && batch.size() < BatchDocs ) {
+                _bytes -= _buf.front().objsize();
+                batch.push_back( _buf.front() );
+                _buf.pop_front();
+            }
+            _changed.notify_all();
+            massert( 13297 , "Cloner: reading " + _ns + " failed: " + _err , !batch.empty() || _err.empty() );
+            return !batch.empty();
+        }
+
+    private:
+        void run() {
+            string err;
+            try {
+                auto_ptr<DBClientCursor> c = _conn->query( _ns.c_str(), _query, 0, 0, 0, QueryOption_NoCursorTimeout | ( _slaveOk ? QueryOption_SlaveOk : 0 ) );
+                if ( c.get() == 0 )
+                    err = "socket error";
+                while ( err.empty() && c->more() ) {
+                    BSONObj o = c->next().getOwned();
+                    scoped_lock lk( _m );
+                    while( _bytes >= BufferBytes && !_stop )
+                        _changed.wait( lk.boost() );
+                    if ( _stop )
+                        return;
+                    _bytes += o.objsize();
+                    _buf.push_back( o );
+                    _changed.notify_all();
+                }
+            }
+            catch( std::exception& e ) {
+                err = e.what();
+            }
+            catch( ... ) {
+                err = "unknown exception";
+            }
+            scoped_lock lk( _m );
+            _err = err;
+            _done = true;
+            _changed.notify_all();
+        }
+
+        scoped_ptr<DBClientConnection> _conn;
+        const string _ns;
+        const Query _query;
+        const bool _slaveOk;
+
+        mongo::mutex _m; // protects the rest
+        boost::condition _changed;
+        list<BSONObj> _buf;
+        int _bytes;
+        bool _done;
+        bool _stop;
+        string _err;
+
+        boost::thread _thread;
+    };
+
+    /* if Cloner::go() leaves early, stops the fetchers still running and waits for their threads
+       without the db lock, before the rest of the stack unwinds. */
+    class StopFetchers : boost::noncopyable {
+    public:
+        StopFetchers(vector< shared_ptr<CollectionFetcher> >& fetchers) : _fetchers(fetchers) { }
+        ~StopFetchers() {
+            bool any = false;
+            for ( unsigned i = 0; i < _fetchers.size(); i++ ) {
+                if ( _fetchers[i] ) {
+                    _fetchers[i]->stop();
+                    any = true;
+                }
+            }
+            if ( !any )
+                return;
+            dbtempreleasecond unlock;
+            _fetchers.clear();
+        }
+    private:
+        vector< shared_ptr<CollectionFetcher> >& _fetchers;
+    };
+
     /* copy the specified collection
        isindex - if true, this is system.indexes collection, in which we do some transformation when copying.
     */
@@ -109,21 +259,8 @@ namespace mongo {
             }
             BSONObj tmp = c->next();
 
-            /* assure object is valid.  note this will slow us down a little. */
-            if ( !tmp.valid() ) {
-                stringstream ss;
-                ss << "Cloner: skipping corrupt object from " << from_collection;
-                BSONElement e = tmp.firstElement();
-                try {
-                    e.validate();
-                    ss << " firstElement: " << e;
-                }
-                catch( ... ){
-                    ss << " firstElement corrupt";
-                }
-                out() << ss.str() << endl;
+            if ( !validCloned( tmp, from_collection ) )
                 continue;
-            }
 
             ++n;
             
@@ -135,14 +272,7 @@ namespace mongo {
                 continue;
             }
 
-            try { 
-                theDataFileMgr.insertWithObjMod(to_collection, js);
-                if ( logForRepl )
-                    logOp("i", to_collection, js);
-            }
-            catch( UserException& e ) { 
-                log() << "warning: exception cloning object in " << from_collection << ' ' << e.what() << " obj:" << js.toString() << '\n';
-            }
+            insertCloned( from_collection, to_collection, js, logForRepl );
             
             RARELY if ( time( 0 ) - saveLast > 60 ) {
                 log() << n << " objects cloned so far from collection " << from_collection << endl;
@@ -151,19 +281,52 @@ namespace mongo {
         }
 
         if ( storedForLater.size() ){
-            for ( list<BSONObj>::iterator i = storedForLater.begin(); i!=storedForLater.end(); i++ ){
-                BSONObj js = *i;
-                try { 
-                    theDataFileMgr.insertWithObjMod(to_collection, js);
-                    if ( logForRepl )
-                        logOp("i", to_collection, js);
-                }
-                catch( UserException& e ) { 
-                    log() << "warning: exception cloning object in " << from_collection << ' ' << e.what() << " obj:" << js.toString() << '\n';
-                }
+            for ( list<BSONObj>::iterator i = storedForLater.begin(); i!=storedForLater.end(); i++ )
+                insertCloned( from_collection, to_collection, *i, logForRepl );
+        }
+    }
+
+    /* copy a collection as it comes in from a CollectionFetcher */
+    void Cloner::copy(CollectionFetcher& f, const char *from_collection, const char *to_collection, bool logForRepl) {
+        vector<BSONObj> batch;
+        long long n = 0;
+        time_t saveLast = time( 0 );
+        while ( 1 ) {
+            {
+                dbtemprelease r;
+                if ( !f.next( batch ) )
+                    break;
+            }
+            for ( unsigned i = 0; i < batch.size(); i++ ) {
+                if ( !validCloned( batch[i], from_collection ) )
+                    continue;
+                ++n;
+                insertCloned( from_collection, to_collection, batch[i], logForRepl );
+            }
+
+            RARELY if ( time( 0 ) - saveLast > 60 ) {
+                log() << n << " objects cloned so far from collection " << from_collection << endl;
+                saveLast = time( 0 );
             }
         }
     }
+
+    /* another connection to the source, for a CollectionFetcher.  0 if it can't be had, in which
+       case the collection is copied over the main connection as usual.
+    */
+    static DBClientConnection* fetcherConnection(const char *masterHost) {
+        auto_ptr< DBClientConnection > c( new DBClientConnection() );
+        string errmsg;
+        if ( !c->connect( masterHost, errmsg ) ) {
+            log() << "cloner: couldn't make a fetch connection to " << masterHost << ": " << errmsg << endl;
+            return 0;
+        }
+        if( !replAuthenticate(c.get()) ) {
+            log() << "cloner: couldn't authenticate a fetch connection to " << masterHost << endl;
+            return 0;
+        }
+        return c.release();
+    }
     
     bool Cloner::go(const char *masterHost, string& errmsg, const string& fromdb, bool logForRepl, bool slaveOk, bool useReplAuth, bool snapshot) {
 
@@ -186,7 +349,10 @@ namespace mongo {
            or just wait until we get rid of global lock anyway.
            */
         string ns = fromdb + ".system.namespaces";
-        list<BSONObj> toClone;
+        vector<BSONObj> toClone;
+        /* collections are read ahead over connections of their own when we're talking to
+           another server ourselves -- see CollectionFetcher */
+        bool fetchAhead = false;
         {  
             dbtemprelease r;
 		
@@ -202,6 +368,7 @@ namespace mongo {
                         return false;
                     
                     conn = c;
+                    fetchAhead = true;
                 } else {
                     conn.reset( new DBDirectClient() );
                 }
@@ -243,11 +410,24 @@ namespace mongo {
             }
         }
 
-        for ( list<BSONObj>::iterator i=toClone.begin(); i != toClone.end(); i++ ){
+        Query q;
+        if( snapshot ) 
+            q.snapshot();
+
+        vector< shared_ptr<CollectionFetcher> > fetchers( toClone.size() );
+        StopFetchers stopFetchers( fetchers );
+        unsigned nFetchersStarted = 0;
+        for ( unsigned i = 0; i < toClone.size(); i++ ){
             {
                 dbtemprelease r;
+                while ( fetchAhead && nFetchersStarted < toClone.size() && nFetchersStarted < i + ClonerFetchAhead ) {
+                    unsigned j = nFetchersStarted++;
+                    DBClientConnection *fc = fetcherConnection( masterHost );
+                    if ( fc )
+                        fetchers[j].reset( new CollectionFetcher( fc, toClone[j]["name"].valuestr(), q, slaveOk ) );
+                }
             }
-            BSONObj collection = *i;
+            BSONObj collection = toClone[i];
             log(2) << "  really will clone: " << collection << endl;
             const char * from_name = collection["name"].valuestr();
             BSONObj options = collection.getObjectField("options");
@@ -257,16 +437,31 @@ namespace mongo {
             assert(p);
             string to_name = todb + p;
 
+            bool buildIdIndexAfter = false;
             {
                 string err;
                 const char *toname = to_name.c_str();
                 userCreateNS(toname, options, err, logForRepl);
+
+                /* on an initial sync, fill the collection without maintaining its _id index, then
+                   build that in one go from sorted keys.  other indexes are built after all the
+                   data is in, below. */
+                NamespaceDetails *d = nsdetails(toname);
+                if ( useReplAuth && d && !d->capped && d->nrecords == 0 && d->nIndexes == 1 && d->idx(0).isIdIndex() ) {
+                    BSONObjBuilder res;
+                    buildIdIndexAfter = dropIndexes(d, toname, "_id_", err, res, true);
+                }
             }
             log(1) << "\t\t cloning " << from_name << " -> " << to_name << endl;
-            Query q;
-            if( snapshot ) 
-                q.snapshot();
-            copy(from_name, to_name.c_str(), false, logForRepl, masterSameProcess, slaveOk, q);
+            if ( fetchers[i] ) {
+                copy(*fetchers[i], from_name, to_name.c_str(), logForRepl);
+                fetchers[i].reset();
+            }
+            else {
+                copy(from_name, to_name.c_str(), false, logForRepl, masterSameProcess, slaveOk, q);
+            }
+            if ( buildIdIndexAfter )
+                buildIdIndexDroppingDups(to_name.c_str());
         }
 
         // now build the indexes
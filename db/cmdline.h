@@ -35,6 +35,7 @@ namespace mongo {
         bool notablescan;      // --notablescan
         bool prealloc;         // --noprealloc
         bool smallfiles;       // --smallfiles
+        bool compactKeys;      // --compactKeys
         
         bool quota;            // --quota
         int quotaFiles;        // --quotaFiles
@@ -51,7 +52,7 @@ namespace mongo {
         };
 
         CmdLine() : 
-            port(DefaultDBPort), rest(false), quiet(false), notablescan(false), prealloc(true), smallfiles(false),
+            port(DefaultDBPort), rest(false), quiet(false), notablescan(false), prealloc(true), smallfiles(false), compactKeys(false),
             quota(false), quotaFiles(8), cpu(false), oplogSize(0), defaultProfile(0), slowMS(100)
         { } 
         
@@ -11,4 +11,6 @@ namespace mongo {
     /* we use new here so we don't have to worry about destructor orders at program shutdown */
     MongoMutex &dbMutex( *(new MongoMutex("rw:dbMutex")) );
 
+    ThreadLocalValue<LockUsageTimer*> LockUsageTimer::_current;
+
 }
@@ -43,6 +43,16 @@ namespace mongo {
     void curopWaitingForLock( int type );
     void curopGotLock();
 
+    /* per database lock accounting.  there is still only dbMutex, so this records which database
+       an acquisition was on behalf of, how long it waited and how long it held the lock.
+       implemented in stats/counters.cpp; reported by serverStatus under "locks".
+    */
+    struct LockUsage;
+    /* the counters for ns's database.  after the first time a database is seen this neither
+       allocates nor takes a mutex */
+    LockUsage* lockUsageFor( const string& ns );
+    void recordLockUsage( LockUsage *u , int type , unsigned long long timeAcquiringMicros , unsigned long long timeLockedMicros );
+
     /* mutex time stats */
     class MutexInfo {
         unsigned long long start, enter, timeLocked; // all in microseconds
@@ -209,43 +219,133 @@ namespace mongo {
     inline void dbunlocking_write() { }
     inline void dbunlocking_read() { }
 
+    /* times the outermost acquisition of dbMutex for recordLockUsage().
+       recursive acquisitions are not counted, their time belongs to the outer lock.  neither is
+       the time inside a dbtemprelease, other than waiting to get the lock back.
+    */
+    class LockUsageTimer : boost::noncopyable {
+        LockUsage *_usage;
+        int _type; // 0 if we are not the outermost lock
+        unsigned long long _start, _acquired;
+        unsigned long long _waited, _held; // so far, across dbtemprelease
+        static ThreadLocalValue<LockUsageTimer*> _current; // the outermost timer of this thread
+        void record() {
+            recordLockUsage( _usage , _type , _waited , _held );
+            _waited = _held = 0;
+        }
+    public:
+        LockUsageTimer() : _usage(0), _type(0), _start(0), _acquired(0), _waited(0), _held(0) { }
+        void acquiring( const string& ns , int type ) {
+            if ( dbMutex.getState() != 0 )
+                return;
+            _usage = lockUsageFor( ns );
+            _type = type;
+            _start = curTimeMicros64();
+        }
+        void acquired() {
+            if ( _type == 0 )
+                return;
+            _acquired = curTimeMicros64();
+            _waited += _acquired - _start;
+            _current.set( this );
+        }
+        /* the lock wasn't got after all (readlocktry) */
+        void cancel() {
+            _type = 0;
+        }
+        void released() {
+            if ( _type == 0 )
+                return;
+            _held += curTimeMicros64() - _acquired;
+            record();
+            _type = 0;
+            _current.set( 0 );
+        }
+        /* lock is being released and retaken as type, e.g. mongolock::releaseAndWriteLock() */
+        void relocking( int type ) {
+            if ( _type == 0 )
+                return;
+            unsigned long long now = curTimeMicros64();
+            _held += now - _acquired;
+            record();
+            _type = type;
+            _start = now;
+        }
+
+        /* dbtemprelease: letting go of the lock, and waiting to get it back */
+        static void tempReleasing() {
+            LockUsageTimer *t = _current.get();
+            if ( t )
+                t->_held += curTimeMicros64() - t->_acquired;
+        }
+        static void tempRelocking() {
+            LockUsageTimer *t = _current.get();
+            if ( t )
+                t->_start = curTimeMicros64();
+        }
+        static void tempRelocked() {
+            LockUsageTimer *t = _current.get();
+            if ( t ) {
+                t->_acquired = curTimeMicros64();
+                t->_waited += t->_acquired - t->_start;
+            }
+        }
+    };
+
     struct writelock {
         writelock(const string& ns) {
+            _timer.acquiring( ns , 1 );
             dbMutex.lock();
+            _timer.acquired();
         }
         ~writelock() { 
             DESTRUCTOR_GUARD(
                 dbunlocking_write();
                 dbMutex.unlock();
+                _timer.released();
             );
         }
+    private:
+        LockUsageTimer _timer;
     };
     
     struct readlock {
         readlock(const string& ns) {
+            _timer.acquiring( ns , -1 );
             dbMutex.lock_shared();
+            _timer.acquired();
         }
         ~readlock() { 
             DESTRUCTOR_GUARD(
                 dbunlocking_read();
                 dbMutex.unlock_shared();
+                _timer.released();
             );
         }
+    private:
+        LockUsageTimer _timer;
     };	
 
     struct readlocktry {
         readlocktry( const string&ns , int tryms ){
+            _timer.acquiring( ns , -1 );
             _got = dbMutex.lock_shared_try( tryms );
+            if ( _got )
+                _timer.acquired();
+            else
+                _timer.cancel();
         }
         ~readlocktry() {
             if ( _got ){
                 dbunlocking_read();
                 dbMutex.unlock_shared();
+                _timer.released();
             }
         }
         bool got() const { return _got; }
     private:
         bool _got;
+        LockUsageTimer _timer;
     };
 
     struct readlocktryassert : public readlocktry { 
@@ -274,13 +374,16 @@ namespace mongo {
 
     class mongolock {
         bool _writelock;
+        LockUsageTimer _timer;
     public:
-        mongolock(bool write) : _writelock(write) {
+        mongolock(bool write, const string& ns) : _writelock(write) {
+            _timer.acquiring( ns , _writelock ? 1 : -1 );
             if( _writelock ) {
                 dbMutex.lock();
             }
             else
                 dbMutex.lock_shared();
+            _timer.acquired();
         }
         ~mongolock() { 
             DESTRUCTOR_GUARD(
@@ -291,6 +394,7 @@ namespace mongo {
                     dbunlocking_read();
                     dbMutex.unlock_shared();
                 }
+                _timer.released();
             );
         }
         /* this unlocks, does NOT upgrade. that works for our current usage */
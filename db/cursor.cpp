@@ -17,6 +17,7 @@
 #include "pch.h"
 #include "pdfile.h"
 #include "curop.h"
+#include "stats/counters.h"
 
 namespace mongo {
 
@@ -32,9 +33,56 @@ namespace mongo {
             last = curr;
             curr = s->next( curr );
         }
+        _readAhead.at( curr );
         return ok();
     }
 
+    void ReadAhead::at( const DiskLoc &dl ) {
+        if ( dl.isNull() )
+            return;
+        int ofs = dl.getOfs();
+        if ( dl.a() == _file && ofs >= _lo && ofs < _hi ) {
+            globalReadAheadCounters.reached( (char *) dl.rec() );
+            // nothing more in this extent, the next one was advised with the end of this one
+            if ( _extentEdge )
+                return;
+            // more once we're halfway through what was advised
+            int mid = _lo + ( _hi - _lo ) / 2;
+            if ( _forward ? ofs < mid : ofs >= mid )
+                return;
+        }
+        Record *r = dl.rec();
+        Extent *e = r->myExtent( dl );
+        int extentStart = r->extentOfs;
+        int extentEnd = extentStart + e->length;
+        int lo, hi;
+        if ( _forward ) {
+            lo = ofs;
+            hi = min( ofs + (int) Window, extentEnd );
+        }
+        else {
+            hi = ofs + r->lengthWithHeaders;
+            lo = max( hi - (int) Window, extentStart );
+        }
+        MemoryMappedFile::willNeed( (char *) e + ( lo - extentStart ), hi - lo );
+        globalReadAheadCounters.advised( hi - lo );
+        _file = dl.a();
+        _lo = lo;
+        _hi = hi;
+        _extentEdge = _forward ? hi == extentEnd : lo == extentStart;
+
+        // the end of this extent is in sight, start on the one we'll go to next
+        if ( _extentEdge ) {
+            DiskLoc n = _forward ? e->xnext : e->xprev;
+            if ( !n.isNull() ) {
+                Extent *ne = n.ext();
+                int len = min( ne->length, (int) Window );
+                MemoryMappedFile::willNeed( _forward ? (char *) ne : (char *) ne + ne->length - len, len );
+                globalReadAheadCounters.advised( len );
+            }
+        }
+    }
+
     /* these will be used outside of mutexes - really functors - thus the const */
     class Forward : public AdvanceStrategy {
         virtual DiskLoc next( const DiskLoc &prev ) const {
@@ -89,6 +137,7 @@ namespace mongo {
         }
         curr = start;
         s = this;
+        _readAhead.at( curr );
     }
 
     DiskLoc ForwardCappedCursor::next( const DiskLoc &prev ) const {
@@ -113,6 +162,7 @@ namespace mongo {
 
     ReverseCappedCursor::ReverseCappedCursor( NamespaceDetails *_nsd, const DiskLoc &startLoc ) :
             nsd( _nsd ) {
+        _readAhead.setForward( false );
         if ( !nsd )
             return;
         DiskLoc start = startLoc;
@@ -125,6 +175,7 @@ namespace mongo {
         }
         curr = start;
         s = this;
+        _readAhead.at( curr );
     }
 
     DiskLoc ReverseCappedCursor::next( const DiskLoc &prev ) const {
@@ -69,6 +69,10 @@ namespace mongo {
             return BSONObj();
         }
 
+        /* true if a key may not hold all of a field's value: a document can have more than one key,
+           or the index is too old to say */
+        virtual bool isMultiKey() const { return false; }
+
         /* called after every query block is iterated -- i.e. between getMore() blocks
            so you can note where we are, if necessary.
            */
@@ -79,6 +83,9 @@ namespace mongo {
         
         virtual bool supportGetMore() = 0;
 
+        /* false if current() isn't read from the record at currLoc(), which then mustn't be touched */
+        virtual bool currentIsRecord() const { return true; }
+
         virtual string toString() { return "abstract?"; }
 
         /* used for multikey index traversal to avoid sending back dups. see Matcher::matches().
@@ -118,11 +125,32 @@ namespace mongo {
     const AdvanceStrategy *forward();
     const AdvanceStrategy *reverse();
 
+    /* read ahead for a cursor walking records in disk order.  the next Window bytes of the extent
+       the cursor is in are advised to the OS (MemoryMappedFile::willNeed), again once it is halfway
+       through them, and the adjacent extent's first Window bytes when the end of this one is in
+       sight -- so cold data comes in with large reads instead of one page fault at a time.
+       nothing more is advised in an extent once its end is in sight.
+    */
+    class ReadAhead {
+    public:
+        enum { Window = 4 * 1024 * 1024 };
+        ReadAhead( bool forward ) : _forward( forward ), _file( -1 ), _lo( 0 ), _hi( 0 ), _extentEdge( false ) { }
+        void setForward( bool forward ) { _forward = forward; }
+        /* the cursor has moved to dl */
+        void at( const DiskLoc &dl );
+    private:
+        bool _forward;
+        int _file;     // file and range of offsets in it last advised
+        int _lo, _hi;
+        bool _extentEdge; // [_lo,_hi) reaches the end of its extent we're heading for
+    };
+
     /* table-scan style cursor */
     class BasicCursor : public Cursor {
     protected:
         DiskLoc curr, last;
         const AdvanceStrategy *s;
+        ReadAhead _readAhead;
 
     private:
         bool tailable_;
@@ -152,10 +180,11 @@ namespace mongo {
         
         bool advance();
 
-        BasicCursor(DiskLoc dl, const AdvanceStrategy *_s = forward()) : curr(dl), s( _s ) {
+        BasicCursor(DiskLoc dl, const AdvanceStrategy *_s = forward()) : curr(dl), s( _s ), _readAhead( _s != reverse() ) {
             init();
+            _readAhead.at( curr );
         }
-        BasicCursor(const AdvanceStrategy *_s = forward()) : s( _s ) {
+        BasicCursor(const AdvanceStrategy *_s = forward()) : s( _s ), _readAhead( _s != reverse() ) {
             init();
         }
         virtual string toString() {
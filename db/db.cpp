@@ -45,6 +45,7 @@
 #include "stats/snapshots.h"
 #include "../util/concurrency/task.h"
 #include "../util/version.h"
+#include "../util/message_server.h"
 
 namespace mongo {
 
@@ -58,6 +59,8 @@ namespace mongo {
     extern bool useHints;
 
     bool noHttpInterface = false;
+    /* --workers: handle connections with an event loop and this many threads rather than a thread each */
+    int listenWorkers = 0;
 
     extern string bind_ip;
     extern char *appsrvPath;
@@ -99,6 +102,9 @@ namespace mongo {
     MessagingPort *connGrab = 0;
     void connThread();
 
+    /* smaller replies aren't worth compressing */
+    const int CompressRepliesMinLen = 1024;
+
     class OurListener : public Listener {
     public:
         OurListener(const string &ip, int p) : Listener(ip, p) { }
@@ -130,6 +136,7 @@ namespace mongo {
     };
 
     void webServerThread();
+    void listenWithWorkers(int port);
 
     void listen(int port) {
         //testTheDb();
@@ -138,6 +145,10 @@ namespace mongo {
         startReplication();
         if ( !noHttpInterface )
             boost::thread thr(webServerThread);
+        if ( listenWorkers > 0 ) {
+            listenWithWorkers(port);
+            return;
+        }
         l.initAndListen();
     }
 
@@ -160,6 +171,40 @@ namespace mongo {
 #endif
   }
 
+    /* handle one message from a client connection.
+       @return false if the connection should be closed
+    */
+    static bool processMessage( Message& m , MessagingPort& port , LastError * le ) {
+        if ( inShutdown() ) {
+            log() << "got request after shutdown()" << endl;
+            return false;
+        }
+
+        lastError.startRequest( m , le );
+
+        DbResponse dbresponse;
+        if ( !assembleResponse( m, dbresponse, port.farEnd ) ) {
+            out() << curTimeMillis() % 10000 << "   end msg " << port.farEnd.toString() << endl;
+            /* todo: we may not wish to allow this, even on localhost: very low priv accounts could stop us. */
+            if ( port.farEnd.isLocalHost() ) {
+                port.shutdown();
+                sleepmillis(50);
+                problem() << "exiting end msg" << endl;
+                dbexit(EXIT_CLEAN);
+            }
+            else {
+                out() << "  (not from localhost, ignoring end msg)" << endl;
+            }
+        }
+
+        if ( dbresponse.response ) {
+            if ( cc().compressReplies() )
+                dbresponse.response->compress( CompressRepliesMinLen );
+            port.reply(m, *dbresponse.response, dbresponse.responseTo);
+        }
+        return true;
+    }
+
     /* we create one thread for each connection from an app server database.
        app server will open a pool of threads.
     */
@@ -191,30 +236,8 @@ namespace mongo {
                     break;
                 }
 
-                if ( inShutdown() ) {
-                    log() << "got request after shutdown()" << endl;
+                if ( !processMessage( m , *dbMsgPort , le ) )
                     break;
-                }
-                
-                lastError.startRequest( m , le );
-
-                DbResponse dbresponse;
-                if ( !assembleResponse( m, dbresponse, dbMsgPort->farEnd ) ) {
-                    out() << curTimeMillis() % 10000 << "   end msg " << dbMsgPort->farEnd.toString() << endl;
-                    /* todo: we may not wish to allow this, even on localhost: very low priv accounts could stop us. */
-                    if ( dbMsgPort->farEnd.isLocalHost() ) {
-                        dbMsgPort->shutdown();
-                        sleepmillis(50);
-                        problem() << "exiting end msg" << endl;
-                        dbexit(EXIT_CLEAN);
-                    }
-                    else {
-                        out() << "  (not from localhost, ignoring end msg)" << endl;
-                    }
-                }
-
-                if ( dbresponse.response )
-                    dbMsgPort->reply(m, *dbresponse.response, dbresponse.responseTo);
             }
 
         }
@@ -245,6 +268,124 @@ namespace mongo {
         globalScriptEngine->threadDone();
     }
 
+    /* the rest of a connection's state, also kept per thread */
+    extern boost::thread_specific_ptr<nonce> lastNonce; // security_commands.cpp
+    typedef map<string,unsigned long long> NSVersions;
+    extern boost::thread_specific_ptr<NSVersions> clientShardVersions; // s/d_logic.cpp
+    extern boost::thread_specific_ptr<OID> clientServerIds;
+
+    /* with --workers, connections are read by the event loop in util/message_server_port.cpp and
+       their messages handled on a pool of threads.  a connection keeps its own Client, LastError
+       and the rest of its thread local state, which are put on whichever thread handles its next
+       message.  a getMore waiting for data (QueryOption_AwaitData) waits on the event loop between
+       passes, not on a worker, see MessageDeferred.
+    */
+    class DbMessageHandler : public MessageHandler {
+    public:
+        DbMessageHandler() : _mutex( "DbMessageHandler" ) { }
+
+        virtual void process( Message& m , AbstractMessagingPort* p ) {
+            MessagingPort * port = dynamic_cast< MessagingPort * >( p );
+            assert( port );
+            Attach a( *this , port );
+            try {
+                if ( !processMessage( m , *port , a.lastError() ) )
+                    port->shutdown();
+            }
+            catch ( const ClockSkewException & ) {
+                exitCleanly( EXIT_CLOCK_SKEW );
+            }
+        }
+
+        virtual void disconnected( AbstractMessagingPort* p ) {
+            Conn c;
+            {
+                scoped_lock lk( _mutex );
+                map< AbstractMessagingPort *, Conn >::iterator i = _conns.find( p );
+                if ( i == _conns.end() )
+                    return;
+                c = i->second;
+                _conns.erase( i );
+            }
+            currentClient.reset( c.client );
+            currentClient->shutdown();
+            currentClient.reset();
+            delete c.le;
+            delete c.nonce;
+            delete c.shardVersions;
+            delete c.serverId;
+        }
+
+    private:
+        struct Conn {
+            Conn() : client(0), le(0), nonce(0), shardVersions(0), serverId(0) { }
+            Client * client;
+            LastError * le;
+            mongo::nonce * nonce;
+            NSVersions * shardVersions;
+            OID * serverId;
+        };
+
+        /* the connection's Client and LastError are the calling thread's for the length of a request */
+        class Attach : boost::noncopyable {
+        public:
+            Attach( DbMessageHandler& h , MessagingPort * p ) : _h( h ) , _p( p ) {
+                bool found;
+                {
+                    scoped_lock lk( h._mutex );
+                    map< AbstractMessagingPort *, Conn >::iterator i = h._conns.find( p );
+                    found = i != h._conns.end();
+                    if ( found )
+                        _c = i->second;
+                }
+                if ( !found ) {
+                    _c.client = new Client( "conn" );
+                    _c.client->getAuthenticationInfo()->isLocalHost = p->farEnd.isLocalHost();
+                    _c.client->setMayDeferGetMore( true );
+                    _c.le = new LastError();
+                    scoped_lock lk( h._mutex );
+                    h._conns[ p ] = _c;
+                }
+                assert( currentClient.get() == 0 );
+                currentClient.reset( _c.client );
+                mongo::lastError.setID( 0 );
+                mongo::lastError.reset( _c.le );
+                lastNonce.reset( _c.nonce );
+                clientShardVersions.reset( _c.shardVersions );
+                clientServerIds.reset( _c.serverId );
+            }
+            ~Attach() {
+                currentClient.release();
+                mongo::lastError.setID( 0 ); // startRequest() may have set it
+                mongo::lastError.release();
+                _c.nonce = lastNonce.release();
+                _c.shardVersions = clientShardVersions.release();
+                _c.serverId = clientServerIds.release();
+                scoped_lock lk( _h._mutex );
+                _h._conns[ _p ] = _c;
+            }
+            LastError * lastError() const { return _c.le; }
+        private:
+            DbMessageHandler& _h;
+            MessagingPort * _p;
+            Conn _c;
+        };
+        friend class Attach;
+
+        mongo::mutex _mutex; // protects _conns
+        map< AbstractMessagingPort *, Conn > _conns;
+    };
+
+    void listenWithWorkers(int port) {
+        MessageServer::Options opts;
+        opts.port = port;
+        opts.ipList = bind_ip;
+        opts.workers = listenWorkers;
+        static DbMessageHandler handler;
+        MessageServer * server = createServer( opts , &handler );
+        server->run();
+    }
+
 
     void msg(const char *m, const char *address, int port, int extras = 0) {
 
@@ -414,12 +555,15 @@ namespace mongo {
             int time_flushing = 0;
             while ( ! inShutdown() ){
                 if ( _sleepsecs == 0 ){
-                    // in case at some point we add an option to change at runtime
-                    sleepsecs(5);
-                    continue;
+                    // in case at some point we add an option to change at runtime.  getLastError
+                    // j:true still needs its flushes
+                    if ( ! MemoryMappedFile::waitForSyncRequest( 5000 ) )
+                        continue;
+                }
+                else {
+                    // woken early for getLastError j:true, see MongoFile::awaitSync()
+                    MemoryMappedFile::waitForSyncRequest( (int) std::max(0.0, (_sleepsecs * 1000) - time_flushing) );
                 }
-
-                sleepmillis( (long long) std::max(0.0, (_sleepsecs * 1000) - time_flushing) );
                 
                 if ( inShutdown() ){
                     // occasional issue trying to flush during shutdown when sleep interrupted
@@ -427,7 +571,7 @@ namespace mongo {
                 }
                 
                 Date_t start = jsTime();
-                MemoryMappedFile::flushAll( true );
+                MemoryMappedFile::syncAll();
                 time_flushing = (int) (jsTime() - start);
 
                 globalFlushCounters.flushed(time_flushing);
@@ -625,6 +769,7 @@ int main(int argc, char* argv[], char *envp[] )
         ("noscripting", "disable scripting engine")
         ("noprealloc", "disable data file preallocation")
         ("smallfiles", "use a smaller default file size")
+        ("compactKeys", "indexes of new collections use the compact btree format. older versions of mongod can't read those indexes")
         ("nssize", po::value<int>()->default_value(16), ".ns file size (in MB) for new databases")
         ("diaglog", po::value<int>(), "0=off 1=W 2=R 3=both 7=W+some reads")
         ("sysinfo", "print some diagnostic system information")
@@ -635,6 +780,7 @@ int main(int argc, char* argv[], char *envp[] )
         ("profile",po::value<int>(), "0=off 1=slow, 2=all")
         ("slowms",po::value<int>(&cmdLine.slowMS)->default_value(100), "value of slow for profile and console log" )
         ("maxConns",po::value<int>(), "max number of simultaneous connections")
+        ("workers", po::value<int>(), "handle connections with an event loop and this many threads instead of a thread each (linux)")
 #if defined(_WIN32)
         ("install", "install mongodb service")
         ("remove", "remove mongodb service")
@@ -656,6 +802,8 @@ int main(int argc, char* argv[], char *envp[] )
         ("slavedelay", po::value<int>(), "specify delay (in seconds) to be used when applying master ops to slave")
         ("fastsync", "indicate that this instance is starting from a dbpath snapshot of the repl peer")
         ("autoresync", "automatically resync if slave data is stale")
+        ("noprefetch", "when slave: don't read in documents and indexes before applying master ops")
+        ("replcompress", "when slave: ask the master to compress the oplog it sends")
         ("oplogSize", po::value<int>(), "size limit (in MB) for op log")
         ("opIdMem", po::value<long>(), "size limit (in bytes) for in memory storage of op ids")
         ;
@@ -766,6 +914,9 @@ int main(int argc, char* argv[], char *envp[] )
         if (params.count("nohttpinterface")) {
             noHttpInterface = true;
         }
+        if (params.count("workers")) {
+            listenWorkers = params["workers"].as<int>();
+        }
         if (params.count("rest")) {
             cmdLine.rest = true;
         }
@@ -800,6 +951,9 @@ int main(int argc, char* argv[], char *envp[] )
         if (params.count("notablescan")) {
             cmdLine.notablescan = true;
         }
+        if (params.count("compactKeys")) {
+            cmdLine.compactKeys = true;
+        }
         if (params.count("install")) {
             installService = true;
         }
@@ -824,6 +978,12 @@ int main(int argc, char* argv[], char *envp[] )
         if (params.count("autoresync")) {
             replSettings.autoresync = true;
         }
+        if (params.count("noprefetch")) {
+            replSettings.prefetch = false;
+        }
+        if (params.count("replcompress")) {
+            replSettings.compress = true;
+        }
         if (params.count("source")) {
             /* specifies what the source in local.sources should be */
             cmdLine.source = params["source"].as<string>().c_str();
@@ -176,20 +176,24 @@ namespace mongo {
             if ( _locktype > 0 ) {
 				massert( 10298 , "can't temprelease nested write lock", _locktype == 1);
                 if ( _context ) _context->unlocked();
+                LockUsageTimer::tempReleasing();
                 dbMutex.unlock();
 			}
             else {
 				massert( 10299 , "can't temprelease nested read lock", _locktype == -1);
                 if ( _context ) _context->unlocked();
+                LockUsageTimer::tempReleasing();
                 dbMutex.unlock_shared();
 			}
 
         }
         ~dbtemprelease() {
+            LockUsageTimer::tempRelocking();
             if ( _locktype > 0 )
                 dbMutex.lock();
             else
                 dbMutex.lock_shared();
+            LockUsageTimer::tempRelocked();
             
             if ( _context ) _context->relocked();
         }
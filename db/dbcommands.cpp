@@ -38,6 +38,7 @@
 #include "queryoptimizer.h"
 #include "../scripting/engine.h"
 #include "stats/counters.h"
+#include "../util/compress.h"
 #include "background.h"
 #include "../util/version.h"
 
@@ -110,7 +111,9 @@ namespace mongo {
             return true;
         }
         virtual void help( stringstream& help ) const {
-            help << "return error status of the last operation on this connection";
+            help << "return error status of the last operation on this connection\n";
+            help << "{ fsync : true } flushes the data files before returning\n";
+            help << "{ j : true } waits for the next group commit of the data files instead of flushing them itself";
         }
         CmdGetLastError() : Command("getLastError", false, "getlasterror") {}
         bool run(const string& dbnamne, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
@@ -127,6 +130,13 @@ namespace mongo {
                 log() << "fsync from getlasterror" << endl;
                 result.append( "fsyncFiles" , MemoryMappedFile::flushAll( true ) );
             }
+            else if ( cmdObj["j"].trueValue() ){
+                // rides along with the next group commit, which the data file sync thread runs for
+                // everyone waiting at the time
+                Timer t;
+                result.appendNumber( "syncs" , (long long) MemoryMappedFile::awaitSync() );
+                result.appendNumber( "jwait" , t.millis() );
+            }
             
             BSONElement e = cmdObj["w"];
             if ( e.isNumber() ){
@@ -355,6 +365,12 @@ namespace mongo {
                 
                 result.append( "globalLock" , t.obj() );
             }
+
+            {
+                BSONObjBuilder bb( result.subobjStart( "locks" ) );
+                globalLockCounters.append( bb );
+                bb.done();
+            }
             
             if ( authed ){
                 
@@ -401,6 +417,18 @@ namespace mongo {
                 bb.done();
             }
 
+            {
+                BSONObjBuilder bb( result.subobjStart( "readAhead" ) );
+                globalReadAheadCounters.append( bb );
+                bb.done();
+            }
+
+            {
+                BSONObjBuilder bb( result.subobjStart( "compression" ) );
+                globalCompressionCounters.append( bb );
+                bb.done();
+            }
+
             {
                 BSONObjBuilder bb( result.subobjStart( "backgroundFlushing" ) );
                 globalFlushCounters.append( bb );
@@ -411,6 +439,10 @@ namespace mongo {
                 BSONObjBuilder bb( result.subobjStart( "repl" ) );
                 appendReplicationInfo( bb , authed , cmdObj["repl"].numberInt() );
                 bb.done();
+
+                BSONObjBuilder ab( result.subobjStart( "replApplyBatchStats" ) );
+                globalReplApplyBatchCounters.append( ab );
+                ab.done();
             }
             
             result.append( "opcounters" , globalOpCounters.getObj() );
@@ -522,10 +554,12 @@ namespace mongo {
             log(4) << "  d->nIndexes was " << d->nIndexes << '\n';
             anObjBuilder.append("nIndexesWas", (double)d->nIndexes);
             IndexDetails *idIndex = 0;
+            bool idIndexExact = false;
             if( d->nIndexes ) {
                 for ( int i = 0; i < d->nIndexes; i++ ) {
                     if ( !mayDeleteIdIndex && d->idx(i).isIdIndex() ) {
                         idIndex = &d->idx(i);
+                        idIndexExact = d->isMultikeyExact(i);
                     } else {
                         d->idx(i).kill_idx();
                     }
@@ -538,6 +572,7 @@ namespace mongo {
             }
             /* assuming here that id index is not multikey: */
             d->multiKeyIndexBits = 0;
+            d->multiKeyExactBits = idIndexExact ? 1 : 0;
             assureSysIndexesEmptied(ns, idIndex);
             anObjBuilder.append("msg", mayDeleteIdIndex ? 
                 "indexes dropped for collection" : 
@@ -561,6 +596,7 @@ namespace mongo {
                 }
                 id->kill_idx();
                 d->multiKeyIndexBits = removeBit(d->multiKeyIndexBits, x);
+                d->multiKeyExactBits = removeBit(d->multiKeyExactBits, x);
                 d->nIndexes--;
                 for ( int i = x; i < d->nIndexes; i++ )
                     d->idx(i) = d->idx(i+1);
@@ -674,6 +710,41 @@ namespace mongo {
         }
     } cmdCreate;
 
+    /* { collMod:"blog.posts", usePowerOf2Sizes:true }
+       the setting is kept in the collection's NamespaceDetails, not its create options */
+    class CmdCollMod : public Command {
+    public:
+        CmdCollMod() : Command("collMod") { }
+        virtual bool logTheOp() { return true; }
+        virtual bool slaveOk() const { return false; }
+        virtual LockType locktype() const { return WRITE; } 
+        virtual void help( stringstream& help ) const {
+            help << "change collection options\n"
+                 << "{ collMod:\"blog.posts\", usePowerOf2Sizes:true }";
+        }
+        virtual bool run(const string& dbname , BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool) {
+            string ns = dbname + '.' + cmdObj.firstElement().valuestr();
+            NamespaceDetails *d = nsdetails( ns.c_str() );
+            if ( !d ) {
+                errmsg = "ns not found";
+                return false;
+            }
+            BSONElement e = cmdObj["usePowerOf2Sizes"];
+            if ( e.eoo() ) {
+                errmsg = "no options specified";
+                return false;
+            }
+            if ( d->capped ) {
+                errmsg = "usePowerOf2Sizes not supported for capped collections";
+                return false;
+            }
+            result.appendBool( "usePowerOf2Sizes_old" , d->usePowerOf2Sizes() );
+            d->setUsePowerOf2Sizes( e.trueValue() );
+            result.appendBool( "usePowerOf2Sizes_new" , d->usePowerOf2Sizes() );
+            return true;
+        }
+    } cmdCollMod;
+
     /* "dropIndexes" is now the preferred form - "deleteIndexes" deprecated */
     class CmdDropIndexes : public Command {
     public:
@@ -1119,6 +1190,7 @@ namespace mongo {
             result.append( "nindexes" , nsd->nIndexes );
             result.append( "lastExtentSize" , nsd->lastExtentSize / scale );
             result.append( "paddingFactor" , nsd->paddingFactor );
+            result.appendNumber( "updateMoves" , nsd->nUpdateMoves );
             result.append( "flags" , nsd->flags );
 
             BSONObjBuilder indexSizes;
@@ -1129,11 +1201,51 @@ namespace mongo {
                 result.append( "capped" , nsd->capped );
                 result.append( "max" , nsd->max );
             }
+            else {
+                long long deletedSize, deletedCount;
+                int largestDeleted;
+                nsd->deletedStats( deletedSize, deletedCount, largestDeleted );
+                result.appendNumber( "deletedCount" , deletedCount );
+                result.appendNumber( "deletedSize" , deletedSize / scale );
+                // share of the free space that is unusable by a record the size of the largest free record
+                result.append( "fragmentation" , deletedSize ? 1.0 - (double) largestDeleted / deletedSize : 0.0 );
+                result.appendBool( "usePowerOf2Sizes" , nsd->usePowerOf2Sizes() );
+            }
 
             return true;
         }
     } cmdCollectionStatis;
 
+    class CmdPlanCache : public Command {
+    public:
+        CmdPlanCache() : Command( "planCache" ) {}
+        virtual bool slaveOk() const { return true; }
+        virtual LockType locktype() const { return READ; } 
+        virtual void help( stringstream &help ) const {
+            help << "{ planCache:\"blog.posts\" [, clear:true] }\n"
+                 << "the query plans the optimizer has cached for a collection, with how they've done since.  clear:true forgets them";
+        }
+        bool run(const string& dbname, BSONObj& jsobj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
+            string ns = dbname + "." + jsobj.firstElement().valuestr();
+            if ( ! nsdetails( ns.c_str() ) ){
+                errmsg = "ns not found";
+                return false;
+            }
+
+            scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+            NamespaceDetailsTransient& nsdt = NamespaceDetailsTransient::get_inlock( ns.c_str() );
+            result.append( "ns" , ns.c_str() );
+            if ( jsobj["clear"].trueValue() ){
+                nsdt.clearQueryCache();
+                return true;
+            }
+            BSONArrayBuilder shapes( result.subarrayStart( "shapes" ) );
+            nsdt.appendQueryCache( shapes );
+            shapes.done();
+            return true;
+        }
+    } cmdPlanCache;
+
     class DBStats : public Command {
     public:
         DBStats() : Command( "dbStats", false, "dbstats" ) {}
@@ -1618,6 +1730,34 @@ namespace mongo {
         }
     } cmdWhatsMyUri;
     
+    class CmdSetCompression : public Command {
+    public:
+        CmdSetCompression() : Command("setCompression") { }
+        virtual bool slaveOk() const {
+            return true;
+        }
+        virtual bool adminOnly() const {
+            return true;
+        }
+        // only changes this connection's Client
+        virtual LockType locktype() const { return NONE; } 
+        virtual void help( stringstream &help ) const {
+            help << "internal. compress replies on this connection, for a slave started with --replcompress.\n"
+                    "the client must already take compressed messages, or it will drop the connection.\n"
+                    "{ setCompression : \"lz\" } or { setCompression : \"none\" }";
+        }        
+        virtual bool run(const string& dbname, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool) {
+            string codec = cmdObj.firstElement().valuestrsafe();
+            if ( codec != "lz" && codec != "none" ) {
+                errmsg = "unknown compression, expected \"lz\" or \"none\"";
+                return false;
+            }
+            cc().setCompressReplies( codec == "lz" );
+            result.append( "compression" , codec );
+            return true;
+        }
+    } cmdSetCompression;
+
     /* For testing only, not for general use */
     class GodInsert : public Command {
     public:
@@ -1800,7 +1940,7 @@ namespace mongo {
             assert( ! c->logTheOp() );
         }
 
-        mongolock lk( needWriteLock );
+        mongolock lk( needWriteLock , dbname );
         Client::Context ctx( dbname , dbpath , &lk , c->requiresAuth() );
         
         try {
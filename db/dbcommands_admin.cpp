@@ -59,6 +59,9 @@ namespace mongo {
 
             for ( int i = 0; i < Buckets; i++ )
                 d->deletedList[i].Null();
+            d->deletedSize = 0;
+            d->deletedCount = 0;
+            d->flags |= NamespaceDetails::Flag_DeletedCounted;
 
             result.append("ns", dropns.c_str());
             return 1;
@@ -66,6 +69,29 @@ namespace mongo {
         
     } cleanCmd;
     
+    class CompactCmd : public Command {
+    public:
+        CompactCmd() : Command( "compact" ){}
+
+        virtual bool slaveOk() const { return true; }
+        virtual LockType locktype() const { return WRITE; } 
+        
+        virtual void help(stringstream& h) const { 
+            h << "defragment a collection: moves its records into new extents and frees the old ones.\n"
+              << "yields periodically.  if interrupted, free space in the extents not yet compacted\n"
+              << "is not reused until the next compact or repair.\n"
+              << "{ compact : \"collectionnamewithoutthedbpart\" }"; 
+        }
+
+        bool run(const string& dbname, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
+            string ns = dbname + "." + cmdObj.firstElement().valuestrsafe();
+            if ( !cmdLine.quiet )
+                tlog() << "CMD: compact " << ns << endl;
+            return compactCollection( ns.c_str(), errmsg, result );
+        }
+        
+    } compactCmd;
+    
     class ValidateCmd : public Command {
     public:
         ValidateCmd() : Command( "validate" ){}
@@ -127,7 +127,7 @@ namespace mongo {
             uassert( 12598 , "$eval reads unauthorized", ai->isAuthorizedReads(dbname.c_str()) );
             
             // write security will be enforced in DBDirectClient
-            mongolock lk( ai->isAuthorized( dbname.c_str() ) );
+            mongolock lk( ai->isAuthorized( dbname.c_str() ) , dbname );
             Client::Context ctx( dbname );
             
 
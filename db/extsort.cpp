@@ -27,12 +27,11 @@
 
 namespace mongo {
     
-    BSONObj BSONObjExternalSorter::extSortOrder;
-    unsigned long long BSONObjExternalSorter::_compares = 0;
+    AtomicUInt BSONObjExternalSorter::_compares = 0;
     
     BSONObjExternalSorter::BSONObjExternalSorter( const BSONObj & order , long maxFileSize )
         : _order( order.getOwned() ) , _maxFilesize( maxFileSize ) , 
-          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0){
+          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0), _runMutex("extsort"), _runsInProgress(0){
         
         stringstream rootpath;
         rootpath << dbpath;
@@ -48,6 +47,14 @@ namespace mongo {
     }
     
     BSONObjExternalSorter::~BSONObjExternalSorter(){
+        {
+            // workers may still be writing into _root if we're unwinding
+            scoped_lock lk( _runMutex );
+            while ( _runsInProgress > 0 )
+                _runDone.wait( lk.boost() );
+        }
+        _runSorters.reset();
+
         if ( _cur ){
             delete _cur;
             _cur = 0;
@@ -57,12 +64,27 @@ namespace mongo {
         wassert( removed == 1 + _files.size() );
     }
 
-    void BSONObjExternalSorter::_sortInMem(){
-        // extSortComp needs to use glbals
-        // qsort_r only seems available on bsd, which is what i really want to use
-        dblock l;
-        extSortOrder = _order;
-        _cur->sort( BSONObjExternalSorter::extSortComp );
+    void BSONObjExternalSorter::sortRun( InMemory * run , vector<Data*>& order , const MyCmp& cmp ){
+        // encode each key once up front, rather than walking the BSON in every comparison
+        BufBuilder keys;
+        vector<Encoded> v;
+        v.reserve( run->size() );
+        for ( InMemory::iterator i=run->begin(); i != run->end(); ++i ){
+            Encoded e;
+            e.data = &(*i);
+            e.ofs = keys.len();
+            // BufBuilder can't go past 64MB; whatever doesn't fit is compared as BSON
+            if ( keys.len() > 32 * 1024 * 1024 || 
+                 ! KeyString::encode( e.data->first , cmp.ordering() , keys , &e.comparableSize ) )
+                e.comparableSize = 0;
+            v.push_back( e );
+        }
+        std::sort( v.begin() , v.end() , EncodedCmp( cmp , keys.buf() ) );
+
+        order.clear();
+        order.reserve( v.size() );
+        for ( unsigned i=0; i<v.size(); i++ )
+            order.push_back( v[i].data );
     }
     
     void BSONObjExternalSorter::sort(){
@@ -71,8 +93,8 @@ namespace mongo {
         _sorted = true;
 
         if ( _cur && _files.size() == 0 ){
-            _sortInMem();
-            log(1) << "\t\t not using file.  size:" << _curSizeSoFar << " _compares:" << _compares << endl;
+            sortRun( _cur , _curSorted , MyCmp( _order ) );
+            log(1) << "\t\t not using file.  size:" << _curSizeSoFar << " _compares:" << (unsigned)_compares << endl;
             return;
         }
         
@@ -80,14 +102,8 @@ namespace mongo {
             finishMap();
         }
         
-        if ( _cur ){
-            delete _cur;
-            _cur = 0;
-        }
-        
-        if ( _files.size() == 0 )
-            return;
-        
+        waitForRuns( 0 );
+        log(1) << "\t\t external sort used " << _files.size() << " files.  _compares:" << (unsigned)_compares << endl;
     }
 
     void BSONObjExternalSorter::add( const BSONObj& o , const DiskLoc & loc ){
@@ -118,30 +134,70 @@ namespace mongo {
         if ( _cur->size() == 0 )
             return;
         
-        _sortInMem();
-        
+        // at most SortThreads runs in flight, plus the one we're about to start filling
+        waitForRuns( SortThreads - 1 );
+
         stringstream ss;
         ss << _root.string() << "/file." << _files.size();
         string file = ss.str();
-        
-        ofstream out;
-        out.open( file.c_str() , ios_base::out | ios_base::binary );
-        assertStreamGood( 10051 ,  (string)"couldn't open file: " + file , out );
-        
-        int num = 0;
-        for ( InMemory::iterator i=_cur->begin(); i != _cur->end(); ++i ){
-            Data p = *i;
-            out.write( p.first.objdata() , p.first.objsize() );
-            out.write( (char*)(&p.second) , sizeof( DiskLoc ) );
-            num++;
+        _files.push_back( file );
+
+        if ( ! _runSorters.get() )
+            _runSorters.reset( new ThreadPool( SortThreads ) );
+
+        {
+            scoped_lock lk( _runMutex );
+            _runsInProgress++;
+        }
+        _runSorters->schedule( &BSONObjExternalSorter::writeRun , this , _cur , file );
+        _cur = 0;
+    }
+
+    void BSONObjExternalSorter::writeRun( BSONObjExternalSorter * sorter , InMemory * run , string file ){
+        string err;
+        try {
+            vector<Data*> order;
+            // no Client on this thread, so no interrupt checks; the caller checks between runs
+            sortRun( run , order , MyCmp( sorter->_order , false ) );
+
+            ofstream out;
+            out.open( file.c_str() , ios_base::out | ios_base::binary );
+            assertStreamGood( 10051 ,  (string)"couldn't open file: " + file , out );
+            
+            for ( vector<Data*>::iterator i=order.begin(); i != order.end(); ++i ){
+                Data * p = *i;
+                out.write( p->first.objdata() , p->first.objsize() );
+                out.write( (char*)(&p->second) , sizeof( DiskLoc ) );
+            }
+            out.close();
+            assertStreamGood( 13289 , (string)"couldn't write file: " + file , out );
+            
+            log(2) << "Added file: " << file << " with " << order.size() << "objects for external sort" << endl;
+        }
+        catch ( std::exception& e ){
+            err = e.what();
+        }
+        catch ( ... ){
+            err = "unknown exception";
         }
         
-        _cur->clear();
-        
-        _files.push_back( file );
-        out.close();
+        delete run;
 
-        log(2) << "Added file: " << file << " with " << num << "objects for external sort" << endl;
+        scoped_lock lk( sorter->_runMutex );
+        if ( err.size() && sorter->_runError.empty() )
+            sorter->_runError = err;
+        sorter->_runsInProgress--;
+        sorter->_runDone.notify_all();
+    }
+
+    void BSONObjExternalSorter::waitForRuns( unsigned maxInProgress ){
+        {
+            scoped_lock lk( _runMutex );
+            while ( _runsInProgress > maxInProgress )
+                _runDone.wait( lk.boost() );
+            uassert( 13288 , (string)"external sort failed writing run: " + _runError , _runError.empty() );
+        }
+        killCurrentOp.checkForInterrupt();
     }
     
     // ---------------------------------
@@ -150,13 +206,16 @@ namespace mongo {
         _cmp( sorter->_order ) , _in( 0 ){
         
         for ( list<string>::iterator i=sorter->_files.begin(); i!=sorter->_files.end(); i++ ){
-            _files.push_back( new FileIterator( *i ) );
-            _stash.push_back( pair<Data,bool>( Data( BSONObj() , DiskLoc() ) , false ) );
+            FileIterator * f = new FileIterator( *i );
+            if ( f->more() )
+                _heap.push_back( pair<Data,int>( f->next() , _files.size() ) );
+            _files.push_back( f );
         }
+        make_heap( _heap.begin() , _heap.end() , HeapCmp( _cmp ) );
         
         if ( _files.size() == 0 && sorter->_cur ){
-            _in = sorter->_cur;
-            _it = sorter->_cur->begin();
+            _in = &sorter->_curSorted;
+            _it = _in->begin();
         }
 
         
@@ -173,44 +232,28 @@ namespace mongo {
         if ( _in )
             return _it != _in->end();
         
-        for ( vector<FileIterator*>::iterator i=_files.begin(); i!=_files.end(); i++ )
-            if ( (*i)->more() )
-                return true;
-        for ( vector< pair<Data,bool> >::iterator i=_stash.begin(); i!=_stash.end(); i++ )
-            if ( i->second )
-                return true;
-        return false;
+        return ! _heap.empty();
     }
         
     BSONObjExternalSorter::Data BSONObjExternalSorter::Iterator::next(){
         
         if ( _in ){
-            Data& d = *_it;
+            Data& d = **_it;
             ++_it;
             return d;
         }
         
-        Data best;
-        int slot = -1;
-        
-        for ( unsigned i=0; i<_stash.size(); i++ ){
+        assert( ! _heap.empty() );
+        pop_heap( _heap.begin() , _heap.end() , HeapCmp( _cmp ) );
+        Data best = _heap.back().first;
+        int slot = _heap.back().second;
+        _heap.pop_back();
 
-            if ( ! _stash[i].second ){
-                if ( _files[i]->more() )
-                    _stash[i] = pair<Data,bool>( _files[i]->next() , true );
-                else
-                    continue;
-            }
-            
-            if ( slot == -1 || _cmp( best , _stash[i].first ) == 0 ){
-                best = _stash[i].first;
-                slot = i;
-            }
-                
+        // refill from the file we just took from
+        if ( _files[slot]->more() ){
+            _heap.push_back( pair<Data,int>( _files[slot]->next() , slot ) );
+            push_heap( _heap.begin() , _heap.end() , HeapCmp( _cmp ) );
         }
-        
-        assert( slot >= 0 );
-        _stash[slot].second = false;
 
         return best;
     }
@@ -22,32 +22,27 @@
 #include "jsobj.h"
 #include "namespace.h"
 #include "curop.h"
+#include "keystring.h"
 #include "../util/array.h"
+#include "../util/concurrency/thread_pool.h"
 
 namespace mongo {
 
 
     /**
        for sorting by BSONObj and attaching a value
+
+       runs that overflow memory are sorted and written out on a small pool of worker threads while 
+       the caller keeps adding, then merged with a heap.  up to SortThreads + 1 runs can be in memory.
      */
     class BSONObjExternalSorter : boost::noncopyable {
     public:
         
         typedef pair<BSONObj,DiskLoc> Data;
 
+        enum { SortThreads = 2 };
+
     private:
-        static BSONObj extSortOrder;
-
-        static int extSortComp( const void *lv, const void *rv ){
-            RARELY killCurrentOp.checkForInterrupt();
-            _compares++;
-            Data * l = (Data*)lv;
-            Data * r = (Data*)rv;
-            int cmp = l->first.woCompare( r->first , extSortOrder );
-            if ( cmp )
-                return cmp;
-            return l->second.compare( r->second );
-        };
 
         class FileIterator : boost::noncopyable {
         public:
@@ -63,18 +58,52 @@ namespace mongo {
 
         class MyCmp {
         public:
-            MyCmp( const BSONObj & order = BSONObj() ) : _order( order ){}
-            bool operator()( const Data &l, const Data &r ) const {
-                RARELY killCurrentOp.checkForInterrupt();
+            /** @param interruptible - false on threads without a Client (sort workers) */
+            MyCmp( const BSONObj & order = BSONObj() , bool interruptible = true ) 
+                : _order( Ordering::make( order ) ) , _interruptible( interruptible ){}
+            int compare( const Data &l, const Data &r ) const {
+                if ( _interruptible ){
+                    RARELY killCurrentOp.checkForInterrupt();
+                }
                 _compares++;
                 int x = l.first.woCompare( r.first , _order );
                 if ( x )
-                    return x < 0;
-                return l.second.compare( r.second ) < 0;
-            };
+                    return x;
+                return l.second.compare( r.second );
+            }
+            bool operator()( const Data &l, const Data &r ) const {
+                return compare( l , r ) < 0;
+            }
+            bool operator()( const Data *l, const Data *r ) const {
+                return compare( *l , *r ) < 0;
+            }
+            const Ordering& ordering() const { return _order; }
+        private:
+            Ordering _order;
+            bool _interruptible;
+        };
 
+        /** a run entry with its key's KeyString, so that sorting a run is mostly memcmp */
+        struct Encoded {
+            Data * data;
+            int ofs; // into the run's key buffer
+            int comparableSize; // 0 if the key can't be encoded
+        };
+
+        class EncodedCmp {
+        public:
+            EncodedCmp( const MyCmp& cmp , const char * keys ) : _cmp( cmp ) , _keys( keys ){}
+            bool operator()( const Encoded& l , const Encoded& r ) const {
+                if ( l.comparableSize == 0 || r.comparableSize == 0 )
+                    return _cmp( l.data , r.data );
+                int x = memcmp( _keys + l.ofs , _keys + r.ofs , min( l.comparableSize , r.comparableSize ) );
+                if ( x )
+                    return x < 0;
+                return l.data->second.compare( r.data->second ) < 0;
+            }
         private:
-            BSONObj _order;
+            const MyCmp& _cmp;
+            const char * _keys;
         };
 
     public:
@@ -90,12 +119,21 @@ namespace mongo {
             Data next();
             
         private:
+            /** orders the merge heap so the smallest head is on top */
+            struct HeapCmp {
+                HeapCmp( const MyCmp& cmp ) : _cmp( cmp ){}
+                bool operator()( const pair<Data,int>& l , const pair<Data,int>& r ) const {
+                    return _cmp.compare( l.first , r.first ) > 0;
+                }
+                MyCmp _cmp;
+            };
+
             MyCmp _cmp;
             vector<FileIterator*> _files;
-            vector< pair<Data,bool> > _stash;
+            vector< pair<Data,int> > _heap; // head of each file that has one, with the file's index
             
-            InMemory * _in;
-            InMemory::iterator _it;
+            vector<Data*> * _in;
+            vector<Data*>::iterator _it;
             
         };
         
@@ -128,10 +166,13 @@ namespace mongo {
 
     private:
 
-        void _sortInMem();
+        /** sorts run into order, which is filled with pointers into run */
+        static void sortRun( InMemory * run , vector<Data*>& order , const MyCmp& cmp );
+        /** worker task: sort a full run, write it to file, free it */
+        static void writeRun( BSONObjExternalSorter * sorter , InMemory * run , string file );
         
-        void sort( string file );
         void finishMap();
+        void waitForRuns( unsigned maxInProgress );
         
         BSONObj _order;
         long _maxFilesize;
@@ -139,11 +180,18 @@ namespace mongo {
         
         int _arraySize;
         InMemory * _cur;
+        vector<Data*> _curSorted; // when everything fit in _cur, its sorted order
         long _curSizeSoFar;
         
         list<string> _files;
         bool _sorted;
 
-        static unsigned long long _compares;
+        auto_ptr<ThreadPool> _runSorters;
+        mongo::mutex _runMutex;
+        boost::condition _runDone;
+        unsigned _runsInProgress;
+        string _runError;
+
+        static AtomicUInt _compares; // woCompare()s; KeyString comparisons aren't counted
     };
 }
@@ -23,7 +23,12 @@ namespace mongo {
 inline void checkDataFileVersion(NamespaceDetails& d) { 
 }
 
+/* 0: BSON keys in btree buckets.  1: CompactKeys buckets for new indexes (--compactKeys). */
+const unsigned short CurrentIndexFileVersion = 1;
+
 inline void checkIndexFileVersion(NamespaceDetails& d) { 
+    uassert( 13302 , "this collection's indexes are in a newer format than this version of mongod can read" ,
+             d.indexFileVersion <= CurrentIndexFileVersion );
 }
 
 }
@@ -85,8 +85,8 @@ namespace mongo {
         wassert( n == 1 );
     }
     
-    void IndexDetails::getKeysFromObject( const BSONObj& obj, BSONObjSetDefaultOrder& keys) const {
-        getSpec().getKeys( obj, keys );
+    void IndexDetails::getKeysFromObject( const BSONObj& obj, BSONObjSetDefaultOrder& keys, bool *expandedArray ) const {
+        getSpec().getKeys( obj, keys, expandedArray );
     }
 
     void setDifference(BSONObjSetDefaultOrder &l, BSONObjSetDefaultOrder &r, vector<BSONObj*> &diff) {
@@ -105,17 +105,28 @@ namespace mongo {
         }
     }
 
+    void getKeysForAllIndexes(NamespaceDetails& d, const BSONObj& obj, vector<BSONObjSetDefaultOrder>& keys, unsigned long long *multikey) {
+        if ( d.nIndexesBeingBuilt() == 0 ) {
+            keys.clear();
+            return;
+        }
+        string ns = d.idx(0).parentNS();
+        NamespaceDetailsTransient::get_w( ns.c_str() ).keyFieldTrie( &d ).getKeys( obj, keys, multikey );
+    }
+
     void getIndexChanges(vector<IndexChanges>& v, NamespaceDetails& d, BSONObj newObj, BSONObj oldObj, bool &changedId) { 
         int z = d.nIndexesBeingBuilt();
         v.resize(z);
-        NamespaceDetails::IndexIterator i = d.ii();
+        vector<BSONObjSetDefaultOrder> oldKeys, newKeys;
+        unsigned long long multikey = 0;
+        getKeysForAllIndexes(d, oldObj, oldKeys);
+        getKeysForAllIndexes(d, newObj, newKeys, &multikey);
         for( int i = 0; i < z; i++ ) {
             IndexDetails& idx = d.idx(i);
-            BSONObj idxKey = idx.info.obj().getObjectField("key"); // eg { ts : 1 }
             IndexChanges& ch = v[i];
-            idx.getKeysFromObject(oldObj, ch.oldkeys);
-            idx.getKeysFromObject(newObj, ch.newkeys);
-            if( ch.newkeys.size() > 1 ) 
+            ch.oldkeys.swap( oldKeys[i] );
+            ch.newkeys.swap( newKeys[i] );
+            if( multikey & ( ( (unsigned long long) 1 ) << i ) )
                 d.setIndexIsMultikey(i);
             setDifference(ch.oldkeys, ch.newkeys, ch.removed);
             setDifference(ch.newkeys, ch.oldkeys, ch.added);
@@ -129,6 +140,11 @@ namespace mongo {
         int z = d.nIndexesBeingBuilt();
         for( int i = 0; i < z; i++ ) {
             IndexDetails& idx = d.idx(i);
+            if( i == d.nIndexes ) {
+                // background index still being built; its tree may be incomplete or not there yet, and
+                // duplicates are caught when its buffered writes are applied
+                continue;
+            }
             v[i].dupCheck(idx, curObjLoc);
         }
     }
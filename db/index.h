@@ -61,7 +61,7 @@ namespace mongo {
            only when it's a "multikey" array.
            keys will be left empty if key not found in the object.
         */
-        void getKeysFromObject( const BSONObj& obj, BSONObjSetDefaultOrder& keys) const;
+        void getKeysFromObject( const BSONObj& obj, BSONObjSetDefaultOrder& keys, bool *expandedArray = 0 ) const;
 
         /* get the key pattern for this object.
            e.g., { lastname:1, firstname:1 }
@@ -156,6 +156,10 @@ namespace mongo {
     };
 
     class NamespaceDetails;
+    /* keys[i] gets the keys of d.idx(i) for obj, for every index including one being built in the 
+       background.  obj is walked once for all of them, see IndexKeyFieldTrie.  assumed to be in write lock. 
+       multikey, if nonzero, gets bit i set if obj makes d.idx(i) multikey. */
+    void getKeysForAllIndexes(NamespaceDetails& d, const BSONObj& obj, vector<BSONObjSetDefaultOrder>& keys, unsigned long long *multikey = 0);
     // changedId should be initialized to false
     void getIndexChanges(vector<IndexChanges>& v, NamespaceDetails& d, BSONObj newObj, BSONObj oldObj, bool &cangedId);
     void dupCheck(vector<IndexChanges>& v, NamespaceDetails& d, DiskLoc curObjLoc);
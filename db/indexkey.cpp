@@ -89,25 +89,32 @@ namespace mongo {
     }
 
     
-    void IndexSpec::getKeys( const BSONObj &obj, BSONObjSetDefaultOrder &keys ) const {
+    void IndexSpec::getKeys( const BSONObj &obj, BSONObjSetDefaultOrder &keys, bool *expandedArray ) const {
         if ( _indexType.get() ){
             _indexType->getKeys( obj , keys );
+            if ( expandedArray && keys.size() > 1 )
+                *expandedArray = true;
             return;
         }
         vector<const char*> fieldNames( _fieldNames );
         vector<BSONElement> fixed( _fixed );
-        _getKeys( fieldNames , fixed , obj, keys );
+        _getKeys( fieldNames , fixed , obj, keys, 0, expandedArray );
         if ( keys.empty() )
             keys.insert( _nullKey );
     }
 
-    void IndexSpec::_getKeys( vector<const char*> fieldNames , vector<BSONElement> fixed , const BSONObj &obj, BSONObjSetDefaultOrder &keys ) const {
+    void IndexSpec::_getKeys( vector<const char*> fieldNames , vector<BSONElement> fixed , const BSONObj &obj, BSONObjSetDefaultOrder &keys, 
+                              const BSONElement *resolved, bool *expandedArray ) const {
         BSONElement arrElt;
         unsigned arrIdx = ~0;
         for( unsigned i = 0; i < fieldNames.size(); ++i ) {
-            if ( *fieldNames[ i ] == '\0' )
+            BSONElement e;
+            if ( resolved )
+                e = resolved[ i ];
+            else if ( *fieldNames[ i ] == '\0' )
                 continue;
-            BSONElement e = obj.getFieldDottedOrArray( fieldNames[ i ] );
+            else
+                e = obj.getFieldDottedOrArray( fieldNames[ i ] );
             if ( e.eoo() )
                 e = _nullElt; // no matching field
             if ( e.type() != Array )
@@ -121,6 +128,8 @@ namespace mongo {
             // enforce single array path here
             uassert( 10088 ,  "cannot index parallel arrays", e.type() != Array || e.rawdata() == arrElt.rawdata() );
         }
+        if ( expandedArray && !arrElt.eoo() )
+            *expandedArray = true;
 
         bool allFound = true; // have we found elements for all field names in the key spec?
         for( vector<const char*>::const_iterator i = fieldNames.begin(); i != fieldNames.end(); ++i ){
@@ -167,7 +176,7 @@ namespace mongo {
                 while( i.more() ) {
                     BSONElement e = i.next();
                     if ( e.type() == Object ){
-                        _getKeys( fieldNames, fixed, e.embeddedObject(), keys );
+                        _getKeys( fieldNames, fixed, e.embeddedObject(), keys, 0, expandedArray );
                     }
                 }
             }
@@ -195,6 +204,123 @@ namespace mongo {
         }
     }
 
+    void IndexKeyFieldTrie::addIndex( const IndexSpec *spec ) {
+        _specs.push_back( spec );
+        _indexPaths.push_back( vector< int >() );
+        if ( spec->getType() )
+            return;
+        vector< int > &paths = _indexPaths.back();
+        for( vector< const char * >::const_iterator i = spec->_fieldNames.begin(); i != spec->_fieldNames.end(); ++i ) {
+            const char *field = *i;
+            vector< Node * > passed;
+            Node *n = &_root;
+            const char *p = field;
+            while( 1 ) {
+                const char *dot = strchr( p, '.' );
+                string name = dot ? string( p, dot - p ) : string( p );
+                Node *child = 0;
+                for( vector< Node >::iterator c = n->children.begin(); c != n->children.end(); ++c ) {
+                    if ( c->name == name ) {
+                        child = &*c;
+                        break;
+                    }
+                }
+                if ( !child ) {
+                    n->children.push_back( Node( name ) );
+                    child = &n->children.back();
+                }
+                n = child;
+                if ( !dot )
+                    break;
+                p = dot + 1;
+                passed.push_back( n );
+            }
+            if ( n->path < 0 ) {
+                n->path = _nPaths++;
+                // what remains of field after each node passed on the way here
+                const char *rest = field;
+                for( vector< Node * >::iterator j = passed.begin(); j != passed.end(); ++j ) {
+                    rest = strchr( rest, '.' ) + 1;
+                    (*j)->below.push_back( make_pair( n->path, rest ) );
+                }
+            }
+            paths.push_back( n->path );
+        }
+    }
+
+    /* one pass over obj for all of n's children, with getFieldDottedOrArray() semantics: 
+       the first field of a name counts, an array ends the path, a scalar part way leaves it unmatched */
+    void IndexKeyFieldTrie::_resolve( const Node &n, const BSONObj &obj, BSONElement *elts, const char **rest ) const {
+        unsigned nChildren = n.children.size();
+        char seenBuf[ 64 ];
+        vector< char > seenBig;
+        char *seen = seenBuf;
+        if ( nChildren > sizeof( seenBuf ) ) {
+            seenBig.resize( nChildren );
+            seen = &seenBig[ 0 ];
+        }
+        memset( seen, 0, min( (size_t) nChildren, sizeof( seenBuf ) ) );
+        unsigned left = nChildren;
+        BSONObjIterator i( obj );
+        while( left && i.more() ) {
+            BSONElement e = i.next();
+            const char *name = e.fieldName();
+            unsigned k = 0;
+            for( ; k < nChildren; ++k ) {
+                if ( !seen[ k ] && n.children[ k ].name == name )
+                    break;
+            }
+            if ( k == nChildren )
+                continue;
+            seen[ k ] = 1;
+            --left;
+            const Node &c = n.children[ k ];
+            if ( c.path >= 0 )
+                elts[ c.path ] = e;
+            if ( c.below.empty() )
+                continue;
+            if ( e.type() == Array ) {
+                for( vector< pair< int, const char * > >::const_iterator j = c.below.begin(); j != c.below.end(); ++j ) {
+                    elts[ j->first ] = e;
+                    rest[ j->first ] = j->second;
+                }
+            }
+            else if ( e.type() == Object ) {
+                _resolve( c, e.embeddedObject(), elts, rest );
+            }
+        }
+    }
+
+    void IndexKeyFieldTrie::getKeys( const BSONObj &obj, vector< BSONObjSetDefaultOrder > &keys, unsigned long long *multikey ) const {
+        keys.resize( _specs.size() );
+        vector< BSONElement > elts( _nPaths );
+        vector< const char * > rest( _nPaths, "" );
+        if ( _nPaths )
+            _resolve( _root, obj, &elts[ 0 ], &rest[ 0 ] );
+        for( unsigned i = 0; i < _specs.size(); ++i ) {
+            const IndexSpec &spec = *_specs[ i ];
+            bool expandedArray = false;
+            if ( spec.getType() ) {
+                spec.getKeys( obj, keys[ i ], &expandedArray );
+                if ( multikey && expandedArray )
+                    *multikey |= ( (unsigned long long) 1 ) << i;
+                continue;
+            }
+            const vector< int > &paths = _indexPaths[ i ];
+            vector< const char * > fieldNames( paths.size() );
+            vector< BSONElement > resolved( paths.size() );
+            for( unsigned j = 0; j < paths.size(); ++j ) {
+                fieldNames[ j ] = rest[ paths[ j ] ];
+                resolved[ j ] = elts[ paths[ j ] ];
+            }
+            spec._getKeys( fieldNames, spec._fixed, obj, keys[ i ], &resolved[ 0 ], &expandedArray );
+            if ( keys[ i ].empty() )
+                keys[ i ].insert( spec._nullKey );
+            if ( multikey && expandedArray )
+                *multikey |= ( (unsigned long long) 1 ) << i;
+        }
+    }
+
     bool anyElementNamesMatch( const BSONObj& a , const BSONObj& b ){
         BSONObjIterator x(a);
         while ( x.more() ){
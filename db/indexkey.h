@@ -28,6 +28,7 @@ namespace mongo {
     class Cursor;
     class IndexSpec;
     class IndexType; // TODO: this name sucks
+    class IndexKeyFieldTrie;
     class IndexPlugin;
     class IndexDetails;
 
@@ -123,7 +124,10 @@ namespace mongo {
         void reset( const DiskLoc& loc );
         void reset( const IndexDetails * details );
         
-        void getKeys( const BSONObj &obj, BSONObjSetDefaultOrder &keys ) const;
+        /* expandedArray: if nonzero, set to true when obj has an array on a key field path, even one 
+           giving a single key ( {a:[5]} ), or a plugin index gives more than one key.  such an index is 
+           multikey, see NamespaceDetails::isMultikey */
+        void getKeys( const BSONObj &obj, BSONObjSetDefaultOrder &keys, bool *expandedArray = 0 ) const;
 
         BSONElement missingField() const { return _nullElt; }
         
@@ -147,7 +151,10 @@ namespace mongo {
 
         IndexSuitability _suitability( const BSONObj& query , const BSONObj& order ) const ;
 
-        void _getKeys( vector<const char*> fieldNames , vector<BSONElement> fixed , const BSONObj &obj, BSONObjSetDefaultOrder &keys ) const;
+        /* resolved: if nonzero, resolved[i] is what getFieldDottedOrArray( fieldNames[i] ) returns on obj
+           and fieldNames[i] has already been advanced -- the top level of an IndexKeyFieldTrie walk */
+        void _getKeys( vector<const char*> fieldNames , vector<BSONElement> fixed , const BSONObj &obj, BSONObjSetDefaultOrder &keys, 
+                       const BSONElement *resolved = 0, bool *expandedArray = 0 ) const;
         
         BSONSizeTracker _sizeTracker;
 
@@ -168,6 +175,45 @@ namespace mongo {
         bool _finishedInit;
 
         friend class IndexType;
+        friend class IndexKeyFieldTrie;
+    };
+
+    /* the key fields of several indexes merged into a trie of dotted paths, so that the keys of
+       all of them come from a single walk of an object rather than one scan per key field.
+       arrays are expanded by IndexSpec as usual, starting from the elements the walk found.
+       a collection's trie is cached in NamespaceDetailsTransient.
+       the IndexSpecs added must outlive the trie.
+    */
+    class IndexKeyFieldTrie : boost::noncopyable {
+    public:
+        IndexKeyFieldTrie() : _root( "" ), _nPaths(0) { }
+
+        /* add spec as the next index.  plugin indexes add no paths and get their keys the usual way. */
+        void addIndex( const IndexSpec *spec );
+
+        int nIndexes() const { return _specs.size(); }
+        const IndexSpec& spec( int i ) const { return *_specs[ i ]; }
+
+        /* keys[i] gets the same keys as spec(i).getKeys( obj, keys[i] ).  if multikey is nonzero, bit i 
+           of it is set where spec(i).getKeys() would set expandedArray */
+        void getKeys( const BSONObj &obj, vector< BSONObjSetDefaultOrder > &keys, unsigned long long *multikey = 0 ) const;
+
+    private:
+        struct Node {
+            Node( const string &n ) : name( n ), path( -1 ) { }
+            string name;
+            int path; // path ending here, or -1
+            /* paths continuing below here, with what remains of each after this node's
+               component -- where getFieldDottedOrArray() stops if it meets an array here */
+            vector< pair< int, const char * > > below;
+            vector< Node > children;
+        };
+        void _resolve( const Node &n, const BSONObj &obj, BSONElement *elts, const char **rest ) const;
+
+        Node _root;
+        int _nPaths;
+        vector< const IndexSpec * > _specs;
+        vector< vector< int > > _indexPaths; // path of each key field, by index
     };
 
 
@@ -38,6 +38,7 @@
 #endif
 #include "stats/counters.h"
 #include "background.h"
+#include "../util/message_server.h"
 
 namespace mongo {
 
@@ -252,7 +253,9 @@ namespace mongo {
             opwrite(m);
         }
         
-        globalOpCounters.gotOp( op , isCommand );
+        // a deferred getMore coming round again was counted the first time, see receivedGetMore
+        if ( op != dbGetMore || cc().awaitDataPasses() == 0 )
+            globalOpCounters.gotOp( op , isCommand );
         
         if ( handlePossibleShardedMessage( m , dbresponse ) ){
             /* important to do this before we lock
@@ -363,7 +366,7 @@ namespace mongo {
                 mongo::log(1) << "note: not profiling because recursive read lock" << endl;
             }
             else {
-                mongolock lk(true);
+                mongolock lk(true, currentOp.getNS());
                 if ( dbHolder.isLoaded( nsToDatabase( currentOp.getNS() ) , dbpath ) ){
                     Client::Context c( currentOp.getNS() );
                     profile(ss.str().c_str(), ms);
@@ -447,7 +450,7 @@ namespace mongo {
             op.setQuery(query);
         }        
 
-        mongolock lk(1);
+        mongolock lk(1, ns);
         Client::Context ctx( ns );
 
         UpdateResult res = updateObjects(ns, toupdate, query, upsert, multi, true, op.debug() );
@@ -490,18 +493,26 @@ namespace mongo {
         
         ss << ns << " cid:" << cursorid << " ntoreturn:" << ntoreturn;;
 
-        int pass = 0;
+        Client& client = cc();
+        int pass = client.awaitDataPasses();
+        client.awaitDataPasses() = 0;
         
         QueryResult* msgdata;
         while( 1 ) {
             try {
-                mongolock lk(false);
+                mongolock lk(false, ns);
                 Client::Context ctx(ns);
                 msgdata = processGetMore(ns, ntoreturn, cursorid, curop, pass );
             }
             catch ( GetMoreWaitException& ) { 
                 massert(13073, "shutting down", !inShutdown() );
                 pass++;
+                if ( client.mayDeferGetMore() ) {
+                    // back for the next pass without holding a thread.  that's a new op
+                    client.awaitDataPasses() = pass;
+                    curop.done();
+                    throw MessageDeferred( 2 );
+                }
                 sleepmillis(2);
                 continue;
             }
@@ -523,6 +534,14 @@ namespace mongo {
         return ok;
     }
 
+    /* the oplog entries for the first n of a batch insert, back to back */
+    static void logInserts(const char *ns, const vector<BSONObj>& objs, int n) {
+        for( int i = 0; i < n; i++ ) {
+            logOp("i", ns, objs[i]);
+            globalOpCounters.gotInsert();
+        }
+    }
+
     void receivedInsert(Message& m, CurOp& op) {
         DbMessage d(m);
 		const char *ns = d.getns();
@@ -532,13 +551,22 @@ namespace mongo {
 
         writelock lk(ns);
         Client::Context ctx(ns);		
+        vector<BSONObj> objs;
         while ( d.moreJSObjs() ) {
             BSONObj js = d.nextJsObj();
             uassert( 10059 , "object to insert too large", js.objsize() <= MaxBSONObjectSize);
-            theDataFileMgr.insertWithObjMod(ns, js, false);
-            logOp("i", ns, js);
-            globalOpCounters.gotInsert();
+            objs.push_back(js);
+        }
+        int n = 0;
+        try {
+            theDataFileMgr.insertBatch(ns, objs, n);
+        }
+        catch( DBException& ) { 
+            logInserts(ns, objs, n);
+            recordPartialInsert(n);
+            throw;
         }
+        logInserts(ns, objs, n);
     }
 
     class JniMessagingPort : public AbstractMessagingPort {
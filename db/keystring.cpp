@@ -0,0 +1,273 @@
+// keystring.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "keystring.h"
+
+namespace mongo {
+
+    /* type bytes follow the canonical type order.  ascending ones are < 0x80, descending ones are
+       inverted and so >= 0x80.  0 is never a type byte, so it can mark the end of the key.
+    */
+    static unsigned char typeByte( int canonical ){
+        if ( canonical == MaxKey )
+            return 0x7f;
+        return (unsigned char)( canonical + 2 );
+    }
+
+    static int canonicalFromTypeByte( unsigned char t ){
+        if ( t & 0x80 )
+            t = ~t;
+        if ( t == 0x7f )
+            return MaxKey;
+        return t - 2;
+    }
+
+    static void appendBigEndian( BufBuilder& b , unsigned long long x , int bytes ){
+        char * p = b.grow( bytes );
+        for ( int i = bytes - 1; i >= 0; i-- ){
+            p[i] = (char)( x & 0xff );
+            x >>= 8;
+        }
+    }
+
+    static unsigned long long readBigEndian( const unsigned char * p , int bytes , bool desc ){
+        unsigned long long x = 0;
+        for ( int i = 0; i < bytes; i++ ){
+            unsigned char c = desc ? ~p[i] : p[i];
+            x = ( x << 8 ) | c;
+        }
+        return x;
+    }
+
+    /* doubles as unsigned so that byte order is numeric order */
+    static unsigned long long orderedDoubleBits( double d ){
+        unsigned long long u;
+        memcpy( &u , &d , sizeof(u) );
+        if ( u >> 63 )
+            return ~u;
+        return u | ( 1ULL << 63 );
+    }
+
+    static double doubleFromOrderedBits( unsigned long long u ){
+        if ( u >> 63 )
+            u &= ~( 1ULL << 63 );
+        else
+            u = ~u;
+        double d;
+        memcpy( &d , &u , sizeof(d) );
+        return d;
+    }
+
+    bool KeyString::canEncode( const BSONElement& e ){
+        switch ( e.type() ){
+        case MinKey:
+        case MaxKey:
+        case jstNULL:
+        case Undefined:
+        case jstOID:
+        case BinData:
+        case mongo::Date:
+        case Timestamp:
+        case NumberInt:
+            return true;
+        case mongo::Bool:
+            return (unsigned char)(*e.value()) <= 1;
+        case NumberLong: {
+            // must survive the trip through a double exactly
+            long long x = e._numberLong();
+            return x <= ( 1LL << 53 ) && x >= -( 1LL << 53 );
+        }
+        case NumberDouble: {
+            // NaN and infinity all compare the same as each other, and -0 the same as 0
+            double d = e._numberDouble();
+            if ( ! ( d <= numeric_limits< double >::max() && d >= -numeric_limits< double >::max() ) )
+                return false;
+            unsigned long long u;
+            memcpy( &u , &d , sizeof(u) );
+            return ! ( d == 0 && ( u >> 63 ) );
+        }
+        case mongo::String:
+        case Symbol:
+            // woCompare uses strcmp, which stops at the first null
+            return (int) strlen( e.valuestr() ) == e.valuestrsize() - 1;
+        default:
+            return false;
+        }
+    }
+
+    bool KeyString::encode( const BSONObj& key , const Ordering& o , BufBuilder& b , int * comparableSize , 
+                            bool ignoreFieldNames ){
+        int start = b.len();
+        {
+            BSONObjIterator i( key );
+            while ( i.more() ){
+                BSONElement e = i.next();
+                if ( ( *e.fieldName() && ! ignoreFieldNames ) || ! canEncode( e ) )
+                    return false;
+            }
+        }
+
+        unsigned mask = 1;
+        BSONObjIterator i( key );
+        while ( i.more() ){
+            BSONElement e = i.next();
+            int elementStart = b.len();
+            b.append( (char) typeByte( e.canonicalType() ) );
+            switch ( e.type() ){
+            case NumberInt:
+            case NumberLong:
+            case NumberDouble:
+                appendBigEndian( b , orderedDoubleBits( e.number() ) , 8 );
+                break;
+            case mongo::String:
+            case Symbol:
+                b.append( e.valuestr() );
+                break;
+            case jstOID:
+                b.append( (void*) e.value() , 12 );
+                break;
+            case mongo::Bool:
+                b.append( *e.value() );
+                break;
+            case mongo::Date:
+            case Timestamp:
+                appendBigEndian( b , e.date() , 8 );
+                break;
+            case BinData:
+                // woCompare orders bindata by length first
+                appendBigEndian( b , (unsigned) e.objsize() , 4 );
+                b.append( (void*)( e.value() + 4 ) , e.objsize() + 1 );
+                break;
+            default:
+                break;
+            }
+            if ( o.descending( mask ) ){
+                char * p = b.buf();
+                for ( int j = elementStart; j < b.len(); j++ )
+                    p[j] = ~p[j];
+            }
+            mask <<= 1;
+        }
+        b.append( (char) 0 );
+        if ( comparableSize )
+            *comparableSize = b.len() - start;
+
+        BSONObjIterator j( key );
+        while ( j.more() )
+            b.append( (char) j.next().type() );
+        return true;
+    }
+
+    /* @return length of the value of an element, not counting the type byte */
+    static int valueSize( const unsigned char * p , int canonical , bool desc ){
+        switch ( canonical ){
+        case 10:
+        case 45:
+            return 8;
+        case 15: {
+            unsigned char end = desc ? 0xff : 0;
+            int n = 0;
+            while ( p[n] != end )
+                n++;
+            return n + 1;
+        }
+        case 30:
+            return 4 + 1 + (int) readBigEndian( p , 4 , desc );
+        case 35:
+            return 12;
+        case 40:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    int KeyString::comparableSize( const char * data ){
+        const unsigned char * p = (const unsigned char *) data;
+        while ( *p ){
+            bool desc = *p & 0x80;
+            int canonical = canonicalFromTypeByte( *p );
+            p += 1 + valueSize( p + 1 , canonical , desc );
+        }
+        return (int)( p - (const unsigned char *) data ) + 1;
+    }
+
+    int KeyString::size( const char * data ){
+        const unsigned char * p = (const unsigned char *) data;
+        int n = 0;
+        while ( *p ){
+            bool desc = *p & 0x80;
+            int canonical = canonicalFromTypeByte( *p );
+            p += 1 + valueSize( p + 1 , canonical , desc );
+            n++;
+        }
+        return (int)( p - (const unsigned char *) data ) + 1 + n;
+    }
+
+    BSONObj KeyString::toBSON( const char * data ){
+        const unsigned char * p = (const unsigned char *) data;
+        const unsigned char * types = p + comparableSize( data );
+
+        BSONObjBuilder b;
+        while ( *p ){
+            bool desc = *p & 0x80;
+            int canonical = canonicalFromTypeByte( *p );
+            p++;
+            int sz = valueSize( p , canonical , desc );
+
+            string v; // the value bytes, uninverted
+            v.resize( sz );
+            for ( int i = 0; i < sz; i++ )
+                v[i] = desc ? ~p[i] : p[i];
+            const unsigned char * u = (const unsigned char *) v.data();
+
+            BSONType t = (BSONType) (signed char) *types++; // MinKey is -1
+            switch ( t ){
+            case MinKey: b.appendMinKey( "" ); break;
+            case MaxKey: b.appendMaxKey( "" ); break;
+            case jstNULL: b.appendNull( "" ); break;
+            case Undefined: b.appendUndefined( "" ); break;
+            case NumberDouble: b.append( "" , doubleFromOrderedBits( readBigEndian( u , 8 , false ) ) ); break;
+            case NumberInt: b.append( "" , (int) doubleFromOrderedBits( readBigEndian( u , 8 , false ) ) ); break;
+            case NumberLong: b.append( "" , (long long) doubleFromOrderedBits( readBigEndian( u , 8 , false ) ) ); break;
+            case mongo::String: b.append( "" , v.c_str() ); break;
+            case Symbol: b.appendSymbol( "" , v.c_str() ); break;
+            case jstOID: {
+                OID oid;
+                memcpy( (void*) &oid , u , 12 );
+                b.appendOID( "" , &oid );
+                break;
+            }
+            case mongo::Bool: b.appendBool( "" , u[0] ); break;
+            case mongo::Date: b.appendDate( "" , Date_t( readBigEndian( u , 8 , false ) ) ); break;
+            case Timestamp: b.appendTimestamp( "" , readBigEndian( u , 8 , false ) ); break;
+            case BinData: {
+                int len = (int) readBigEndian( u , 4 , false );
+                b.appendBinData( "" , len , (BinDataType) u[4] , (const char *)( u + 5 ) );
+                break;
+            }
+            default:
+                massert( 13290 , "bad type in KeyString" , false );
+            }
+            p += sz;
+        }
+        return b.obj();
+    }
+
+}
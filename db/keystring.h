@@ -0,0 +1,110 @@
+// keystring.h
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../pch.h"
+#include "jsobj.h"
+
+namespace mongo {
+
+    /**
+       an order preserving byte encoding of an index key.  for two keys encoded with the same Ordering,
+
+         memcmp( a , b , a's comparableSize )
+
+       has the same sign as BSONObj::woCompare( a , b , ordering ).  the original BSON can be recovered
+       with toBSON() without knowing the Ordering.
+
+       layout:
+         for each element: a type byte, then the value; all bytes of the element are inverted if that
+         field is descending
+         0x00 - end of the comparable part.  type bytes are never 0
+         the original BSONType of each element, so int/double/long etc. come back as they went in.
+         these are never inverted and are not part of the comparable size
+
+       only keys with empty field names and "simple" values can be encoded: numbers (not NaN,
+       infinity, -0 or longs that don't fit in a double exactly), strings without embedded nulls,
+       oids, bools, dates, timestamps, bindata, null, undefined, minkey and maxkey.  everything
+       else (objects, arrays, regexes, code, ...) must be compared as BSON.
+    */
+    class KeyString {
+    public:
+        /**
+         * appends the encoding of key to b.
+         * @param comparableSize if not null, set to the size of the part to compare with memcmp
+         * @param ignoreFieldNames if every key it will be compared with has the same field names.
+         *        they are dropped, so toBSON() gives back empty names.
+         * @return false if key can't be encoded, in which case b is left as it was
+         */
+        static bool encode( const BSONObj& key , const Ordering& o , BufBuilder& b , int * comparableSize = 0 , 
+                            bool ignoreFieldNames = false );
+
+        /** @return the key encoded at data, with empty field names */
+        static BSONObj toBSON( const char * data );
+
+        /** @return size of the comparable part of the encoding at data, including the end marker */
+        static int comparableSize( const char * data );
+
+        /** @return total size of the encoding at data */
+        static int size( const char * data );
+
+        /** @return true if this element's value can be encoded */
+        static bool canEncode( const BSONElement& e );
+    };
+
+    /**
+       a key kept with its KeyString, when it has one, for code that compares the same keys many
+       times, e.g. sorting.  keys that can't be encoded are compared with woCompare.
+    */
+    class SortKey {
+    public:
+        /** @param ignoreFieldNames see KeyString::encode */
+        SortKey( const BSONObj& key , const Ordering& o , bool ignoreFieldNames = false ) : _obj( key ) {
+            BufBuilder b;
+            if ( KeyString::encode( key , o , b , &_comparableSize , ignoreFieldNames ) )
+                _ks = string( b.buf() , _comparableSize );
+            else
+                _comparableSize = 0;
+        }
+
+        const BSONObj& obj() const { return _obj; }
+
+        int woCompare( const SortKey& r , const Ordering& o ) const {
+            if ( _comparableSize && r._comparableSize )
+                return memcmp( _ks.data() , r._ks.data() , min( _comparableSize , r._comparableSize ) );
+            return _obj.woCompare( r._obj , o );
+        }
+
+    private:
+        BSONObj _obj;
+        string _ks; // comparable part only
+        int _comparableSize; // 0 if _obj can't be encoded
+    };
+
+    class SortKeyCmp {
+    public:
+        SortKeyCmp( const Ordering& o ) : _order( o ) {}
+        bool operator()( const SortKey& l , const SortKey& r ) const {
+            return l.woCompare( r , _order ) < 0;
+        }
+    private:
+        Ordering _order;
+    };
+
+}
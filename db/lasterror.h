@@ -129,4 +129,11 @@ namespace mongo {
             le->recordDelete( nDeleted );        
     }
 
+    /* after the error a batch insert stopped at: n is how many of its objects went in */
+    inline void recordPartialInsert( int nInserted ) {
+        LastError *le = lastError.get();
+        if ( le && le->valid )
+            le->nObjects = nInserted;
+    }
+
 } // namespace mongo
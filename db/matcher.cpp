@@ -392,6 +392,157 @@ namespace mongo {
         }
         
         constrainIndexKey_ = constrainIndexKey;
+        compile();
+    }
+
+    void Matcher::compile() {
+        _compiledAll = false;
+        // index keys have empty field names, leave them to getFieldUsingIndexNames()
+        if ( !constrainIndexKey_.isEmpty() || basics.size() > CompiledPredicates::MaxPredicates )
+            return;
+        bool all = true;
+        for ( unsigned i = 0; i < basics.size(); i++ ) {
+            if ( !_compiled.add( basics[i] ) )
+                all = false;
+        }
+        _compiledAll = all && !_compiled.empty() && nRegex == 0 && 
+            _orMatchers.empty() && _norMatchers.empty() && !where;
+    }
+
+    bool CompiledPredicates::add( const ElementMatcher &bm ) {
+        if ( bm.isNot || _preds.size() >= MaxPredicates )
+            return false;
+        Predicate p;
+        switch( bm.compareOp ) {
+            case BSONObj::Equality: p.mask = 0x2; break;
+            case BSONObj::LT:
+            case BSONObj::LTE:
+            case BSONObj::GT:
+            case BSONObj::GTE: p.mask = bm.compareOp; break;
+            default: return false;
+        }
+        p.value = bm.toMatch;
+        p.d = 0;
+        p.dNan = p.isLong = false;
+        switch( p.value.type() ) {
+            case NumberDouble:
+            case NumberInt:
+            case NumberLong:
+                p.kind = Num;
+                p.d = p.value.number();
+                p.dNan = !( p.d <= numeric_limits< double >::max() && p.d >= -numeric_limits< double >::max() );
+                p.isLong = p.value.type() == NumberLong;
+                break;
+            case String:
+            case Symbol: p.kind = Str; break;
+            case Date:
+            case Timestamp: p.kind = Time; break;
+            case jstOID: p.kind = Oid; break;
+            case Bool: p.kind = Boolean; break;
+            default: return false;
+        }
+        const char *f = p.value.fieldName();
+        const char *dot = strchr( f, '.' );
+        p.first = dot ? string( f, dot - f ) : string( f );
+        while( dot ) {
+            f = dot + 1;
+            dot = strchr( f, '.' );
+            p.rest.push_back( dot ? string( f, dot - f ) : string( f ) );
+        }
+        _preds.push_back( p );
+        return true;
+    }
+
+    inline int CompiledPredicates::compare( const Predicate &p, const BSONElement &e ) {
+        switch( p.kind ) {
+            case Num: {
+                double x;
+                switch( e.type() ) {
+                    case NumberDouble: x = e._numberDouble(); break;
+                    case NumberInt: x = e._numberInt(); break;
+                    case NumberLong:
+                        if ( p.isLong ) {
+                            long long L = e._numberLong(), R = p.value._numberLong();
+                            return L < R ? -1 : ( L == R ? 0 : 1 );
+                        }
+                        x = (double) e._numberLong();
+                        break;
+                    default: return -2;
+                }
+                bool xNan = !( x <= numeric_limits< double >::max() && x >= -numeric_limits< double >::max() );
+                if ( xNan || p.dNan )
+                    return xNan == p.dNan ? 0 : ( xNan ? -1 : 1 );
+                return x < p.d ? -1 : ( x == p.d ? 0 : 1 );
+            }
+            case Str: {
+                if ( e.type() != String && e.type() != Symbol )
+                    return -2;
+                int c = strcmp( e.valuestr(), p.value.valuestr() );
+                return c < 0 ? -1 : ( c == 0 ? 0 : 1 );
+            }
+            case Time: {
+                if ( e.type() != Date && e.type() != Timestamp )
+                    return -2;
+                Date_t l = e.date(), r = p.value.date();
+                return l < r ? -1 : ( l == r ? 0 : 1 );
+            }
+            case Oid: {
+                if ( e.type() != jstOID )
+                    return -2;
+                int c = memcmp( e.value(), p.value.value(), 12 );
+                return c < 0 ? -1 : ( c == 0 ? 0 : 1 );
+            }
+            case Boolean: {
+                if ( e.type() != Bool )
+                    return -2;
+                int c = *e.value() - *p.value.value();
+                return c < 0 ? -1 : ( c == 0 ? 0 : 1 );
+            }
+        }
+        return -2;
+    }
+
+    int CompiledPredicates::eval( const Predicate &p, BSONElement e ) {
+        for( vector< string >::const_iterator i = p.rest.begin(); i != p.rest.end(); ++i ) {
+            if ( e.type() == Array )
+                return -1;
+            if ( e.type() != Object )
+                return 0; // missing
+            e = e.embeddedObject().getField( i->c_str() );
+            if ( e.eoo() )
+                return 0;
+        }
+        if ( e.type() == Array )
+            return -1;
+        int c = compare( p, e );
+        if ( c == -2 )
+            return 0;
+        return ( p.mask & ( 1 << ( c + 1 ) ) ) ? 1 : 0;
+    }
+
+    int CompiledPredicates::matches( const BSONObj &obj ) const {
+        const unsigned n = _preds.size();
+        unsigned found = 0; // bit k set once predicate k's top level field has been seen
+        bool undecided = false;
+        BSONObjIterator i( obj );
+        while( i.more() ) {
+            BSONElement e = i.next();
+            const char *fn = e.fieldName();
+            for( unsigned k = 0; k < n; k++ ) {
+                // only the first field of a name is matched, as getField() does
+                if ( ( found & ( 1U << k ) ) || strcmp( fn, _preds[ k ].first.c_str() ) != 0 )
+                    continue;
+                found |= 1U << k;
+                int r = eval( _preds[ k ], e );
+                if ( r == 0 )
+                    return 0;
+                if ( r < 0 )
+                    undecided = true;
+            }
+        }
+        if ( found != ( n == 32 ? 0xffffffffU : ( 1U << n ) - 1 ) )
+            return 0; // a missing field matches none of these (null is not compiled)
+        return undecided ? -1 : 1;
     }
     
     inline bool regexMatches(const RegexMatcher& rm, const BSONElement& e) {
@@ -725,6 +876,14 @@ namespace mongo {
         /* assuming there is usually only one thing to match.  if more this
         could be slow sometimes. */
 
+        if ( !_compiled.empty() ) {
+            int r = _compiled.matches( jsobj );
+            if ( r == 0 )
+                return false;
+            if ( r == 1 && _compiledAll )
+                return true;
+        }
+
         // check normal non-regex cases:
         for ( unsigned i = 0; i < basics.size(); i++ ) {
             ElementMatcher& bm = basics[i];
@@ -80,6 +80,41 @@ namespace mongo {
         vector< shared_ptr<Matcher> > allMatchers;
     };
 
+    /* a conjunction of simple comparisons compiled from a Matcher's basics, e.g. 
+       { a : 3, "b.c" : { $gt : 5 } }.  field paths are split once, the comparison for each is 
+       specialized by the type of the query value, and a document's top level fields are 
+       scanned once for all of them.  an array on a path is left to the general matcher. */
+    class CompiledPredicates {
+    public:
+        /** @return false if bm is not a simple comparison; nothing is added then. */
+        bool add( const ElementMatcher &bm );
+
+        bool empty() const { return _preds.empty(); }
+        unsigned size() const { return _preds.size(); }
+
+        /** @return 1 match, 0 mismatch, -1 undecided - use the general matcher */
+        int matches( const BSONObj &obj ) const;
+
+        enum { MaxPredicates = 32 };
+    private:
+        enum Kind { Num, Str, Time, Oid, Boolean };
+        struct Predicate {
+            string first;          // top level field name
+            vector< string > rest; // remaining path segments, for dotted field names
+            int mask;              // bit (c+1) set if a comparison result c of -1, 0, 1 matches
+            Kind kind;
+            BSONElement value;
+            double d;              // Num
+            bool dNan;             // Num: NaN or infinite, ordered as in compareElementValues()
+            bool isLong;           // Num: value is a NumberLong, compared exactly against NumberLongs
+        };
+        /** 1 match, 0 mismatch, -1 undecided */
+        static int eval( const Predicate &p, BSONElement e );
+        /** -1, 0, 1 as compareElementValues( e, p.value ); -2 if of a different canonical type */
+        static int compare( const Predicate &p, const BSONElement &e );
+        vector< Predicate > _preds;
+    };
+
     class Where; // used for $where javascript eval
     class DiskLoc;
 
@@ -199,6 +234,10 @@ namespace mongo {
         list< shared_ptr< Matcher > > _orMatchers;
         list< shared_ptr< Matcher > > _norMatchers;
 
+        void compile();
+        CompiledPredicates _compiled;  // the basics that compile; checked before the general match
+        bool _compiledAll;             // _compiled decides the whole match
+
         friend class CoveredIndexMatcher;
     };
     
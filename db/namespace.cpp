@@ -51,7 +51,7 @@ namespace mongo {
         capped = _capped;
         max = 0x7fffffff;
         paddingFactor = 1.0;
-        flags = 0;
+        flags = Flag_DeletedCounted;
         capFirstNewRecord = DiskLoc();
         // Signal that we are on first allocation iteration through extents.
         capFirstNewRecord.setInvalid();
@@ -60,11 +60,16 @@ namespace mongo {
             deletedList[ 1 ].setInvalid();
 		assert( sizeof(dataFileVersion) == 2 );
 		dataFileVersion = 0;
-		indexFileVersion = 0;
+		indexFileVersion = cmdLine.compactKeys ? 1 : 0;
         multiKeyIndexBits = 0;
-        reservedA = 0;
+        multiKeyExactBits = 0;
         extraOffset = 0;
         backgroundIndexBuildInProgress = 0;
+        memset(growthHistogram, 0, sizeof(growthHistogram));
+        growthSamples = 0;
+        nUpdateMoves = 0;
+        deletedSize = 0;
+        deletedCount = 0;
         memset(reserved, 0, sizeof(reserved));
     }
 
@@ -197,6 +202,9 @@ namespace mongo {
                 firstDeletedInCapExtent() = dloc;
             }
         } else {
+            checkDeletedCounted();
+            deletedSize += d->lengthWithHeaders;
+            deletedCount++;
             int b = bucket(d->lengthWithHeaders);
             DiskLoc& list = deletedList[b];
             DiskLoc oldHead = list;
@@ -210,6 +218,7 @@ namespace mongo {
     */
     DiskLoc NamespaceDetails::alloc(const char *ns, int lenToAlloc, DiskLoc& extentLoc) {
         lenToAlloc = (lenToAlloc + 3) & 0xfffffffc;
+        checkDeletedCounted();
         DiskLoc loc = _alloc(ns, lenToAlloc);
         if ( loc.isNull() )
             return loc;
@@ -219,6 +228,10 @@ namespace mongo {
         /* note we want to grab from the front so our next pointers on disk tend
         to go in a forward direction which is important for performance. */
         int regionlen = r->lengthWithHeaders;
+        if ( capped == 0 ) {
+            deletedSize -= regionlen;
+            deletedCount--;
+        }
         extentLoc.set(loc.a(), r->extentOfs);
         assert( r->extentOfs < loc.getOfs() );
 
@@ -226,7 +239,11 @@ namespace mongo {
 
         int left = regionlen - lenToAlloc;
         if ( capped == 0 ) {
-            if ( left < 24 || left < (lenToAlloc >> 3) ) {
+            /* with power of two sizes a freed record is reused whole, so records keep their 
+               slot size.  only space not carved into slots yet -- the end of an extent, or 
+               free records from before the setting -- is split. */
+            bool slot = usePowerOf2Sizes() && quantizePowerOf2AllocationSpace( regionlen ) == regionlen;
+            if ( slot || left < 24 || left < (lenToAlloc >> 3) ) {
                 // you get the whole thing.
 				DataFileMgr::grow(loc, regionlen);
                 return loc;
@@ -248,10 +265,95 @@ namespace mongo {
         return loc;
     }
 
+    int NamespaceDetails::quantizePowerOf2AllocationSpace( int allocSize ) {
+        for ( int i = 0; i < Buckets; i++ )
+            if ( bucketSizes[i] >= allocSize )
+                return bucketSizes[i];
+        return ( allocSize + 0xfffff ) & ~0xfffff;
+    }
+
+    int NamespaceDetails::quantizeAllocationSpace( int allocSize ) {
+        int unit = bucketSizes[ bucket( allocSize ) ] / 32;
+        if ( unit < 4 )
+            unit = 4;
+        return ( allocSize + unit - 1 ) / unit * unit;
+    }
+
+    int NamespaceDetails::allocationSize( int lenWHdr ) const {
+        if ( usePowerOf2Sizes() )
+            return quantizePowerOf2AllocationSpace( lenWHdr );
+        int x = (int) ( lenWHdr * paddingFactor );
+        if ( capped || x == 0 ) // 0: old datafiles without a paddingFactor
+            return x;
+        return quantizeAllocationSpace( x );
+    }
+
+    void NamespaceDetails::noteUpdateSize( int objSize, int oldSize ) {
+        if ( capped || usePowerOf2Sizes() || oldSize <= 0 )
+            return;
+        // sizes, not the padded space, so that samples from before a change of paddingFactor 
+        // still mean the same.  growth in ((b-1)/16, b/16]  <=>  b == ceil(16*growth/oldSize)
+        long long b = 0;
+        if ( objSize > oldSize )
+            b = ( 16LL * ( objSize - oldSize ) + oldSize - 1 ) / oldSize;
+        if ( b >= GrowthBuckets )
+            b = GrowthBuckets - 1;
+        if ( growthHistogram[b] < 0xffff )
+            growthHistogram[b]++;
+        if ( ++growthSamples < GrowthWindow )
+            return;
+        growthSamples = 0;
+
+        unsigned total = 0;
+        for ( int i = 0; i < GrowthBuckets; i++ )
+            total += growthHistogram[i];
+        // the smallest bucket bound that 90% of the noted updates fall under.  the last bucket 
+        // has none, it gets the most padding we allow
+        unsigned target = total - total / 10;
+        unsigned n = 0;
+        double x = 1.0;
+        for ( int i = 0; i < GrowthBuckets; i++ ) {
+            n += growthHistogram[i];
+            if ( n >= target ) {
+                x = i == GrowthBuckets - 1 ? 2.0 : 1.0 + i / 16.0;
+                break;
+            }
+        }
+        paddingFactor = x;
+
+        // older updates count for less in later windows
+        for ( int i = 0; i < GrowthBuckets; i++ )
+            growthHistogram[i] /= 2;
+    }
+
+    /* for collections using power of two sizes.  records are sized to the smallest size of
+       a bucket, so any deleted record in the bucket can hold them (only the last bucket
+       has no upper limit).  we take the head of the first bucket that fits rather than
+       searching chains, so allocation is bounded by the number of buckets.
+       returned item is out of the deleted list upon return
+    */
+    DiskLoc NamespaceDetails::__powerOf2Alloc(int len) {
+        for ( int b = bucket(len); b < Buckets; b++ ) {
+            DiskLoc cur = deletedList[b];
+            if ( cur.isNull() )
+                continue;
+            DeletedRecord *r = cur.drec();
+            if ( r->lengthWithHeaders < len )
+                continue;
+            deletedList[b] = r->nextDeleted;
+            r->nextDeleted.setInvalid(); // defensive.
+            assert( r->extentOfs < cur.getOfs() );
+            return cur;
+        }
+        return DiskLoc();
+    }
+
     /* for non-capped collections.
        returned item is out of the deleted list upon return
     */
     DiskLoc NamespaceDetails::__stdAlloc(int len) {
+        if ( usePowerOf2Sizes() )
+            return __powerOf2Alloc(len);
         DiskLoc *prev;
         DiskLoc *bestprev = 0;
         DiskLoc bestmatch;
@@ -342,6 +444,38 @@ namespace mongo {
         }
     }
 
+    void NamespaceDetails::countDeleted( long long &size, long long &n ) {
+        size = n = 0;
+        for ( int i = 0; i < Buckets; i++ ) {
+            for ( DiskLoc dl = deletedList[i]; !dl.isNull() && dl.isValid(); dl = dl.drec()->nextDeleted ) {
+                size += dl.drec()->lengthWithHeaders;
+                n++;
+            }
+        }
+    }
+
+    void NamespaceDetails::deletedStats( long long &size, long long &n, int &largest ) {
+        if ( flags & Flag_DeletedCounted ) {
+            size = deletedSize;
+            n = deletedCount;
+        }
+        else {
+            // not changed since before the counts were kept, we're only reading here
+            countDeleted( size, n );
+        }
+        // each bucket's records are smaller than the next bucket's, so the largest is in the 
+        // highest bucket in use.  only look at the start of its chain, like __stdAlloc
+        largest = 0;
+        for ( int i = Buckets - 1; i >= 0 && largest == 0; i-- ) {
+            int chain = 0;
+            for ( DiskLoc dl = deletedList[i]; !dl.isNull() && dl.isValid() && chain < 30; dl = dl.drec()->nextDeleted, chain++ ) {
+                int len = dl.drec()->lengthWithHeaders;
+                if ( len > largest )
+                    largest = len;
+            }
+        }
+    }
+
     /* combine adjacent deleted records
 
        this is O(n^2) but we call it for capped tables where typically n==1 or 2!
@@ -707,10 +841,66 @@ namespace mongo {
     map< string, shared_ptr< NamespaceDetailsTransient > > NamespaceDetailsTransient::_map;
     typedef map< string, shared_ptr< NamespaceDetailsTransient > >::iterator ouriter;
 
+    bool CachedQueryPlan::stale( long long nRecords , long long writes ) const {
+        if ( writes - _writes > max( _nRecords , 100LL ) )
+            return true;
+        long long drift = nRecords > _nRecords ? nRecords - _nRecords : _nRecords - nRecords;
+        return drift > max( _nRecords / 4 , 100LL );
+    }
+
+    void CachedQueryPlan::won( const BSONObj& indexKey , long long nScanned , long long nRecords , long long writes ) {
+        this->indexKey = indexKey.getOwned();
+        this->nScanned = nScanned;
+        runs = 0;
+        avgNScanned = 0;
+        _nRecords = nRecords;
+        _writes = writes;
+    }
+
+    void CachedQueryPlan::ran( const BSONObj& indexKey , long long nScanned ) {
+        if ( this->indexKey.woCompare( indexKey ) != 0 )
+            return;
+        if ( runs++ == 0 )
+            avgNScanned = (double) nScanned;
+        else
+            avgNScanned = avgNScanned * 0.9 + nScanned * 0.1;
+    }
+
+    void CachedQueryPlan::appendSelf( BSONObjBuilder& b , long long writes ) const {
+        b.appendNumber( "nRecords" , _nRecords );
+        b.appendNumber( "writesSince" , writes - _writes );
+        b.append( "indexKey" , indexKey );
+        b.appendNumber( "nScanned" , nScanned );
+        b.appendNumber( "runs" , runs );
+        b.append( "avgNScanned" , avgNScanned );
+    }
+
+    const CachedQueryPlan *NamespaceDetailsTransient::planForPattern( const QueryPattern &pattern, long long nRecords ) {
+        map< QueryPattern, CachedQueryPlan >::iterator i = _qcCache.find( pattern );
+        if ( i == _qcCache.end() )
+            return 0;
+        if ( i->second.stale( nRecords, _qcWriteCount ) ) {
+            log(1) << "query plan for " << _ns << ' ' << pattern.toBSON() << " is stale" << endl;
+            _qcCache.erase( i );
+            return 0;
+        }
+        return &i->second;
+    }
+
+    void NamespaceDetailsTransient::appendQueryCache( BSONArrayBuilder& b ) const {
+        for( map< QueryPattern, CachedQueryPlan >::const_iterator i = _qcCache.begin(); i != _qcCache.end(); ++i ) {
+            BSONObjBuilder e( b.subobjStart() );
+            e.append( "pattern" , i->first.toBSON() );
+            i->second.appendSelf( e , _qcWriteCount );
+            e.done();
+        }
+    }
+
     void NamespaceDetailsTransient::reset() {
         DEV assertInWriteLock();
         clearQueryCache();
         _keysComputed = false;
+        _keyFieldTrie.reset();
         _indexSpecs.clear();
     }
     
@@ -743,6 +933,20 @@ namespace mongo {
             i.next().keyPattern().getFieldNames(_indexKeys);
     }
 
+    const IndexKeyFieldTrie& NamespaceDetailsTransient::keyFieldTrie( NamespaceDetails *d ) {
+        DEV assertInWriteLock();
+        int n = d->nIndexesBeingBuilt();
+        bool current = _keyFieldTrie.get() && _keyFieldTrie->nIndexes() == n;
+        for( int i = 0; current && i < n; ++i )
+            current = _keyFieldTrie->spec( i ).getDetails() == &d->idx( i );
+        if ( !current ) {
+            _keyFieldTrie.reset( new IndexKeyFieldTrie() );
+            for( int i = 0; i < n; ++i )
+                _keyFieldTrie->addIndex( &getIndexSpec( &d->idx( i ) ) );
+        }
+        return *_keyFieldTrie;
+    }
+
     void NamespaceDetailsTransient::cllStart( int logSizeMb ) {
         assertInWriteLock();
         _cll_ns = "local.temp.oplog." + _ns;
@@ -260,15 +260,32 @@ namespace mongo {
 		   See filever.h
         */
 		unsigned short dataFileVersion;
-		unsigned short indexFileVersion;
+		unsigned short indexFileVersion; // 1 if created with --compactKeys: new btree buckets for this collection's indexes are CompactKeys
 
         unsigned long long multiKeyIndexBits;
+        /* bit i set if idx(i) was built since multikey marking noticed single element arrays, so
+           that !isMultikey(i) means no key came from an array.  zero (was reserved) in older files. */
+        unsigned long long multiKeyExactBits;
     private:
-        unsigned long long reservedA;
         long long extraOffset; // where the $extra info is located (bytes relative to this)
     public:
         int backgroundIndexBuildInProgress; // 1 if in prog
-        char reserved[76];
+
+        /* how much updates grow objects, in 1/16ths of the old object's size: growthHistogram[b]
+           counts growth in ((b-1)/16, b/16], bucket 0 no growth, the last bucket everything above
+           14/16.  see noteUpdateSize() */
+        enum { GrowthBuckets = 16, GrowthWindow = 256 };
+        unsigned short growthHistogram[GrowthBuckets];
+        int growthSamples; // updates noted since paddingFactor was last recomputed
+
+        long long nUpdateMoves; // updates that outgrew their record and moved the object
+
+        /* bytes and records on the deleted lists (not for capped collections), kept as records
+           go on and off them so collStats needn't walk the lists.  only meaningful with 
+           Flag_DeletedCounted: older files count them on their first change, see checkDeletedCounted() */
+        long long deletedSize;
+        long long deletedCount;
+        char reserved[16];
 
         /* when a background index build is in progress, we don't count the index in nIndexes until 
            complete, yet need to still use it in _indexRecord() - thus we use this function for that.
@@ -280,7 +297,9 @@ namespace mongo {
         */
         enum NamespaceFlags {
             Flag_HaveIdIndex = 1 << 0, // set when we have _id index (ONLY if ensureIdIndex was called -- 0 if that has never been called)
-            Flag_CappedDisallowDelete = 1 << 1 // set when deletes not allowed during capped table allocation.
+            Flag_CappedDisallowDelete = 1 << 1, // set when deletes not allowed during capped table allocation.
+            Flag_UsePowerOf2Sizes = 1 << 2, // records are allocated in power of two sizes, see __powerOf2Alloc()
+            Flag_DeletedCounted = 1 << 3 // deletedSize and deletedCount are kept
         };
 
         IndexDetails& idx(int idxNo) {
@@ -331,9 +350,10 @@ namespace mongo {
             return -1;
         }
 
-        /* multikey indexes are indexes where there are more than one key in the index
-             for a single document. see multikey in wiki.
-           for these, we have to do some dedup work on queries.
+        /* multikey indexes are indexes where a document has an array on a key field path -- usually
+             more than one key in the index for a single document. see multikey in wiki.
+           for these, we have to do some dedup work on queries, and can't answer queries from the 
+           keys alone ( {a:[5]} has the single key 5 ).
         */
         bool isMultikey(int i) {
             return (multiKeyIndexBits & (((unsigned long long) 1) << i)) != 0;
@@ -346,6 +366,13 @@ namespace mongo {
             dassert( i < NIndexesMax );
             multiKeyIndexBits &= ~(((unsigned long long) 1) << i);
         }
+        bool isMultikeyExact(int i) {
+            return (multiKeyExactBits & (((unsigned long long) 1) << i)) != 0;
+        }
+        void setIndexIsMultikeyExact(int i) { 
+            dassert( i < NIndexesMax );
+            multiKeyExactBits |= (((unsigned long long) 1) << i);
+        }
 
         /* add a new index.  does not add to system.indexes etc. - just to NamespaceDetails.
            caller must populate returned object. 
@@ -355,20 +382,33 @@ namespace mongo {
         void aboutToDeleteAnIndex() { flags &= ~Flag_HaveIdIndex;  }
 
         void cappedDisallowDelete() { flags |= Flag_CappedDisallowDelete; }
+
+        bool usePowerOf2Sizes() const { return !capped && ( flags & Flag_UsePowerOf2Sizes ); }
+        void setUsePowerOf2Sizes( bool on ) {
+            if ( on )
+                flags |= Flag_UsePowerOf2Sizes;
+            else
+                flags &= ~Flag_UsePowerOf2Sizes;
+        }
+
+        /* the smallest bucket size holding allocSize, so that any deleted record in the bucket
+           can be reused for it.  beyond the largest bucket, rounds up to a megabyte. */
+        static int quantizePowerOf2AllocationSpace( int allocSize );
+
+        /* rounds allocSize up to a multiple of 1/32 of the bucket size above it */
+        static int quantizeAllocationSpace( int allocSize );
         
         /* returns index of the first index in which the field is present. -1 if not present. */
         int fieldIsIndexed(const char *fieldName);
 
-        void paddingFits() {
-            double x = paddingFactor - 0.01;
-            if ( x >= 1.0 )
-                paddingFactor = x;
-        }
-        void paddingTooSmall() {
-            double x = paddingFactor + 0.6;
-            if ( x <= 2.0 )
-                paddingFactor = x;
-        }
+        /* called for each update with the new and old object sizes.  every GrowthWindow updates,
+           paddingFactor is set to the growth that 90% of the recent updates stayed within. */
+        void noteUpdateSize( int objSize, int oldSize );
+
+        /* the space to allocate for a record of lenWHdr bytes (headers included): a power of 
+           two with usePowerOf2Sizes, otherwise padded by paddingFactor and rounded up to a 
+           size class so that freed records fit documents of similar size. */
+        int allocationSize( int lenWHdr ) const;
 
         //returns offset in indexes[]
         int findIndexByName(const char *name) {
@@ -417,6 +457,20 @@ namespace mongo {
         void addDeletedRec(DeletedRecord *d, DiskLoc dloc);
 
         void dumpDeleted(set<DiskLoc> *extents = 0);
+
+        /* call before changing the deleted lists other than through alloc() and addDeletedRec(),
+           which do.  counts them if deletedSize and deletedCount aren't being kept yet. */
+        void checkDeletedCounted() {
+            if ( !capped && !( flags & Flag_DeletedCounted ) ) {
+                countDeleted( deletedSize, deletedCount );
+                flags |= Flag_DeletedCounted;
+            }
+        }
+
+        /* space on the deleted lists: total bytes, number of deleted records and the largest one.
+           largest is from the start of the highest bucket in use, so it may come out low if the
+           last bucket has a long chain. */
+        void deletedStats( long long &size, long long &n, int &largest );
         bool capLooped() const { return capped && capFirstNewRecord.isValid();  }
 
         // Start from firstExtent by default.
@@ -435,9 +489,11 @@ namespace mongo {
         void advanceCapExtent( const char *ns );
         void maybeComplain( const char *ns, int len ) const;
         DiskLoc __stdAlloc(int len);
+        DiskLoc __powerOf2Alloc(int len);
         DiskLoc __capAlloc(int len);
         DiskLoc _alloc(const char *ns, int len);
         void compact(); // combine adjacent deleted records
+        void countDeleted( long long &size, long long &n ); // walks the deleted lists
         DiskLoc &firstDeletedInCapExtent();
         bool nextIsInCapExtent( const DiskLoc &dl ) const;
     }; // NamespaceDetails
@@ -455,6 +511,34 @@ namespace mongo {
 
        todo: cleanup code, need abstractions and separation
     */
+    /* what the query optimizer has learned about one QueryPattern: the plan (by index key) that
+       won the last race, and how its runs have gone since.  see QueryPlanSet.
+    */
+    class CachedQueryPlan {
+    public:
+        CachedQueryPlan() : nScanned(), runs(), avgNScanned(), _nRecords(), _writes() {}
+
+        BSONObj indexKey;
+        long long nScanned;  // when it won.  each run is held against this, see QueryPlanSet::Runner
+        long long runs;      // since it won
+        double avgNScanned;  // of those runs, exponentially weighted.  for the planCache command
+
+        /* the collection has moved on too much since the plan won: the writes since then are more
+           than its size was, or its document count has drifted by more than a quarter.  either way
+           by at least 100, so small collections don't thrash. */
+        bool stale( long long nRecords , long long writes ) const;
+
+        /* indexKey won a race, after nScanned */
+        void won( const BSONObj& indexKey , long long nScanned , long long nRecords , long long writes );
+        /* the cached plan ran again on its own */
+        void ran( const BSONObj& indexKey , long long nScanned );
+
+        void appendSelf( BSONObjBuilder& b , long long writes ) const;
+    private:
+        long long _nRecords; // in the collection when the plan won
+        long long _writes;   // NamespaceDetailsTransient's write count then
+    };
+
     class NamespaceDetailsTransient : boost::noncopyable {
 		BOOST_STATIC_ASSERT( sizeof(NamespaceDetails) == 496 );
 
@@ -513,10 +597,17 @@ namespace mongo {
             return spec;
         }
 
+        /* key fields of all indexes, including one being built in the background, merged so
+           that index keys for a record come from one pass over it.  assumed to be in write lock. */
+    private:
+        shared_ptr< IndexKeyFieldTrie > _keyFieldTrie;
+    public:
+        const IndexKeyFieldTrie& keyFieldTrie( NamespaceDetails *d );
+
         /* query cache (for query optimizer) ------------------------------------- */
     private:
-        int _qcWriteCount;
-        map< QueryPattern, pair< BSONObj, long long > > _qcCache;
+        long long _qcWriteCount; // ever, to tell how many there have been since a plan was cached
+        map< QueryPattern, CachedQueryPlan > _qcCache;
     public:
         static mongo::mutex _qcMutex;
         /* you must be in the qcMutex when calling this (and using the returned val): */
@@ -525,24 +616,37 @@ namespace mongo {
         }
         void clearQueryCache() { // public for unit tests
             _qcCache.clear();
-            _qcWriteCount = 0;
         }
         /* you must notify the cache if you are doing writes, as query plan optimality will change */
         void notifyOfWriteOp() {
-            if ( _qcCache.empty() )
-                return;
-            if ( ++_qcWriteCount >= 100 )
-                clearQueryCache();
+            ++_qcWriteCount;
         }
+        /* the plan cached for pattern, or 0 if there is none.  a stale one is dropped.
+           nRecords: the collection's document count now */
+        const CachedQueryPlan *planForPattern( const QueryPattern &pattern, long long nRecords );
         BSONObj indexForPattern( const QueryPattern &pattern ) {
-            return _qcCache[ pattern ].first;
+            map< QueryPattern, CachedQueryPlan >::const_iterator i = _qcCache.find( pattern );
+            return i == _qcCache.end() ? BSONObj() : i->second.indexKey;
         }
         long long nScannedForPattern( const QueryPattern &pattern ) {
-            return _qcCache[ pattern ].second;
+            map< QueryPattern, CachedQueryPlan >::const_iterator i = _qcCache.find( pattern );
+            return i == _qcCache.end() ? 0 : i->second.nScanned;
+        }
+        /* an empty indexKey forgets the pattern */
+        void registerIndexForPattern( const QueryPattern &pattern, const BSONObj &indexKey, long long nScanned, long long nRecords = 0 ) {
+            if ( indexKey.isEmpty() ) {
+                _qcCache.erase( pattern );
+                return;
+            }
+            _qcCache[ pattern ].won( indexKey, nScanned, nRecords, _qcWriteCount );
         }
-        void registerIndexForPattern( const QueryPattern &pattern, const BSONObj &indexKey, long long nScanned ) {
-            _qcCache[ pattern ] = make_pair( indexKey, nScanned );
+        void registerRunForPattern( const QueryPattern &pattern, const BSONObj &indexKey, long long nScanned ) {
+            map< QueryPattern, CachedQueryPlan >::iterator i = _qcCache.find( pattern );
+            if ( i != _qcCache.end() )
+                i->second.ran( indexKey, nScanned );
         }
+        /* for the planCache command */
+        void appendQueryCache( BSONArrayBuilder& b ) const;
 
         /* for collection-level logging -- see CmdLogCollection ----------------- */ 
         /* assumed to be in write lock for this */
@@ -29,10 +29,101 @@ namespace mongo {
     // cached copies of these...so don't rename them
     NamespaceDetails *localOplogMainDetails = 0;
     Database *localOplogDB = 0;
+    shared_ptr<OplogTsIndex> localOplogMainTsIndex;
 
     void oplogCheckCloseDatabase( Database * db ){
         localOplogDB = 0;
         localOplogMainDetails = 0;
+        localOplogMainTsIndex.reset();
+        OplogTsIndex::forget( db->name + '.' );
+    }
+
+    /* -- OplogTsIndex -- */
+
+    static map< string, shared_ptr<OplogTsIndex> > oplogTsIndexes;
+    static mongo::mutex oplogTsIndexesMutex("oplogTsIndexes");
+
+    shared_ptr<OplogTsIndex> OplogTsIndex::get( const string& ns ) {
+        scoped_lock lk( oplogTsIndexesMutex );
+        shared_ptr<OplogTsIndex> &i = oplogTsIndexes[ ns ];
+        if ( i.get() == 0 )
+            i.reset( new OplogTsIndex() );
+        return i;
+    }
+
+    shared_ptr<OplogTsIndex> OplogTsIndex::find( const string& ns ) {
+        scoped_lock lk( oplogTsIndexesMutex );
+        map< string, shared_ptr<OplogTsIndex> >::const_iterator i = oplogTsIndexes.find( ns );
+        return i == oplogTsIndexes.end() ? shared_ptr<OplogTsIndex>() : i->second;
+    }
+
+    void OplogTsIndex::forget( const string& prefix ) {
+        scoped_lock lk( oplogTsIndexesMutex );
+        map< string, shared_ptr<OplogTsIndex> >::iterator i = oplogTsIndexes.begin();
+        while ( i != oplogTsIndexes.end() ) {
+            if ( i->first.compare( 0, prefix.size(), prefix ) == 0 )
+                oplogTsIndexes.erase( i++ );
+            else
+                ++i;
+        }
+    }
+
+    /* ts of the log record at loc, null if it hasn't got one */
+    static OpTime tsAt( const DiskLoc& loc ) {
+        BSONElement e = loc.obj()[ "ts" ];
+        if ( !( e.type() == Date || e.type() == Timestamp ) )
+            return OpTime();
+        return OpTime( e.date() );
+    }
+
+    void OplogTsIndex::sample( const OpTime& ts, const DiskLoc& loc ) {
+        scoped_lock lk( _mutex );
+        _bytes = 0;
+        _samples[ ts.asDate() ] = loc;
+        if ( _samples.size() > MaxSamples )
+            _samples.erase( _samples.begin() );
+    }
+
+    void OplogTsIndex::sampleExtents( NamespaceDetails *d ) {
+        _extentsSampled = true;
+        for ( DiskLoc e = d->firstExtent; !e.isNull(); e = e.ext()->xnext ) {
+            DiskLoc r = e.ext()->firstRecord;
+            // the fresh side of capExtent, as in FindingStartCursor::startLoc()
+            if ( d->capLooped() && e == d->capExtent )
+                r = d->capFirstNewRecord;
+            if ( r.isNull() )
+                continue;
+            OpTime ts = tsAt( r );
+            if ( !ts.isNull() )
+                _samples[ ts.asDate() ] = r;
+        }
+    }
+
+    DiskLoc OplogTsIndex::seek( NamespaceDetails *d, const DiskLoc& first, const OpTime& ts ) {
+        scoped_lock lk( _mutex );
+        if ( !_extentsSampled )
+            sampleExtents( d );
+
+        OpTime firstTs = tsAt( first );
+        if ( firstTs.isNull() )
+            return DiskLoc();
+        // samples before the oldest record have been overwritten
+        _samples.erase( _samples.begin(), _samples.lower_bound( firstTs.asDate() ) );
+        _samples[ firstTs.asDate() ] = first;
+
+        // the last sample before ts.  ts can't be matched at or before it, and all is
+        // matched from first on if there's none
+        Samples::iterator i = _samples.lower_bound( ts.asDate() );
+        if ( i != _samples.begin() )
+            --i;
+        if ( !( tsAt( i->second ).asDate() == i->first ) ) {
+            // shouldn't happen; don't trust it and fall back to the scan
+            log() << "OplogTsIndex: sample " << OpTime( i->first ).toString() << " out of date, clearing" << endl;
+            _samples.clear();
+            _extentsSampled = false;
+            return DiskLoc();
+        }
+        return i->second;
     }
 
     /* we write to local.opload.$main:
@@ -85,18 +176,22 @@ namespace mongo {
         int len = posz + obj.objsize() + 1 + 2 /*o:*/;
 
         Record *r;
+        DiskLoc loc;
         if ( strncmp( logNS, "local.", 6 ) == 0 ) { // For now, assume this is olog main
             if ( localOplogMainDetails == 0 ) {
                 Client::Context ctx("local.", dbpath, 0, false);
                 localOplogDB = ctx.db();
                 localOplogMainDetails = nsdetails(logNS);
+                localOplogMainTsIndex = OplogTsIndex::get( logNS );
             }
             Client::Context ctx( "" , localOplogDB, false );
-            r = theDataFileMgr.fast_oplog_insert(localOplogMainDetails, logNS, len);
+            r = theDataFileMgr.fast_oplog_insert(localOplogMainDetails, logNS, len, &loc);
+            localOplogMainTsIndex->noteInsert( ts, loc, len );
         } else {
             Client::Context ctx( logNS, dbpath, 0, false );
             assert( nsdetails( logNS ) );
-            r = theDataFileMgr.fast_oplog_insert( nsdetails( logNS ), logNS, len);
+            r = theDataFileMgr.fast_oplog_insert( nsdetails( logNS ), logNS, len, &loc);
+            OplogTsIndex::get( logNS )->noteInsert( ts, loc, len );
         }
 
         char *p = r->data;
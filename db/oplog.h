@@ -55,6 +55,53 @@ namespace mongo {
     
     extern int __findingStartInitialTimeout; // configurable for testing    
 
+    /* sparse in-memory index of ts -> record for the capped logs _logOp() writes
+       (local.oplog.$main, collection level logs).  a sample is taken every SampleBytes of
+       log written, and on first use from the first record of each extent -- so after a
+       restart it costs one read per extent.  a capped log is overwritten oldest first, so
+       samples older than the oldest record still in the log are dropped and every other
+       one still points at the record it was taken from.
+
+       lets FindingStartCursor start a { ts : { $gte : ... } } scan at most SampleBytes
+       before the first match instead of walking back from the end of the log.
+    */
+    class OplogTsIndex : boost::noncopyable {
+    public:
+        enum { SampleBytes = 1024 * 1024, MaxSamples = 64 * 1024 };
+
+        /* the index for log ns, created if need be.  only _logOp() creates them: ts must be
+           increasing in insertion order, across drops too, for samples to be dropped right */
+        static shared_ptr<OplogTsIndex> get( const string& ns );
+        /* the index for ns, if it has one */
+        static shared_ptr<OplogTsIndex> find( const string& ns );
+        /* a database is closing, forget its logs */
+        static void forget( const string& prefix );
+
+        OplogTsIndex() : _extentsSampled(), _bytes(), _mutex("OplogTsIndex") { }
+
+        /* _logOp() wrote a record of len bytes with ts at loc.  caller holds the write lock */
+        void noteInsert( const OpTime& ts, const DiskLoc& loc, int len ) {
+            _bytes += len;
+            if ( _bytes >= SampleBytes )
+                sample( ts, loc );
+        }
+
+        /* a record at or before the first one in d with ts >= the given.  first is the oldest
+           record in the log (where a forward scan starts).  null if the log has no ts to go by.
+           caller holds at least a read lock */
+        DiskLoc seek( NamespaceDetails *d, const DiskLoc& first, const OpTime& ts );
+
+        int nSamples() const { return _samples.size(); } // for unit tests
+    private:
+        void sample( const OpTime& ts, const DiskLoc& loc );
+        void sampleExtents( NamespaceDetails *d );
+        typedef map< unsigned long long, DiskLoc > Samples; // OpTime::asDate() -> record
+        Samples _samples;
+        bool _extentsSampled;
+        int _bytes; // written since the last sample
+        mongo::mutex _mutex; // readers seek concurrently
+    };
+
     class FindingStartCursor {
     public:
         FindingStartCursor( const QueryPlan & qp ) : 
@@ -182,19 +229,45 @@ namespace mongo {
                 _findingStartCursor = ClientCursor::find( id, false );
             }                                            
         }
+        /* seek with OplogTsIndex if the query gives a lower bound on ts */
+        bool seekByTs( const BSONElement &tsElt ) {
+            BSONElement bound = tsElt;
+            if ( tsElt.type() == Object ) {
+                BSONObj o = tsElt.embeddedObject();
+                bound = o[ "$gte" ];
+                if ( bound.eoo() )
+                    bound = o[ "$gt" ];
+            }
+            if ( !( bound.type() == Date || bound.type() == Timestamp ) )
+                return false;
+            shared_ptr<OplogTsIndex> index = OplogTsIndex::find( _qp.ns() );
+            if ( index.get() == 0 )
+                return false;
+            shared_ptr<Cursor> first = _qp.newCursor();
+            if ( !first->ok() )
+                return false;
+            DiskLoc start = index->seek( _qp.nsd(), first->currLoc(), OpTime( bound.date() ) );
+            if ( start.isNull() )
+                return false;
+            createClientCursor( start );
+            _findingStartMode = InExtent;
+            return true;
+        }
         void init() {
-            // Use a ClientCursor here so we can release db mutex while scanning
-            // oplog (can take quite a while with large oplogs).
-            shared_ptr<Cursor> c = _qp.newReverseCursor();
-            _findingStartCursor = new ClientCursor(QueryOption_NoCursorTimeout, c, _qp.ns());
             _findingStartTimer.reset();
-            _findingStartMode = Initial;
             BSONElement tsElt = _qp.query()[ "ts" ];
             massert( 13044, "no ts field in query", !tsElt.eoo() );
             BSONObjBuilder b;
             b.append( tsElt );
             BSONObj tsQuery = b.obj();
             _matcher.reset(new CoveredIndexMatcher(tsQuery, _qp.indexKey()));
+            if ( seekByTs( tsElt ) )
+                return;
+            // Use a ClientCursor here so we can release db mutex while scanning
+            // oplog (can take quite a while with large oplogs).
+            shared_ptr<Cursor> c = _qp.newReverseCursor();
+            _findingStartCursor = new ClientCursor(QueryOption_NoCursorTimeout, c, _qp.ns());
+            _findingStartMode = Initial;
         }
     };
 
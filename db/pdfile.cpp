@@ -56,6 +56,9 @@ namespace mongo {
         }
     };
 
+    /* set while buildIdIndexDroppingDups() runs */
+    static bool droppingIdDups = false;
+
     const int MaxExtentSize = 0x7ff00000;
 
     map<string, unsigned> BackgroundOperation::dbsInProg;
@@ -236,6 +239,9 @@ namespace mongo {
         if ( mx > 0 )
             d->max = mx;
 
+        if ( j["usePowerOf2Sizes"].trueValue() )
+            d->setUsePowerOf2Sizes( true );
+
         return true;
     }
 
@@ -649,6 +655,29 @@ namespace mongo {
         log() << "  end freelist" << endl;
     }
 
+    /* put the chain of extents firstExt..lastExt on the database's free list, where allocFromFreeList() finds them */
+    static void addToFreeList(const DiskLoc& firstExt, const DiskLoc& lastExt) {
+        string s = cc().database()->name + ".$freelist";
+        NamespaceDetails *freeExtents = nsdetails(s.c_str());
+        if( freeExtents == 0 ) { 
+            string err;
+            _userCreateNS(s.c_str(), BSONObj(), err);
+            freeExtents = nsdetails(s.c_str());
+            massert( 10361 , "can't create .$freelist", freeExtents);
+        }
+        if( freeExtents->firstExtent.isNull() ) { 
+            freeExtents->firstExtent = firstExt;
+            freeExtents->lastExtent = lastExt;
+        }
+        else { 
+            DiskLoc a = freeExtents->firstExtent;
+            assert( a.ext()->xprev.isNull() );
+            a.ext()->xprev = lastExt;
+            lastExt.ext()->xnext = a;
+            freeExtents->firstExtent = firstExt;
+        }
+    }
+
     /* drop a collection/namespace */
     void dropNS(const string& nsToDrop) {
         NamespaceDetails* d = nsdetails(nsToDrop.c_str());
@@ -675,28 +704,9 @@ namespace mongo {
 
         // free extents
         if( !d->firstExtent.isNull() ) {
-            string s = cc().database()->name + ".$freelist";
-            NamespaceDetails *freeExtents = nsdetails(s.c_str());
-            if( freeExtents == 0 ) { 
-                string err;
-                _userCreateNS(s.c_str(), BSONObj(), err);
-                freeExtents = nsdetails(s.c_str());
-                massert( 10361 , "can't create .$freelist", freeExtents);
-            }
-            if( freeExtents->firstExtent.isNull() ) { 
-                freeExtents->firstExtent = d->firstExtent;
-                freeExtents->lastExtent = d->lastExtent;
-            }
-            else { 
-                DiskLoc a = freeExtents->firstExtent;
-                assert( a.ext()->xprev.isNull() );
-                a.ext()->xprev = d->lastExtent;
-                d->lastExtent.ext()->xnext = a;
-                freeExtents->firstExtent = d->firstExtent;
-
-                d->firstExtent.setInvalid();
-                d->lastExtent.setInvalid();
-            }
+            addToFreeList(d->firstExtent, d->lastExtent);
+            d->firstExtent.setInvalid();
+            d->lastExtent.setInvalid();
         }
 
         // remove from the catalog hashtable
@@ -728,10 +738,238 @@ namespace mongo {
     
     int nUnindexes = 0;
 
-    /* unindex all keys in index for this record. */
-    static void _unindexRecord(IndexDetails& id, BSONObj& obj, const DiskLoc& dl, bool logMissing = true) {
-        BSONObjSetDefaultOrder keys;
-        id.getKeysFromObject(obj, keys);
+    /* a background index is built bottom up from an external sort, so its btree does not exist until
+       the end of the build.  writes to the collection made meanwhile (while the build yields) are queued
+       here in order, and applied to the btree once it has been committed.  past MaxBufferedBytes of
+       keys the queue goes on in a file under _tmp.
+       keyed by the index being built.  caller must hold the write lock.
+    */
+    class BgIndexSideBuffer : boost::noncopyable {
+    public:
+        enum { MaxBufferedBytes = 64 * 1024 * 1024,
+               FinalRoundOps = 1000 // apply() finishes without yielding once no more than this are left
+        };
+
+        BgIndexSideBuffer(IndexDetails& idx) : _idx(idx), _bytes(0), _n(0), _spills(0) {
+            assert( _idx.head.isNull() );
+            assert( _buffers.count(&_idx) == 0 );
+            _buffers[&_idx] = this;
+        }
+        ~BgIndexSideBuffer() { 
+            detach();
+            if( !_spillFile.empty() ) {
+                _spill.close();
+                ::remove( _spillFile.c_str() );
+            }
+        }
+
+        /** @return the buffer taking writes for idx, or 0 if idx's btree is being written directly */
+        static BgIndexSideBuffer* get(IndexDetails& idx) { 
+            if( _buffers.empty() )
+                return 0;
+            map<IndexDetails*,BgIndexSideBuffer*>::iterator i = _buffers.find(&idx);
+            return i == _buffers.end() ? 0 : i->second;
+        }
+
+        void inserted(const BSONObj& key, const DiskLoc& loc) { add( Op(true, key, loc) ); }
+        void removed(const BSONObj& key, const DiskLoc& loc) { add( Op(false, key, loc) ); }
+        unsigned long long size() const { return _n; }
+
+        /** apply the queued writes to the now committed btree, in the order they were made.  yields
+            the lock now and then, writes made meanwhile being queued behind the rest; once few are
+            left they are applied without yielding and the buffer detaches.
+            @param dupsToDrop with dropDups, receives records whose insert was a duplicate key
+            @return locations that were removed (or moved) during the build
+        */
+        set<DiskLoc> apply(bool dropDups, set<DiskLoc>& dupsToDrop);
+
+    private:
+        void detach() { 
+            _buffers.erase(&_idx);
+        }
+
+        struct Op { 
+            Op() : insert(false) { }
+            Op(bool i, const BSONObj& k, const DiskLoc& l) : insert(i), key(k.getOwned()), loc(l) { }
+            bool insert;
+            BSONObj key;
+            DiskLoc loc;
+        };
+
+        void add(const Op& op) {
+            _n++;
+            if( !_spillFile.empty() ) {
+                write(op);
+                return;
+            }
+            _ops.push_back(op);
+            _bytes += op.key.objsize();
+            if( _bytes > MaxBufferedBytes ) {
+                startSpill();
+                for( unsigned k = 0; k < _ops.size(); k++ )
+                    write(_ops[k]);
+                _ops.clear();
+                _bytes = 0;
+            }
+        }
+
+        void startSpill() {
+            stringstream ss;
+            ss << dbpath;
+            if ( dbpath[dbpath.size()-1] != '/' )
+                ss << '/';
+            ss << "_tmp";
+            boost::filesystem::create_directories( ss.str() );
+            ss << "/bgindex." << time(0) << '.' << rand() << '.' << _spills++;
+            _spillFile = ss.str();
+            log(1) << "\t bg index side buffer spilling to " << _spillFile << endl;
+            _spill.open( _spillFile.c_str() , ios_base::out | ios_base::binary );
+            uassert( 13298 , "couldn't open bg index side buffer file: " + _spillFile , _spill.good() );
+        }
+
+        void write(const Op& op) {
+            _spill.put( op.insert ? 1 : 0 );
+            _spill.write( (const char *) &op.loc , sizeof(DiskLoc) );
+            _spill.write( op.key.objdata() , op.key.objsize() );
+            uassert( 13299 , "couldn't write bg index side buffer file: " + _spillFile , _spill.good() );
+        }
+
+        static bool read(ifstream& in, Op& op) {
+            char insert;
+            if( !in.get(insert) )
+                return false;
+            op.insert = insert != 0;
+            in.read( (char *) &op.loc , sizeof(DiskLoc) );
+            int size;
+            in.read( (char *) &size , 4 );
+            massert( 13300 , "bg index side buffer file truncated" , in.good() && size >= 5 );
+            char *buf = (char *) malloc( size );
+            memcpy( buf , &size , 4 );
+            in.read( buf + 4 , size - 4 );
+            op.key = BSONObj( buf , true );
+            massert( 13301 , "bg index side buffer file truncated" , in.good() );
+            return true;
+        }
+
+        IndexDetails& _idx;
+        vector<Op> _ops;
+        long long _bytes; // of the keys in _ops
+        unsigned long long _n; // ops queued, in _ops or the file
+        string _spillFile; // empty if not spilling
+        ofstream _spill;
+        unsigned _spills;
+        static map<IndexDetails*,BgIndexSideBuffer*> _buffers;
+    };
+    map<IndexDetails*,BgIndexSideBuffer*> BgIndexSideBuffer::_buffers;
+
+    set<DiskLoc> BgIndexSideBuffer::apply(bool dropDups, set<DiskLoc>& dupsToDrop) {
+        assertInWriteLock();
+        assert( !_idx.head.isNull() );
+
+        // the last removal for each location.  an insert before that belongs to a record that has since gone.
+        map<DiskLoc,unsigned long long> lastRemove;
+        // inserts that were duplicate keys, and where they came.  the record holding the key may be
+        // removed further on in the buffer, so they are tried again once everything else is in
+        vector< pair<Op,unsigned long long> > dupInserts;
+
+        bool dupsAllowed = !_idx.unique();
+        Ordering ordering = Ordering::make(_idx.keyPattern());
+        unsigned long long k = 0;
+        int rounds = 0;
+        while( 1 ) {
+            // if writes keep up with us, stop yielding after a few rounds rather than chase them
+            bool last = _n <= FinalRoundOps || ++rounds > 8;
+
+            // take what is queued.  what is written while we yield is queued afresh, behind it
+            vector<Op> ops;
+            ops.swap(_ops);
+            string file = _spillFile;
+            if( !file.empty() ) {
+                _spill.close();
+                _spillFile = "";
+            }
+            _bytes = 0;
+            _n = 0;
+
+            ifstream in;
+            if( !file.empty() )
+                in.open( file.c_str() , ios_base::in | ios_base::binary );
+            unsigned inMemory = 0;
+            Op fromFile;
+            while( 1 ) {
+                if( !last && k % 128 == 127 ) {
+                    dbtemprelease r;
+                }
+                RARELY killCurrentOp.checkForInterrupt();
+
+                Op *op;
+                if( in.is_open() && read(in, fromFile) )
+                    op = &fromFile;
+                else if( inMemory < ops.size() )
+                    op = &ops[inMemory++];
+                else
+                    break;
+
+                unsigned long long pos = k++;
+                if( !op->insert ) {
+                    lastRemove[op->loc] = pos;
+                    _idx.head.btree()->unindex(_idx.head, _idx, op->key, op->loc);
+                    continue;
+                }
+                try {
+                    _idx.head.btree()->bt_insert(_idx.head, op->loc, op->key, ordering, dupsAllowed, _idx);
+                }
+                catch( AssertionException& e ) { 
+                    if( e.code == 10287 ) {
+                        // the scan got to this record after it was written - already in the index
+                        continue;
+                    }
+                    if( dupsAllowed || e.interrupted() )
+                        throw;
+                    dupInserts.push_back( make_pair(*op, pos) );
+                }
+            }
+            if( !file.empty() ) {
+                in.close();
+                ::remove( file.c_str() );
+            }
+
+            if( last )
+                break;
+        }
+
+        // all removes are in now, so a duplicate left is a real one.  still in the final round, no yielding
+        for( unsigned i = 0; i < dupInserts.size(); i++ ) {
+            const Op& op = dupInserts[i].first;
+            map<DiskLoc,unsigned long long>::iterator r = lastRemove.find(op.loc);
+            if( r != lastRemove.end() && r->second > dupInserts[i].second )
+                continue; // the record has gone since
+            try {
+                _idx.head.btree()->bt_insert(_idx.head, op.loc, op.key, ordering, dupsAllowed, _idx);
+            }
+            catch( AssertionException& e ) { 
+                if( e.code == 10287 )
+                    continue;
+                if( e.interrupted() || !dropDups )
+                    throw;
+                dupsToDrop.insert(op.loc);
+            }
+        }
+        detach();
+
+        set<DiskLoc> gone;
+        for( map<DiskLoc,unsigned long long>::iterator i = lastRemove.begin(); i != lastRemove.end(); i++ )
+            gone.insert(i->first);
+        return gone;
+    }
+
+    /* unindex all keys in index for this record.  keys: the record's keys for id */
+    static void _unindexRecord(IndexDetails& id, BSONObj& obj, const DiskLoc& dl, bool logMissing, BSONObjSetDefaultOrder& keys) {
+        if( BgIndexSideBuffer *side = BgIndexSideBuffer::get(id) ) { 
+            for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ )
+                side->removed(*i, dl);
+            return;
+        }
         for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
             BSONObj j = *i;
             if ( otherTraceLevel >= 5 ) {
@@ -761,20 +999,19 @@ namespace mongo {
     /* unindex all keys in all indexes for this record. */
     static void unindexRecord(NamespaceDetails *d, Record *todelete, const DiskLoc& dl, bool noWarn = false) {
         BSONObj obj(todelete);
+        vector<BSONObjSetDefaultOrder> keys;
+        getKeysForAllIndexes(*d, obj, keys);
         int n = d->nIndexes;
         for ( int i = 0; i < n; i++ )
-            _unindexRecord(d->idx(i), obj, dl, !noWarn);
+            _unindexRecord(d->idx(i), obj, dl, !noWarn, keys[i]);
         if( d->backgroundIndexBuildInProgress ) {
             // always pass nowarn here, as this one may be missing for valid reasons as we are concurrently building it
-            _unindexRecord(d->idx(n), obj, dl, false); 
+            _unindexRecord(d->idx(n), obj, dl, false, keys[n]); 
         }
     }
 
-    /* deletes a record, just the pdfile portion -- no index cleanup, no cursor cleanup, etc. 
-       caller must check if capped
-    */
-    void DataFileMgr::_deleteRecord(NamespaceDetails *d, const char *ns, Record *todelete, const DiskLoc& dl)
-    {
+    /* remove a record from its extent's record list */
+    static void unlinkFromRecList(Record *todelete, const DiskLoc& dl) {
         /* remove ourself from the record next/prev chain */
         {
             if ( todelete->prevOfs != DiskLoc::NullOfs )
@@ -799,6 +1036,14 @@ namespace mongo {
                     e->lastRecord.setOfs(dl.a(), todelete->prevOfs);
             }
         }
+    }
+
+    /* deletes a record, just the pdfile portion -- no index cleanup, no cursor cleanup, etc. 
+       caller must check if capped
+    */
+    void DataFileMgr::_deleteRecord(NamespaceDetails *d, const char *ns, Record *todelete, const DiskLoc& dl)
+    {
+        unlinkFromRecList(todelete, dl);
 
         /* add to the free list */
         {
@@ -877,10 +1122,11 @@ namespace mongo {
         getIndexChanges(changes, *d, objNew, objOld, changedId);
         dupCheck(changes, *d, dl);
 
+        d->noteUpdateSize( objNew.objsize(), objOld.objsize() );
         if ( toupdate->netLength() < objNew.objsize() ) {
             // doesn't fit.  reallocate -----------------------------------------------------
             uassert( 10003 , "E10003 failing update: objects in a capped ns cannot grow", !(d && d->capped));
-            d->paddingTooSmall();
+            d->nUpdateMoves++;
             if ( cc().database()->profile )
                 ss << " moved ";
             deleteRecord(ns, toupdate, dl);
@@ -888,7 +1134,6 @@ namespace mongo {
         }
 
         nsdt->notifyOfWriteOp();
-        d->paddingFits();
 
         /* have any index keys changed? */
         {
@@ -896,6 +1141,13 @@ namespace mongo {
             int z = d->nIndexesBeingBuilt();
             for ( int x = 0; x < z; x++ ) {
                 IndexDetails& idx = d->idx(x);
+                if( BgIndexSideBuffer *side = BgIndexSideBuffer::get(idx) ) { 
+                    for ( unsigned i = 0; i < changes[x].removed.size(); i++ )
+                        side->removed(*changes[x].removed[i], dl);
+                    for ( unsigned i = 0; i < changes[x].added.size(); i++ )
+                        side->inserted(*changes[x].added[i], dl);
+                    continue;
+                }
                 for ( unsigned i = 0; i < changes[x].removed.size(); i++ ) {
                     try {
                         idx.head.btree()->unindex(idx.head, idx, *changes[x].removed[i], dl);
@@ -948,19 +1200,97 @@ namespace mongo {
         return sz;
     }
 
+    /* an insertBatch() in progress.  while it runs, keys for the non-unique indexes of its collection
+       are held here and added in key order at the end, rather than one btree descent per record 
+       in insert order.  capped collections aren't deferred, as their records can go away mid batch. */
+    class InsertBatch : boost::noncopyable {
+    public:
+        InsertBatch(const char *ns) : bytesLeft(0), _ns(ns), _d(0) { }
+        /* called once the collection exists */
+        void attach(NamespaceDetails *d) {
+            if ( _d || d == 0 || d->capped )
+                return;
+            _d = d;
+            _keys.resize(d->nIndexes);
+            for( int i = 0; i < d->nIndexes; i++ ) 
+                _defer.push_back( !d->idx(i).unique() );
+        }
+        bool isFor(const char *ns) const { return _ns == ns; }
+        bool defers(NamespaceDetails *d, int idxNo) const { 
+            return d == _d && idxNo < (int) _defer.size() && _defer[idxNo];
+        }
+        /* hold keys[i] of a record just inserted, for each deferred index i */
+        void deferKeys(NamespaceDetails *d, vector<BSONObjSetDefaultOrder>& keys, const DiskLoc& loc) {
+            for( unsigned i = 0; i < _keys.size(); i++ ) {
+                if ( !defers(d, i) )
+                    continue;
+                for ( BSONObjSetDefaultOrder::iterator k = keys[i].begin(); k != keys[i].end(); k++ )
+                    _keys[i].push_back( make_pair( *k, loc ) );
+            }
+        }
+        void addDeferredKeys();
+
+        long long bytesLeft; // record space the rest of the batch needs, before padding
+    private:
+        typedef pair< BSONObj, DiskLoc > KeyAndLoc;
+        class KeyOrder { 
+        public:
+            KeyOrder(const Ordering& o) : _o(o) { }
+            bool operator()(const KeyAndLoc& l, const KeyAndLoc& r) const {
+                int c = l.first.woCompare(r.first, _o, false);
+                return c < 0 || ( c == 0 && l.second < r.second );
+            }
+        private:
+            Ordering _o;
+        };
+        string _ns;
+        NamespaceDetails *_d;
+        vector<char> _defer;
+        vector< vector< KeyAndLoc > > _keys;
+    };
+    static InsertBatch *insertBatchInProgress = 0;
+
+    void InsertBatch::addDeferredKeys() {
+        for( unsigned i = 0; i < _keys.size(); i++ ) {
+            if ( _keys[i].empty() )
+                continue;
+            IndexDetails& idx = _d->idx(i);
+            Ordering ordering = Ordering::make(idx.keyPattern());
+            sort( _keys[i].begin(), _keys[i].end(), KeyOrder(ordering) );
+            for( vector< KeyAndLoc >::iterator k = _keys[i].begin(); k != _keys[i].end(); k++ ) {
+                try {
+                    idx.head.btree()->bt_insert(idx.head, k->second, k->first, ordering, /*dupsAllowed*/true, idx);
+                }
+                catch (AssertionException&) {
+                    problem() << " caught assertion addDeferredKeys " << idx.indexNamespace() << endl;
+                }
+            }
+            _keys[i].clear();
+        }
+    }
+
+    /* size of the extent to add when a batch insert runs out of room: enough for the rest of the 
+       batch if that is more than the usual growth, so its records stay together */
+    static int batchExtentSize(NamespaceDetails *d, int lenWHdr, long long bytesLeft) {
+        int sz = followupExtentSize(lenWHdr, d->lastExtentSize);
+        long long want = (long long) ( bytesLeft * d->paddingFactor ) + lenWHdr;
+        if ( want > sz ) 
+            sz = (int) ( min( want, (long long) MaxExtentSize ) & 0xffffff00 );
+        return sz;
+    }
+
     /* add keys to index idxNo for a new record */
-    static inline void  _indexRecord(NamespaceDetails *d, int idxNo, BSONObj& obj, DiskLoc recordLoc, bool dupsAllowed) {
+    static inline void  _indexRecord(NamespaceDetails *d, int idxNo, BSONObjSetDefaultOrder& keys, DiskLoc recordLoc, bool dupsAllowed) {
         IndexDetails& idx = d->idx(idxNo);
-        BSONObjSetDefaultOrder keys;
-        idx.getKeysFromObject(obj, keys);
+        BgIndexSideBuffer *side = idxNo == d->nIndexes ? BgIndexSideBuffer::get(idx) : 0;
         BSONObj order = idx.keyPattern();
         Ordering ordering = Ordering::make(order);
-        int n = 0;
         for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
-            if( ++n == 2 ) { 
-                d->setIndexIsMultikey(idxNo);
-            }
             assert( !recordLoc.isNull() );
+            if( side ) {
+                side->inserted(*i, recordLoc);
+                continue;
+            }
             try {
                 idx.head.btree()->bt_insert(idx.head, recordLoc,
                                             *i, ordering, dupsAllowed, idx);
@@ -1004,6 +1334,48 @@ namespace mongo {
         }
     }
 
+    /* feed the sorted keys to btBuilder.  with dropDups, records with a duplicate key are added to 
+       dupsToDrop instead of failing the build.
+    */
+    static void addKeysBottomUp(BSONObjExternalSorter& sorter, BtreeBuilder& btBuilder, bool dupsAllowed, bool dropDups, 
+                                ProgressMeterHolder& pm, list<DiskLoc>& dupsToDrop, bool yield = false) {
+        auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+        unsigned long long n = 0;
+        while( i->more() ) { 
+            if( yield && ++n % 1024 == 0 ) {
+                // for a background build.  nothing else can reach the buckets: the index isn't in
+                // nIndexes yet, and the bg operation keeps the collection from being dropped
+                dbtemprelease r;
+            }
+            RARELY killCurrentOp.checkForInterrupt();
+            BSONObjExternalSorter::Data d = i->next();
+
+            try { 
+                btBuilder.addKey(d.first, d.second);
+            }
+            catch( AssertionException& e ) { 
+                if ( dupsAllowed ){
+                    // unknow exception??
+                    throw;
+                }
+                    
+                if( e.interrupted() )
+                    throw;
+
+                if ( ! dropDups )
+                    throw;
+
+                /* we could queue these on disk, but normally there are very few dups, so instead we 
+                   keep in ram and have a limit.
+                */
+                dupsToDrop.push_back(d.second);
+                uassert( 10092 , "too may dups on index build with dropDups=true", dupsToDrop.size() < 1000000 );
+            }
+            pm.hit();
+        }
+        pm.finished();
+    }
+
     // throws DBException
     unsigned long long fastBuildIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
         assert( d->backgroundIndexBuildInProgress == 0 );
@@ -1014,7 +1386,7 @@ namespace mongo {
         tlog() << "Buildindex " << ns << " idxNo:" << idxNo << ' ' << idx.info.obj().toString() << endl;
 
         bool dupsAllowed = !idx.unique();
-        bool dropDups = idx.dropDups() || inDBRepair;
+        bool dropDups = idx.dropDups() || inDBRepair || ( droppingIdDups && idx.isIdIndex() );
         BSONObj order = idx.keyPattern();
 
         idx.head.Null();
@@ -1033,11 +1405,11 @@ namespace mongo {
             DiskLoc loc = c->currLoc();
 
             BSONObjSetDefaultOrder keys;
-            idx.getKeysFromObject(o, keys);
-            int k = 0;
+            bool multikey = false;
+            idx.getKeysFromObject(o, keys, &multikey);
+            if( multikey )
+                d->setIndexIsMultikey(idxNo);
             for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
-                if( ++k == 2 )
-                    d->setIndexIsMultikey(idxNo);
                 //cout<<"SORTER ADD " << i->toString() << ' ' << loc.toString() << endl;
                 sorter.add(*i, loc);
                 nkeys++;
@@ -1064,37 +1436,8 @@ namespace mongo {
         /* build index --- */ 
         {
             BtreeBuilder btBuilder(dupsAllowed, idx);
-            BSONObj keyLast;
-            auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
             assert( pm == op->setMessage( "index: (2/3) btree bottom up" , nkeys , 10 ) );
-            while( i->more() ) { 
-                RARELY killCurrentOp.checkForInterrupt();
-                BSONObjExternalSorter::Data d = i->next();
-
-                try { 
-                    btBuilder.addKey(d.first, d.second);
-                }
-                catch( AssertionException& e ) { 
-                    if ( dupsAllowed ){
-                        // unknow exception??
-                        throw;
-                    }
-                    
-                    if( e.interrupted() )
-                        throw;
-
-                    if ( ! dropDups )
-                        throw;
-
-                    /* we could queue these on disk, but normally there are very few dups, so instead we 
-                       keep in ram and have a limit.
-                    */
-                    dupsToDrop.push_back(d.second);
-                    uassert( 10092 , "too may dups on index build with dropDups=true", dupsToDrop.size() < 1000000 );
-                }
-                pm.hit();
-            }
-            pm.finished();
+            addKeysBottomUp(sorter, btBuilder, dupsAllowed, dropDups, pm, dupsToDrop);
             op->setMessage( "index: (3/3) btree-middle" );
             log(t.seconds() > 10 ? 0 : 1 ) << "\t done building bottom layer, going to commit" << endl;
             btBuilder.commit();
@@ -1111,11 +1454,11 @@ namespace mongo {
 
     class BackgroundIndexBuildJob : public BackgroundOperation { 
 
-        unsigned long long addExistingToIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
-            bool dupsAllowed = !idx.unique();
-            bool dropDups = idx.dropDups();
-
-            ProgressMeter& progress = cc().curop()->setMessage( "bg index build" , d->nrecords );
+        /* phase 1: scan the collection, yielding, and external sort the keys.  
+           the index has no btree yet; writes made while we yield go to the side buffer. */
+        unsigned long long sortExisting(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo, 
+                                        BSONObjExternalSorter& sorter, unsigned long long& nkeys) {
+            ProgressMeter& progress = cc().curop()->setMessage( "bg index build (1/3) external sort" , d->nrecords );
 
             unsigned long long n = 0;
             auto_ptr<ClientCursor> cc;
@@ -1123,37 +1466,22 @@ namespace mongo {
                 shared_ptr<Cursor> c = theDataFileMgr.findAll(ns);
                 cc.reset( new ClientCursor(QueryOption_NoCursorTimeout, c, ns) );
             }
-            CursorId id = cc->cursorid;
 
             while ( cc->c->ok() ) {
                 BSONObj js = cc->c->current();
-                try { 
-                    _indexRecord(d, idxNo, js, cc->c->currLoc(), dupsAllowed);
-                    cc->c->advance();
-                } catch( AssertionException& e ) { 
-                    if( e.interrupted() )
-                        throw;
+                DiskLoc loc = cc->c->currLoc();
 
-                    if ( dropDups ) {
-                        DiskLoc toDelete = cc->c->currLoc();
-                        bool ok = cc->c->advance();
-                        cc->updateLocation();
-                        theDataFileMgr.deleteRecord( ns, toDelete.rec(), toDelete, false, true );
-                        if( ClientCursor::find(id, false) == 0 ) {
-                            cc.release();
-                            if( !ok ) { 
-                                /* we were already at the end. normal. */
-                            }
-                            else {
-                                uasserted(12585, "cursor gone during bg index; dropDups");
-                            }
-                            break;
-                        }
-                    } else {
-                        log() << "background addExistingToIndex exception " << e.what() << endl;
-                        throw;
-                    }
+                BSONObjSetDefaultOrder keys;
+                bool multikey = false;
+                idx.getKeysFromObject(js, keys, &multikey);
+                if( multikey )
+                    d->setIndexIsMultikey(idxNo);
+                for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
+                    sorter.add(*i, loc);
+                    nkeys++;
                 }
+                cc->c->advance();
+
                 n++;
                 progress.hit();
 
@@ -1167,6 +1495,44 @@ namespace mongo {
             return n;
         }
 
+        /* phases 2 and 3: build the btree bottom up, then apply what was written to the collection
+           meanwhile.  the final sort is done without the lock, and the other two yield it now and then;
+           writes made while it's released go to the side buffer. */
+        void buildFromSorted(const char *ns, NamespaceDetails *d, IndexDetails& idx, 
+                             BSONObjExternalSorter& sorter, unsigned long long nkeys, BgIndexSideBuffer& side) {
+            bool dupsAllowed = !idx.unique();
+            bool dropDups = idx.dropDups();
+            CurOp * op = cc().curop();
+
+            {
+                dbtemprelease r;
+                sorter.sort();
+            }
+
+            list<DiskLoc> sortedDups;
+            {
+                BtreeBuilder btBuilder(dupsAllowed, idx);
+                ProgressMeterHolder pm( op->setMessage( "bg index build (2/3) btree bottom up" , nkeys , 10 ) );
+                addKeysBottomUp(sorter, btBuilder, dupsAllowed, dropDups, pm, sortedDups, true);
+                btBuilder.commit();
+            }
+
+            op->setMessage( "bg index build (3/3) applying writes made during the build" );
+            log(1) << "\t bg index applying " << side.size() << " buffered writes" << endl;
+            set<DiskLoc> dupsToDrop;
+            set<DiskLoc> gone = side.apply(dropDups, dupsToDrop);
+
+            // a dup found in the sort may have been deleted since and its slot reused; the side buffer covered those
+            for( list<DiskLoc>::iterator i = sortedDups.begin(); i != sortedDups.end(); i++ ) {
+                if( gone.count(*i) == 0 )
+                    dupsToDrop.insert(*i);
+            }
+
+            log(1) << "\t bg index dupsToDrop:" << dupsToDrop.size() << endl;
+            for( set<DiskLoc>::iterator i = dupsToDrop.begin(); i != dupsToDrop.end(); i++ )
+                theDataFileMgr.deleteRecord( ns, i->rec(), *i, false, true );
+        }
+
         /* we do set a flag in the namespace for quick checking, but this is our authoritative info - 
            that way on a crash/restart, we don't think we are still building one. */
         set<NamespaceDetails*> bgJobsInProgress;
@@ -1193,9 +1559,14 @@ namespace mongo {
 
             prep(ns.c_str(), d);
             assert( idxNo == d->nIndexes );
+            idx.head.Null();
             try { 
-                idx.head = BtreeBucket::addBucket(idx);
-                n = addExistingToIndex(ns.c_str(), d, idx, idxNo);
+                BgIndexSideBuffer side(idx);
+                BSONObjExternalSorter sorter(idx.keyPattern());
+                sorter.hintNumObjects( d->nrecords );
+                unsigned long long nkeys = 0;
+                n = sortExisting(ns.c_str(), d, idx, idxNo, sorter, nkeys);
+                buildFromSorted(ns.c_str(), d, idx, sorter, nkeys, side);
             }
             catch(...) { 
                 if( cc().database() && nsdetails(ns.c_str()) == d ) {
@@ -1238,10 +1609,20 @@ namespace mongo {
     /* add keys to indexes for a new record */
     static void indexRecord(NamespaceDetails *d, BSONObj obj, DiskLoc loc) {
         int n = d->nIndexesBeingBuilt();
+        vector<BSONObjSetDefaultOrder> keys;
+        unsigned long long multikey = 0;
+        getKeysForAllIndexes(*d, obj, keys, &multikey);
+        InsertBatch *batch = insertBatchInProgress;
         for ( int i = 0; i < n; i++ ) {
             try { 
+                if( multikey & ( ( (unsigned long long) 1 ) << i ) )
+                    d->setIndexIsMultikey(i);
+                if( batch && batch->defers(d, i) ) { 
+                    // added with the rest of the batch's keys once the record is in, see InsertBatch
+                    continue;
+                }
                 bool unique = d->idx(i).unique();
-                _indexRecord(d, i, obj, loc, /*dupsAllowed*/!unique);
+                _indexRecord(d, i, keys[i], loc, /*dupsAllowed*/!unique);
             }
             catch( DBException& ) { 
                 /* try to roll back previously added index entries
@@ -1250,7 +1631,7 @@ namespace mongo {
                 */
                 for( int j = 0; j <= i; j++ ) { 
                     try {
-                        _unindexRecord(d->idx(j), obj, loc, false);
+                        _unindexRecord(d->idx(j), obj, loc, false, keys[j]);
                     }
                     catch(...) { 
                         log(3) << "unindex fails on rollback after unique failure\n";
@@ -1259,6 +1640,8 @@ namespace mongo {
                 throw;
             }
         }
+        if( batch )
+            batch->deferKeys(d, keys, loc);
     }
 
     extern BSONObj id_obj; // { _id : 1 }
@@ -1290,6 +1673,23 @@ namespace mongo {
         theDataFileMgr.insert(system_indexes.c_str(), o.objdata(), o.objsize(), true);
     }
 
+    /* for a collection filled with its _id index dropped (see Cloner::go).  a scan that isn't a
+       snapshot can return a document that moved twice; as in repair, only one of them is kept.
+       replaying the oplog from before the copy is what brings its contents up to date.
+    */
+    void buildIdIndexDroppingDups(const char *ns) {
+        assert( !droppingIdDups );
+        droppingIdDups = true;
+        try {
+            ensureHaveIdIndex(ns);
+        }
+        catch( ... ) {
+            droppingIdDups = false;
+            throw;
+        }
+        droppingIdDups = false;
+    }
+
 #pragma pack(1)
     struct IDToInsert_ { 
         char type;
@@ -1323,6 +1723,36 @@ namespace mongo {
         insert( ns, o.objdata(), o.objsize(), god );
     }
 
+    void DataFileMgr::insertBatch(const char *ns, vector<BSONObj> &objs, int &nInserted) {
+        nInserted = 0;
+        InsertBatch batch(ns);
+        for( vector<BSONObj>::const_iterator i = objs.begin(); i != objs.end(); i++ )
+            batch.bytesLeft += i->objsize() + Record::HeaderSize;
+        // system collections (index creation in particular) go one at a time
+        bool deferring = strstr(ns, ".system.") == 0;
+        if ( deferring ) {
+            batch.attach( nsdetails(ns) );
+            insertBatchInProgress = &batch;
+        }
+        try {
+            for( ; nInserted < (int) objs.size(); nInserted++ ) {
+                BSONObj &o = objs[nInserted];
+                int len = o.objsize();
+                insertWithObjMod(ns, o);
+                batch.bytesLeft -= len + Record::HeaderSize;
+                if ( deferring )
+                    batch.attach( nsdetails(ns) ); // in case the first insert created the collection
+            }
+        }
+        catch( ... ) { 
+            insertBatchInProgress = 0;
+            batch.addDeferredKeys();
+            throw;
+        }
+        insertBatchInProgress = 0;
+        batch.addDeferredKeys();
+    }
+
     bool prepareToBuildIndex(const BSONObj& io, bool god, string& sourceNS, NamespaceDetails *&sourceCollection);
 
     // We are now doing two btree scans for all unique indexes (one here, and one when we've
@@ -1344,6 +1774,22 @@ namespace mongo {
         }        
     }
     
+    /* append a newly allocated record to its extent's record list */
+    static void addToRecList(Record *r, const DiskLoc& loc) {
+        Extent *e = r->myExtent(loc);
+        if ( e->lastRecord.isNull() ) {
+            e->firstRecord = e->lastRecord = loc;
+            r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
+        }
+        else {
+            Record *oldlast = e->lastRecord.rec();
+            r->prevOfs = e->lastRecord.getOfs();
+            r->nextOfs = DiskLoc::NullOfs;
+            oldlast->nextOfs = loc.getOfs();
+            e->lastRecord = loc;
+        }
+    }
+
     /* note: if god==true, you may pass in obuf of NULL and then populate the returned DiskLoc 
              after the call -- that will prevent a double buffer copy in some cases (btree.cpp).
     */
@@ -1383,7 +1829,6 @@ namespace mongo {
             if ( !god )
                 ensureIdIndexForNewNs(ns);
         }
-        d->paddingFits();
 
         NamespaceDetails *tableToIndex = 0;
 
@@ -1418,8 +1863,7 @@ namespace mongo {
         }
 
         DiskLoc extentLoc;
-        int lenWHdr = len + Record::HeaderSize;
-        lenWHdr = (int) (lenWHdr * d->paddingFactor);
+        int lenWHdr = d->allocationSize( len + Record::HeaderSize );
         if ( lenWHdr == 0 ) {
             // old datafiles, backward compatible here.
             assert( d->paddingFactor == 0 );
@@ -1438,7 +1882,10 @@ namespace mongo {
             // out of space
             if ( d->capped == 0 ) { // size capped doesn't grow
                 log(1) << "allocating new extent for " << ns << " padding:" << d->paddingFactor << " lenWHdr: " << lenWHdr << endl;
-                cc().database()->allocExtent(ns, followupExtentSize(lenWHdr, d->lastExtentSize), false);
+                int extentSize = insertBatchInProgress && insertBatchInProgress->isFor(ns) ? 
+                    batchExtentSize(d, lenWHdr, insertBatchInProgress->bytesLeft) : 
+                    followupExtentSize(lenWHdr, d->lastExtentSize);
+                cc().database()->allocExtent(ns, extentSize, false);
                 loc = d->alloc(ns, lenWHdr, extentLoc);
                 if ( loc.isNull() ){
                     log() << "WARNING: alloc() failed after allocating new extent. lenWHdr: " << lenWHdr << " last extent size:" << d->lastExtentSize << "; trying again\n";
@@ -1470,19 +1917,7 @@ namespace mongo {
             if( obuf )
                 memcpy(r->data, obuf, len);
         }
-        Extent *e = r->myExtent(loc);
-        if ( e->lastRecord.isNull() ) {
-            e->firstRecord = e->lastRecord = loc;
-            r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
-        }
-        else {
-
-            Record *oldlast = e->lastRecord.rec();
-            r->prevOfs = e->lastRecord.getOfs();
-            r->nextOfs = DiskLoc::NullOfs;
-            oldlast->nextOfs = loc.getOfs();
-            e->lastRecord = loc;
-        }
+        addToRecList(r, loc);
 
         d->nrecords++;
         d->datasize += r->netLength();
@@ -1500,6 +1935,7 @@ namespace mongo {
             int idxNo = tableToIndex->nIndexes;
             IndexDetails& idx = tableToIndex->addIndex(tabletoidxns.c_str(), !background); // clear transient info caches so they refresh; increments nIndexes
             idx.info = loc;
+            tableToIndex->setIndexIsMultikeyExact(idxNo);
             try {
                 buildAnIndex(tabletoidxns, tableToIndex, idx, idxNo, background);
             } catch( DBException& e ) {
@@ -1561,7 +1997,7 @@ namespace mongo {
     /* special version of insert for transaction logging -- streamlined a bit.
        assumes ns is capped and no indexes
     */
-    Record* DataFileMgr::fast_oplog_insert(NamespaceDetails *d, const char *ns, int len) {
+    Record* DataFileMgr::fast_oplog_insert(NamespaceDetails *d, const char *ns, int len, DiskLoc *recordLoc) {
         RARELY assert( d == nsdetails(ns) );
 
         DiskLoc extentLoc;
@@ -1590,6 +2026,8 @@ namespace mongo {
 
         d->nrecords++;
 
+        if ( recordLoc )
+            *recordLoc = loc;
         return r;
     }
 
@@ -1599,6 +2037,203 @@ namespace mongo {
 
 namespace mongo {
 
+    /* -- compact -- */
+
+    /* take the free space inside extents being emptied off the deleted lists, so that
+       records moved by compact (or inserted while it yields) land in other extents. 
+       what is taken off is added to removed. */
+    static void removeDeletedRecsIn(NamespaceDetails *d, const set<DiskLoc>& extents, vector<DiskLoc>& removed) {
+        d->checkDeletedCounted();
+        for ( int b = 0; b < Buckets; b++ ) {
+            DiskLoc *prev = &d->deletedList[b];
+            while ( !prev->isNull() ) {
+                DeletedRecord *r = prev->drec();
+                if ( extents.count( DiskLoc( prev->a(), r->extentOfs ) ) ) {
+                    d->deletedSize -= r->lengthWithHeaders;
+                    d->deletedCount--;
+                    removed.push_back( *prev );
+                    *prev = r->nextDeleted;
+                }
+                else
+                    prev = &r->nextDeleted;
+            }
+        }
+    }
+
+    /* if compact stops part way (killOp, an assertion), puts the free space it took out of use
+       back on the deleted lists: the deleted records and the slots of moved records that are in 
+       extents still pending, i.e. not freed. */
+    class CompactFreeSpaceRestorer : boost::noncopyable {
+    public:
+        CompactFreeSpaceRestorer(const char *ns, NamespaceDetails *d, const set<DiskLoc>& pending) : 
+            _ns(ns), _d(d), _pending(pending), _done(false) { }
+        ~CompactFreeSpaceRestorer() {
+            if ( _done || nsdetails(_ns.c_str()) != _d )
+                return;
+            int n = 0;
+            for ( vector<DiskLoc>::iterator i = taken.begin(); i != taken.end(); i++ ) {
+                DeletedRecord *r = i->drec();
+                if ( _pending.count( DiskLoc( i->a(), r->extentOfs ) ) ) {
+                    _d->addDeletedRec(r, *i);
+                    n++;
+                }
+            }
+            log() << "compact " << _ns << " stopped, " << n << " free records put back" << endl;
+        }
+        void done() { _done = true; }
+        vector<DiskLoc> taken; // free space off the deleted lists
+    private:
+        string _ns;
+        NamespaceDetails *_d;
+        const set<DiskLoc>& _pending;
+        bool _done;
+    };
+
+    /* move the record at dl out of its extent.  its index keys are rewritten to the new
+       location and cursors on it advanced, as for a delete.
+       @param remaining estimate of the bytes left to move, used to size new extents
+       @return bytes allocated for the moved record
+    */
+    static int compactMoveRecord(const char *ns, NamespaceDetails *d, const DiskLoc& dl, long long remaining) {
+        Record *old = dl.rec();
+        BSONObj o(old);
+        int lenWHdr = d->allocationSize( o.objsize() + Record::HeaderSize );
+        if ( lenWHdr == 0 ) // old datafiles, see insert()
+            lenWHdr = o.objsize() + Record::HeaderSize;
+
+        DiskLoc extentLoc;
+        DiskLoc loc = d->alloc(ns, lenWHdr, extentLoc);
+        if ( loc.isNull() ) {
+            // size new extents to what is left to move rather than growing them geometrically
+            long long sz = remaining + remaining / 16;
+            if ( sz < initialExtentSize(lenWHdr) )
+                sz = initialExtentSize(lenWHdr);
+            if ( sz > MaxExtentSize )
+                sz = MaxExtentSize;
+            cc().database()->allocExtent(ns, ((int)sz) & 0xffffff00, false);
+            loc = d->alloc(ns, lenWHdr, extentLoc);
+            massert( 13295 , "compact: can't allocate space for a record", !loc.isNull() );
+        }
+
+        Record *r = loc.rec();
+        memcpy(r->data, old->data, o.objsize());
+        addToRecList(r, loc);
+        d->nrecords++;
+        d->datasize += r->netLength();
+
+        ClientCursor::aboutToDelete(dl);
+        unindexRecord(d, old, dl);
+        indexRecord(d, BSONObj(r), loc);
+
+        // the old slot is not put on the deleted lists, its extent is about to be freed (see
+        // CompactFreeSpaceRestorer if it isn't)
+        unlinkFromRecList(old, dl);
+        d->nrecords--;
+        d->datasize -= old->netLength();
+        return lenWHdr;
+    }
+
+    /* unlink an emptied extent from the collection and free it.
+       @return false if it was the collection's only extent, which is kept
+    */
+    static bool freeEmptiedExtent(const char *ns, NamespaceDetails *d, const DiskLoc& L) {
+        Extent *e = L.ext();
+        assert( e->firstRecord.isNull() );
+        if ( d->firstExtent == L && d->lastExtent == L ) {
+            DiskLoc emptyLoc = e->reuse(ns);
+            d->addDeletedRec(emptyLoc.drec(), emptyLoc);
+            return false;
+        }
+        if ( e->xprev.isNull() )
+            d->firstExtent = e->xnext;
+        else
+            e->xprev.ext()->xnext = e->xnext;
+        if ( e->xnext.isNull() ) {
+            d->lastExtent = e->xprev;
+            d->lastExtentSize = e->xprev.ext()->length;
+        }
+        else
+            e->xnext.ext()->xprev = e->xprev;
+        e->xprev.Null();
+        e->xnext.Null();
+        addToFreeList(L, L);
+        return true;
+    }
+
+    bool compactCollection(const char *ns, string& errmsg, BSONObjBuilder& result) {
+        NamespaceDetails *d = nsdetails(ns);
+        if ( !d ) {
+            errmsg = "ns not found";
+            return false;
+        }
+        if ( d->capped ) {
+            errmsg = "cannot compact a capped collection";
+            return false;
+        }
+        BackgroundOperation::assertNoBgOpInProgForNs(ns);
+        // while we yield, drops, index builds and other compacts of ns are refused
+        BackgroundOperation bgop(ns);
+
+        vector<DiskLoc> extents;
+        long long sizeBefore = 0;
+        for ( DiskLoc L = d->firstExtent; !L.isNull(); L = L.ext()->xnext ) {
+            extents.push_back(L);
+            sizeBefore += L.ext()->length;
+        }
+        set<DiskLoc> pending( extents.begin(), extents.end() );
+        CompactFreeSpaceRestorer restorer(ns, d, pending);
+        removeDeletedRecsIn(d, pending, restorer.taken);
+
+        log() << "compact " << ns << " begin, " << extents.size() << " extents" << endl;
+        ProgressMeterHolder pm( cc().curop()->setMessage( "compact: moving records" , d->nrecords ) );
+        long long remaining = d->datasize + (long long) d->nrecords * Record::HeaderSize;
+        long long nMoved = 0;
+        int nFreed = 0;
+        for ( unsigned i = 0; i < extents.size(); i++ ) {
+            // records inserted into this extent while we yield are picked up by rechecking firstRecord
+            while ( !extents[i].ext()->firstRecord.isNull() ) {
+                DiskLoc dl = extents[i].ext()->firstRecord;
+                remaining -= compactMoveRecord(ns, d, dl, remaining);
+                restorer.taken.push_back(dl);
+                nMoved++;
+                pm.hit();
+                if ( nMoved % 128 == 0 ) {
+                    killCurrentOp.checkForInterrupt();
+                    {
+                        dbtempreleasecond unlock;
+                        if ( unlock.unlocked() )
+                            sleepmicros( Client::recommendedYieldMicros() );
+                    }
+                    uassert( 13296 , "collection dropped during compact" , nsdetails(ns) == d );
+                    // deletes made while we were unlocked may have freed space in the pending extents
+                    removeDeletedRecsIn(d, pending, restorer.taken);
+                }
+            }
+            pending.erase(extents[i]);
+            if ( freeEmptiedExtent(ns, d, extents[i]) )
+                nFreed++;
+        }
+        restorer.done();
+        pm.finished();
+
+        long long sizeAfter = 0;
+        int nExtents = 0;
+        for ( DiskLoc L = d->firstExtent; !L.isNull(); L = L.ext()->xnext ) {
+            sizeAfter += L.ext()->length;
+            nExtents++;
+        }
+        NamespaceDetailsTransient::get_w( ns ).notifyOfWriteOp();
+        log() << "compact " << ns << " done, moved " << nMoved << " records, freed " << nFreed << " extents" << endl;
+
+        result.append( "ns" , ns );
+        result.appendNumber( "moved" , nMoved );
+        result.append( "extentsFreed" , nFreed );
+        result.append( "nExtents" , nExtents );
+        result.appendNumber( "storageSizeBefore" , sizeBefore );
+        result.appendNumber( "storageSizeAfter" , sizeAfter );
+        return true;
+    }
+
     void dropDatabase(string db) {
         log(1) << "dropDatabase " << db << endl;
         assert( cc().database()->name == db );
@@ -48,6 +48,10 @@ namespace mongo {
     
     /* deletes this ns, indexes and cursors */
     void dropCollection( const string &name, string &errmsg, BSONObjBuilder &result ); 
+
+    /* moves a collection's records into new, densely packed extents and frees the old ones. 
+       yields as it goes.  caller must hold the write lock. */
+    bool compactCollection(const char *ns, string& errmsg, BSONObjBuilder& result);
     bool userCreateNS(const char *ns, BSONObj j, string& err, bool logForReplication);
     shared_ptr<Cursor> findTableScan(const char *ns, const BSONObj& order, const DiskLoc &startLoc=DiskLoc());
 
@@ -117,6 +121,14 @@ namespace mongo {
         void insertNoReturnVal(const char *ns, BSONObj o, bool god = false);
 
         DiskLoc insert(const char *ns, const void *buf, int len, bool god = false, const BSONElement &writeId = BSONElement(), bool mayAddIndex = true);
+
+        /** insert objs in order, each as insertWithObjMod() would -- objs[i] becomes the stored record.
+            keys for non-unique indexes are added in key order once the batch is in, and extents added
+            part way are sized for what remains of the batch.
+            @param nInserted out: how many went in.  set even when an insert fails and throws, the rest 
+                             of the batch is then not attempted.
+        */
+        void insertBatch(const char *ns, vector<BSONObj> &objs, int &nInserted);
         void deleteRecord(const char *ns, Record *todelete, const DiskLoc& dl, bool cappedOK = false, bool noWarn = false);
         static shared_ptr<Cursor> findAll(const char *ns, const DiskLoc &startLoc = DiskLoc());
 
@@ -124,7 +136,7 @@ namespace mongo {
            assumes ns is capped and no indexes
            no _id field check
         */
-        Record* fast_oplog_insert(NamespaceDetails *d, const char *ns, int len);
+        Record* fast_oplog_insert(NamespaceDetails *d, const char *ns, int len, DiskLoc *recordLoc = 0);
 
         static Extent* getExtent(const DiskLoc& dl);
         static Record* getRecord(const DiskLoc& dl);
@@ -184,6 +196,9 @@ namespace mongo {
         Extent* myExtent(const DiskLoc& myLoc) {
             return DataFileMgr::getExtent(DiskLoc(myLoc.a(), extentOfs));
         }
+        /* true if reading the record won't wait on the disk.  the page holding the header is checked
+           before the length is read from it, then the whole record. */
+        bool likelyInPhysicalMemory() const;
         /* get the next record in the namespace, traversing extents as necessary */
         DiskLoc getNext(const DiskLoc& myLoc);
         DiskLoc getPrev(const DiskLoc& myLoc);
@@ -381,6 +396,11 @@ namespace mongo {
         return e->xprev.ext()->lastRecord;
     }
 
+    inline bool Record::likelyInPhysicalMemory() const {
+        return MemoryMappedFile::resident(this, HeaderSize) && 
+               MemoryMappedFile::resident(this, lengthWithHeaders);
+    }
+
     inline Record* DiskLoc::rec() const {
         return DataFileMgr::getRecord(*this);
     }
@@ -483,6 +503,7 @@ namespace mongo {
     }
     
     void ensureHaveIdIndex(const char *ns);
+    void buildIdIndexDroppingDups(const char *ns);
     
     bool dropIndexes( NamespaceDetails *d, const char *ns, const char *name, string &errmsg, BSONObjBuilder &anObjBuilder, bool maydeleteIdIndex );
         
@@ -147,6 +147,7 @@ namespace mongo {
             
         unsigned long long nScanned = 0;
         bool justOne = justOneOrig;
+        DiskLoc faultYieldLoc; // so we yield at most once for a record not in memory
         do {
             if ( ++nScanned % 128 == 0 && !god && !creal->matcher()->docMatcher().atomic() ) {
                 if ( ! cc->yield() ){
@@ -154,6 +155,17 @@ namespace mongo {
                     break;
                 }
             }
+
+            if ( !god && cc->c->currLoc() != faultYieldLoc && !creal->matcher()->docMatcher().atomic() && 
+                 !cc->c->_current()->likelyInPhysicalMemory() ) {
+                faultYieldLoc = cc->c->currLoc();
+                if ( ! cc->yieldForPageFault( cc->c->_current() ) ){
+                    cc.release(); // has already been deleted elsewhere
+                    break;
+                }
+                if ( ! cc->c->ok() )
+                    break;
+            }
                 
             // this way we can avoid calling updateLocation() every time (expensive)
             // as well as some other nuances handled
@@ -262,6 +274,23 @@ namespace mongo {
         return qr;
     }
 
+    /* true if the index has every field the query looks at and returns, so results can be built 
+       from keys without touching the record */
+    static bool indexCovers( Cursor *c, CoveredIndexMatcher *matcher, FieldMatcher *fields ) {
+        return fields && matcher && !matcher->needRecord() && !c->isMultiKey() && 
+            fields->coveredBy( c->indexKeyPattern() );
+    }
+
+    /* the current document, or just what the index key has of it when the index covers the query */
+    static BSONObj currentObj( Cursor *c, bool covered ) {
+        if ( covered ) {
+            BSONObj o = objFromKey( c->indexKeyPattern(), c->currKey() );
+            if ( !o.isEmpty() )
+                return o;
+        }
+        return c->current();
+    }
+
     QueryResult* processGetMore(const char *ns, int ntoreturn, long long cursorid , CurOp& curop, int pass ) {
 
         ClientCursor::Pointer p(cursorid);
@@ -301,6 +330,8 @@ namespace mongo {
             Cursor *c = cc->c.get();
             c->checkLocation();
             DiskLoc last;
+            bool covered = indexCovers( c, c->matcher(), cc->fields.get() );
+            DiskLoc faultYieldLoc; // so we yield at most once for a record not in memory
 
             while ( 1 ) {
                 if ( !c->ok() ) {
@@ -325,6 +356,20 @@ namespace mongo {
                     cc = 0;
                     break;
                 }
+                if ( !covered && c->currentIsRecord() && c->currLoc() != faultYieldLoc && 
+                     !c->_current()->likelyInPhysicalMemory() ) {
+                    faultYieldLoc = c->currLoc();
+                    if ( ! cc->yieldForPageFault( c->_current() ) ) {
+                        // deleted by invalidate() while we were unlocked, so it isn't unpinned either
+                        p._c = 0;
+                        cursorid = 0;
+                        cc = 0;
+                        resultFlags = QueryResult::ResultFlag_CursorNotFound;
+                        break;
+                    }
+                    c->checkLocation();
+                    continue;
+                }
                 // in some cases (clone collection) there won't be a matcher
                 if ( c->matcher() && !c->matcher()->matches(c->currKey(), c->currLoc() ) ) {
                 }
@@ -334,11 +379,13 @@ namespace mongo {
                         //out() << "  but it's a dup \n";
                     }
                     else {
-                        last = c->currLoc();
-                        BSONObj js = c->current();
+                        DiskLoc cl = c->currLoc();
+                        if ( c->currentIsRecord() )
+                            last = cl;
+                        BSONObj js = currentObj( c, covered );
 
                         // show disk loc should be part of the main query, not in an $or clause, so this should be ok
-                        fillQueryResultFromObj(b, cc->fields.get(), js, ( cc->pq.get() && cc->pq->showDiskLoc() ? &last : 0));
+                        fillQueryResultFromObj(b, cc->fields.get(), js, ( cc->pq.get() && cc->pq->showDiskLoc() ? &cl : 0));
                         n++;
                         if ( (ntoreturn>0 && (n >= ntoreturn || b.len() > MaxBytesToReturnToClientAtOnce)) ||
                              (ntoreturn==0 && b.len()>1*1024*1024) ) {
@@ -506,7 +553,7 @@ namespace mongo {
             b << "cursor" << c->toString() << "indexBounds" << c->prettyIndexBounds();
             b.done();
         }
-        void noteScan( Cursor *c, long long nscanned, long long nscannedObjects, int n, bool scanAndOrder, int millis, bool hint ) {
+        void noteScan( Cursor *c, long long nscanned, long long nscannedObjects, int n, bool scanAndOrder, bool indexOnly, int millis, bool hint ) {
             if ( _i == 1 ) {
                 _c.reset( new BSONArrayBuilder() );
                 *_c << _b->obj();
@@ -523,6 +570,9 @@ namespace mongo {
             if ( scanAndOrder ) {
                 *_b << "scanAndOrder" << true;
             }
+            if ( indexOnly ) {
+                *_b << "indexOnly" << true;
+            }
             *_b << "millis" << millis;
             if ( !hint ) {
                 *_b << "allPlans" << _a->arr();
@@ -569,6 +619,7 @@ namespace mongo {
             _n(0),
             _oldN(0),
             _inMemSort(false),
+            _covered(false),
             _saveClientCursor(false),
             _oplogReplay( pq.hasOption( QueryOption_OplogReplay) ),
             _response( response ),
@@ -589,8 +640,18 @@ namespace mongo {
             }
             // FIXME get query right way
             _matcher.reset(new CoveredIndexMatcher( qp().query() , qp().indexKey()));
+            _covered = _c.get() && !_pq.returnKey() && indexCovers( _c.get(), _matcher.get(), _pq.getFields() );
 
             if ( qp().scanAndOrderRequired() ) {
+                if ( _covered ) {
+                    // the sort keys have to come from the index key too
+                    BSONObj keyPattern = _c->indexKeyPattern();
+                    BSONObjIterator i( _pq.getOrder() );
+                    while ( i.more() ) {
+                        if ( !keyPattern.getField( i.next().fieldName() ).isNumber() )
+                            _covered = false;
+                    }
+                }
                 _inMemSort = true;
                 _so.reset( new ScanAndOrder( _pq.getSkip() , _pq.getNumToReturn() , _pq.getOrder() ) );
             }
@@ -627,6 +688,13 @@ namespace mongo {
                 return;
             }
 
+            // an in memory sort fetches its records again at the end, so they mustn't go away
+            if ( mayYield() && !_covered && !_inMemSort && _c->currLoc() != _faultYieldLoc &&
+                 !_c->_current()->likelyInPhysicalMemory() ) {
+                yieldForPageFault();
+                return;
+            }
+
             _nscanned++;
             if ( !_matcher->matches(_c->currKey(), _c->currLoc() , &_details ) ) {
                 // not a match, continue onward
@@ -634,14 +702,16 @@ namespace mongo {
                     _nscannedObjects++;
             }
             else {
-                _nscannedObjects++;
+                if ( !_covered )
+                    _nscannedObjects++;
                 DiskLoc cl = _c->currLoc();
                 if( !_c->getsetdup(cl) ) { 
                     // got a match.
                     
                     if ( _inMemSort ) {
-                        // note: no cursors for non-indexed, ordered results.  results must be fairly small.
-                        _so->add( _pq.returnKey() ? _c->currKey() : _c->current(), _pq.showDiskLoc() ? &cl : 0 );
+                        // results are sorted in finish(); what doesn't fit in the reply gets a ScanAndOrderCursor
+                        bool fromRecord = !_pq.returnKey() && !_covered;
+                        _so->add( _pq.returnKey() ? _c->currKey() : currentObj( _c.get(), _covered ), cl, fromRecord );
                     }
                     else if ( _ntoskip > 0 ) {
                         _ntoskip--;
@@ -662,7 +732,7 @@ namespace mongo {
                                 bb.done();
                             }
                             else {
-                                BSONObj js = _c->current();
+                                BSONObj js = currentObj( _c.get(), _covered );
                                 assert( js.isValid() );
                                 fillQueryResultFromObj( _buf , _pq.getFields() , js , (_pq.showDiskLoc() ? &cl : 0));
                             }
@@ -698,7 +768,14 @@ namespace mongo {
                 _n = _inMemSort ? _so->size() : _n;
             } 
             else if ( _inMemSort ) {
-                _so->fill( _buf, _pq.getFields() , _n );
+                _so->fill( _buf, _pq.getFields() , _n , _pq.showDiskLoc() );
+                if ( _pq.wantMore() && _pq.getNumToReturn() != 1 && useCursors ) {
+                    shared_ptr<Cursor> rest = _so->rest();
+                    if ( rest ) {
+                        _c = rest;
+                        _saveClientCursor = true;
+                    }
+                }
             }
             
             if ( _pq.hasOption( QueryOption_CursorTailable ) && _pq.getNumToReturn() != 1 )
@@ -709,7 +786,7 @@ namespace mongo {
                 _saveClientCursor = true;
 
             if ( _pq.isExplain()) {
-                _eb.noteScan( _c.get(), _nscanned, _nscannedObjects, _n, scanAndOrderRequired(), _curop.elapsedMillis(), useHints && !_pq.getHint().eoo() );
+                _eb.noteScan( _c.get(), _nscanned, _nscannedObjects, _n, scanAndOrderRequired(), _covered, _curop.elapsedMillis(), useHints && !_pq.getHint().eoo() );
             } else {
                 _response.appendData( _buf.buf(), _buf.len() );
                 _buf.decouple();
@@ -721,6 +798,18 @@ namespace mongo {
             }
         }
         
+        /* let the current record be read in without holding the lock, see ClientCursor::yieldForPageFault().
+           the cursor may have moved on afterwards. */
+        void yieldForPageFault() {
+            _faultYieldLoc = _c->currLoc();
+            auto_ptr< ClientCursor > cc( new ClientCursor( QueryOption_NoCursorTimeout, _c, _pq.ns() ) );
+            if ( ! cc->yieldForPageFault( _c->_current() ) ) {
+                cc.release(); // has already been deleted elsewhere
+                uasserted( 13303, "collection or index dropped during query" );
+            }
+            _c->checkLocation();
+        }
+
         void finishExplain( const BSONObj &suffix ) {
             BSONObj obj = _eb.finishWithSuffix( nscanned(), nscannedObjects(), n(), _curop.elapsedMillis(), suffix);
             fillQueryResultFromObj(_buf, 0, obj);
@@ -767,9 +856,11 @@ namespace mongo {
         MatchDetails _details;
 
         bool _inMemSort;
+        bool _covered; // results come from index keys, see indexCovers()
         auto_ptr< ScanAndOrder > _so;
         
         shared_ptr<Cursor> _c;
+        DiskLoc _faultYieldLoc; // so we yield at most once for a record not in memory
 
         auto_ptr< CoveredIndexMatcher > _matcher;
 
@@ -839,7 +930,7 @@ namespace mongo {
         
         // regular query
 
-        mongolock lk(false); // read lock
+        mongolock lk(false, ns); // read lock
         Client::Context ctx( ns , dbpath , &lk );
 
         replVerifyReadsOk(pq);
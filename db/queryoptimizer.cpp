@@ -176,6 +176,24 @@ namespace mongo {
             unhelpful_ = true;
     }
     
+    QueryPlan::QueryPlan( 
+        NamespaceDetails *_d, const vector< int > &intersect,
+        const FieldRangeSet &fbs, const BSONObj &order ) :
+    d(_d), idxNo( -1 ),
+    fbs_( fbs ),
+    order_( order ),
+    index_( 0 ),
+    optimal_( false ),
+    scanAndOrderRequired_( !order.isEmpty() ),
+    exactKeyMatch_( false ),
+    direction_( 1 ),
+    endKeyInclusive_( true ),
+    unhelpful_( false ),
+    _type( 0 ),
+    _intersect( intersect ) {
+        assert( _intersect.size() > 1 );
+    }
+    
     shared_ptr<Cursor> QueryPlan::newCursor( const DiskLoc &startLoc , int numWanted ) const {
 
         if ( _type )
@@ -186,6 +204,18 @@ namespace mongo {
                 checkTableScanAllowed( fbs_.ns() );
             return shared_ptr<Cursor>( new BasicCursor( DiskLoc() ) );
         }
+        if ( intersection() ) {
+            massert( 13293, "newCursor() with start location not implemented for intersection plans", startLoc.isNull() );
+            vector< shared_ptr< BtreeCursor > > cursors;
+            for( vector< int >::const_iterator i = _intersect.begin(); i != _intersect.end(); ++i ) {
+                IndexDetails &id = d->idx( *i );
+                BoundList bounds = fbs_.indexBounds( id.keyPattern(), 1 );
+                massert( 13294, "intersection requires a single key per index",
+                        bounds.size() == 1 && bounds[ 0 ].first.woCompare( bounds[ 0 ].second, BSONObj(), false ) == 0 );
+                cursors.push_back( shared_ptr< BtreeCursor >( new BtreeCursor( d, *i, id, bounds[ 0 ].first, bounds[ 0 ].second, true, 1 ) ) );
+            }
+            return shared_ptr<Cursor>( new IntersectCursor( cursors ) );
+        }
         if ( !index_ ){
             if ( fbs_.nNontrivialRanges() )
                 checkTableScanAllowed( fbs_.ns() );
@@ -216,6 +246,14 @@ namespace mongo {
     }
     
     BSONObj QueryPlan::indexKey() const {
+        if ( intersection() ) {
+            BSONObjBuilder b;
+            BSONArrayBuilder a( b.subarrayStart( "$intersect" ) );
+            for( vector< int >::const_iterator i = _intersect.begin(); i != _intersect.end(); ++i )
+                a << d->idx( *i ).keyPattern();
+            a.done();
+            return b.obj();
+        }
         if ( !index_ )
             return BSON( "$natural" << 1 );
         return index_->keyPattern();
@@ -224,7 +262,14 @@ namespace mongo {
     void QueryPlan::registerSelf( long long nScanned ) const {
         if ( fbs_.matchPossible() ) {
             scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
-            NamespaceDetailsTransient::get_inlock( ns() ).registerIndexForPattern( fbs_.pattern( order_ ), indexKey(), nScanned );  
+            NamespaceDetailsTransient::get_inlock( ns() ).registerIndexForPattern( fbs_.pattern( order_ ), indexKey(), nScanned, d ? d->nrecords : 0 );  
+        }
+    }
+    
+    void QueryPlan::registerRun( long long nScanned ) const {
+        if ( fbs_.matchPossible() ) {
+            scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
+            NamespaceDetailsTransient::get_inlock( ns() ).registerRunForPattern( fbs_.pattern( order_ ), indexKey(), nScanned );
         }
     }
     
@@ -353,16 +398,40 @@ namespace mongo {
         if ( honorRecordedPlan_ ) {
             scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
             NamespaceDetailsTransient& nsd = NamespaceDetailsTransient::get_inlock( ns );
-            BSONObj bestIndex = nsd.indexForPattern( fbs_.pattern( order_ ) );
-            if ( !bestIndex.isEmpty() ) {
+            const CachedQueryPlan *cached = nsd.planForPattern( fbs_.pattern( order_ ), d->nrecords );
+            if ( cached ) {
+                BSONObj bestIndex = cached->indexKey;
                 usingPrerecordedPlan_ = true;
                 mayRecordPlan_ = false;
-                oldNScanned_ = nsd.nScannedForPattern( fbs_.pattern( order_ ) );
+                // the other plans are raced again if this does much worse than when it won.  not
+                // against its recent runs, or a plan getting slowly worse would never be raced
+                oldNScanned_ = cached->nScanned;
                 if ( !strcmp( bestIndex.firstElement().fieldName(), "$natural" ) ) {
                     // Table scan plan
                     plans_.push_back( PlanPtr( new QueryPlan( d, -1, fbs_, order_ ) ) );
                     return;
                 }
+                
+                if ( !strcmp( bestIndex.firstElement().fieldName(), "$intersect" ) ) {
+                    vector< int > intersect;
+                    BSONObjIterator k( bestIndex.firstElement().embeddedObject() );
+                    while( k.more() ) {
+                        BSONObj key = k.next().embeddedObject();
+                        int found = -1;
+                        NamespaceDetails::IndexIterator i = d->ii();
+                        while( i.more() ) {
+                            int j = i.pos();
+                            if ( i.next().keyPattern().woCompare( key ) == 0 ) {
+                                found = j;
+                                break;
+                            }
+                        }
+                        massert( 10368 ,  "Unable to locate previously recorded index", found >= 0 );
+                        intersect.push_back( found );
+                    }
+                    plans_.push_back( PlanPtr( new QueryPlan( d, intersect, fbs_, order_ ) ) );
+                    return;
+                }
 
                 NamespaceDetails::IndexIterator i = d->ii();
                 while( i.more() ) {
@@ -397,6 +466,7 @@ namespace mongo {
         bool normalQuery = hint_.isEmpty() && min_.isEmpty() && max_.isEmpty() && query_.getField( "$or" ).eoo();
 
         PlanSet plans;
+        vector< int > singleKey;
         for( int i = 0; i < d->nIndexes; ++i ) {
             IndexDetails& id = d->idx(i);
             const IndexSpec& spec = id.getSpec();
@@ -413,15 +483,46 @@ namespace mongo {
                 return;
             } else if ( !p->unhelpful() ) {
                 plans.push_back( p );
+                if ( p->singleKey() && !spec.getType() )
+                    singleKey.push_back( i );
             }
         }
         for( PlanSet::iterator i = plans.begin(); i != plans.end(); ++i )
             addPlan( *i, checkFirst );
 
+        if ( normalQuery && order_.isEmpty() ) {
+            PlanPtr p = intersectPlan( d, singleKey );
+            if ( p )
+                addPlan( p, checkFirst );
+        }
+
         // Table scan plan
         addPlan( PlanPtr( new QueryPlan( d, -1, fbs_, order_ ) ), checkFirst );
     }
     
+    // Plan intersecting the given single key indexes, or null if fewer than two are
+    // worth intersecting.  An index whose fields are all in another index adds nothing.
+    QueryPlanSet::PlanPtr QueryPlanSet::intersectPlan( NamespaceDetails *d, const vector< int > &singleKey ) const {
+        vector< set< string > > fields( singleKey.size() );
+        for( unsigned i = 0; i < singleKey.size(); ++i )
+            d->idx( singleKey[ i ] ).keyPattern().getFieldNames( fields[ i ] );
+        vector< int > intersect;
+        for( unsigned i = 0; i < singleKey.size(); ++i ) {
+            bool redundant = false;
+            for( unsigned j = 0; j < singleKey.size() && !redundant; ++j ) {
+                if ( j == i || !includes( fields[ j ].begin(), fields[ j ].end(), fields[ i ].begin(), fields[ i ].end() ) )
+                    continue;
+                // of two indexes on the same fields keep the first
+                redundant = fields[ i ].size() < fields[ j ].size() || j < i;
+            }
+            if ( !redundant )
+                intersect.push_back( singleKey[ i ] );
+        }
+        if ( intersect.size() < 2 )
+            return PlanPtr();
+        return PlanPtr( new QueryPlan( d, intersect, fbs_, order_ ) );
+    }
+    
     shared_ptr< QueryOp > QueryPlanSet::runOp( QueryOp &op ) {
         if ( usingPrerecordedPlan_ ) {
             Runner r( *this, op );
@@ -487,6 +588,7 @@ namespace mongo {
             if ( (*i)->complete() )
                 return *i;
         }
+        ops[ 0 ]->setMayYield( ops.size() == 1 );
         
         long long nScanned = 0;
         long long nScannedBackup = 0;
@@ -502,6 +604,8 @@ namespace mongo {
                         nScanned += nScannedBackup;
                     if ( plans_.mayRecordPlan_ && op.mayRecordPlan() )
                         op.qp().registerSelf( nScanned );
+                    else if ( plans_.usingPrerecordedPlan_ && op.mayRecordPlan() && !plans_._bestGuessOnly )
+                        op.qp().registerRun( nScanned );
                     return *i;
                 }
                 if ( op.error() )
@@ -512,6 +616,7 @@ namespace mongo {
                 break;
             if ( !plans_._bestGuessOnly && plans_.usingPrerecordedPlan_ && nScanned > plans_.oldNScanned_ * 10 && plans_._special.empty() ) {
                 plans_.addOtherPlans( true );
+                ops[ 0 ]->setMayYield( false );
                 PlanSet::iterator i = plans_.plans_.begin();
                 ++i;
                 for( ; i != plans_.plans_.end(); ++i ) {
@@ -565,7 +670,6 @@ namespace mongo {
     _i(),
     _honorRecordedPlan( honorRecordedPlan ),
     _bestGuessOnly() {
-//    _fros( ns, query ) {
         // eventually implement (some of?) these
         if ( !order.isEmpty() || ( hint && !hint->eoo() ) || !min.isEmpty() || !max.isEmpty() ) {
             _or = false;
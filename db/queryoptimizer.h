@@ -38,6 +38,13 @@ namespace mongo {
                   const BSONObj &endKey = BSONObj() ,
                   string special="" );
 
+        /* Plan intersecting the records of several indexes, each constrained to a single key.
+           See IntersectCursor. */
+        QueryPlan(NamespaceDetails *_d,
+                  const vector< int > &intersect,
+                  const FieldRangeSet &fbs,
+                  const BSONObj &order );
+
         /* If true, no other index can do better. */
         bool optimal() const { return optimal_; }
         /* ScanAndOrder processing will be required if true */
@@ -59,6 +66,14 @@ namespace mongo {
         BSONObj simplifiedQuery( const BSONObj& fields = BSONObj() ) const { return fbs_.simplifiedQuery( fields ); }
         const FieldRange &range( const char *fieldName ) const { return fbs_.range( fieldName ); }
         void registerSelf( long long nScanned ) const;
+        /* when this was the cached plan, and ran on its own */
+        void registerRun( long long nScanned ) const;
+        /* true if the index range is one key, so the plan can be part of an intersection */
+        bool singleKey() const {
+            return index_ && !_type && indexBounds_.size() == 1 &&
+                indexBounds_[ 0 ].first.woCompare( indexBounds_[ 0 ].second, BSONObj(), false ) == 0;
+        }
+        bool intersection() const { return !_intersect.empty(); }
         // just for testing
         BoundList indexBounds() const { return indexBounds_; }
     private:
@@ -76,6 +91,7 @@ namespace mongo {
         bool unhelpful_;
         string _special;
         IndexType * _type;
+        vector< int > _intersect;
     };
 
     // Inherit from this interface to implement a new query operation.
@@ -83,7 +99,7 @@ namespace mongo {
     // each clone its own query plan.
     class QueryOp {
     public:
-        QueryOp() : _complete(), _stopRequested(), _qp(), _error() {}
+        QueryOp() : _complete(), _stopRequested(), _qp(), _error(), _mayYield() {}
         virtual ~QueryOp() {}
         
         /** this gets called after a query plan is set? ERH 2/16/10 */
@@ -102,8 +118,12 @@ namespace mongo {
         bool stopRequested() const { return _stopRequested; }
         string exceptionMessage() const { return _exceptionMessage; }
         const QueryPlan &qp() const { return *_qp; }
+        /** true while this is the only op its QueryPlanSet is running, so next() may release the
+            lock: there are no other ops with cursors that wouldn't hear of deletes meanwhile */
+        bool mayYield() const { return _mayYield; }
         // To be called by QueryPlanSet::Runner only.
         void setQueryPlan( const QueryPlan *qp ) { _qp = qp; }
+        void setMayYield( bool mayYield ) { _mayYield = mayYield; }
         void setExceptionMessage( const string &exceptionMessage ) {
             _error = true;
             _exceptionMessage = exceptionMessage;
@@ -117,6 +137,7 @@ namespace mongo {
         string _exceptionMessage;
         const QueryPlan *_qp;
         bool _error;
+        bool _mayYield;
     };
     
     // Set of candidate query plans for a particular query.  Used for running
@@ -148,6 +169,7 @@ namespace mongo {
         const FieldRangeSet &fbs() const { return fbs_; }
     private:
         void addOtherPlans( bool checkFirst );
+        PlanPtr intersectPlan( NamespaceDetails *d, const vector< int > &singleKey ) const;
         void addPlan( PlanPtr plan, bool checkFirst ) {
             if ( checkFirst && plan->indexKey().woCompare( plans_[ 0 ]->indexKey() ) == 0 )
                 return;
@@ -269,7 +291,6 @@ namespace mongo {
         const char * _ns;
         bool _or;
         BSONObj _query;
-//        FieldRangeOrSet _fros;
         auto_ptr< QueryPlanSet > _currentQps;
         int _i;
         int _n;
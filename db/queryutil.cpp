@@ -443,27 +443,65 @@ namespace mongo {
     }
     
     const FieldRange &FieldRange::operator-=( const FieldRange &other ) {
-        // TODO implement
-        return *this;
-        
         vector< FieldInterval > newIntervals;
-        vector< FieldInterval >::const_iterator i = _intervals.begin();
         vector< FieldInterval >::const_iterator j = other._intervals.begin();
-        while( i != _intervals.end() && j != other._intervals.end() ) {
-            int cmp = i->_lower._bound.woCompare( j->_lower._bound, false );
-            if ( cmp < 0 ) {
-                int cmp2 = i->_upper._bound.woCompare( j->_lower._bound, false );
-                if ( cmp2 < 0 ) {
-                    
+        for( vector< FieldInterval >::const_iterator i = _intervals.begin(); i != _intervals.end(); ++i ) {
+            FieldInterval rest = *i;
+            bool remaining = true;
+            // intervals of other that end below rest can't affect later intervals either
+            while( j != other._intervals.end() && j->_upper._bound.woCompare( rest._lower._bound, false ) < 0 )
+                ++j;
+            for( vector< FieldInterval >::const_iterator k = j; k != other._intervals.end(); ++k ) {
+                FieldInterval overlap;
+                if ( !fieldIntervalOverlap( rest, *k, overlap ) ) {
+                    if ( k->_lower._bound.woCompare( rest._upper._bound, false ) >= 0 )
+                        break;
+                    continue;
+                }
+                // the part of rest below k survives
+                int cmp = rest._lower._bound.woCompare( k->_lower._bound, false );
+                if ( cmp < 0 || ( cmp == 0 && rest._lower._inclusive && !k->_lower._inclusive ) ) {
+                    FieldInterval below;
+                    below._lower = rest._lower;
+                    below._upper._bound = k->_lower._bound;
+                    below._upper._inclusive = !k->_lower._inclusive;
+                    newIntervals.push_back( below );
+                }
+                // continue with the part of rest above k, if any
+                int cmp2 = k->_upper._bound.woCompare( rest._upper._bound, false );
+                if ( cmp2 < 0 || ( cmp2 == 0 && rest._upper._inclusive && !k->_upper._inclusive ) ) {
+                    rest._lower._bound = k->_upper._bound;
+                    rest._lower._inclusive = !k->_upper._inclusive;
+                } else {
+                    remaining = false;
+                    break;
                 }
             }
-        }
-        while( i != _intervals.end() ) {
-            newIntervals.push_back( *i );
+            if ( remaining )
+                newIntervals.push_back( rest );
         }
         finishOperation( newIntervals, other );
         return *this;        
     }
+
+    bool FieldRange::operator<=( const FieldRange &other ) const {
+        vector< FieldInterval >::const_iterator j = other._intervals.begin();
+        for( vector< FieldInterval >::const_iterator i = _intervals.begin(); i != _intervals.end(); ++i ) {
+            // find the first interval of other that doesn't end below i
+            while( j != other._intervals.end() ) {
+                int cmp = j->_upper._bound.woCompare( i->_upper._bound, false );
+                if ( cmp > 0 || ( cmp == 0 && ( j->_upper._inclusive || !i->_upper._inclusive ) ) )
+                    break;
+                ++j;
+            }
+            if ( j == other._intervals.end() )
+                return false;
+            int cmp = j->_lower._bound.woCompare( i->_lower._bound, false );
+            if ( cmp > 0 || ( cmp == 0 && !j->_lower._inclusive && i->_lower._inclusive ) )
+                return false;
+        }
+        return true;
+    }
     
     BSONObj FieldRange::addObj( const BSONObj &o ) {
         _objData.push_back( o );
@@ -559,7 +597,8 @@ namespace mongo {
     
     FieldRangeSet::FieldRangeSet( const char *ns, const BSONObj &query , bool optimize )
         : _ns( ns ), _query( query.getOwned() ) {
-            BSONObjIterator i( query );
+            BSONObjIterator i( _query );
+            vector< BSONObj > nor;
             
             while( i.more() ) {
                 BSONElement e = i.next();
@@ -586,73 +625,122 @@ namespace mongo {
                 }
                 
                 if ( strcmp( e.fieldName(), "$nor" ) == 0 ) {
-                    continue; // TODO can elim some bounds
+                    massert( 13292, "$nor must be array", e.type() == Array );
+                    BSONObjIterator j( e.embeddedObject() );
+                    while( j.more() ) {
+                        BSONElement f = j.next();
+                        if ( f.type() == Object )
+                            nor.push_back( f.embeddedObject() );
+                    }
+                    continue;
                 }
                 
                 processQueryField( e, optimize );
-            }   
-        }
-
-//    FieldRangeOrSet::FieldRangeOrSet( const char *ns, const BSONObj &query , bool optimize )
-//        : _baseSet( ns, query, optimize ), _orFound() {
-//
-//        BSONObjIterator i( query );
-//        
-//        while( i.more() ) {
-//            BSONElement e = i.next();
-//            // e could be x:1 or x:{$gt:1}
-//
-//            if ( strcmp( e.fieldName(), "$where" ) == 0 )
-//                continue;
-//            
-//            if ( strcmp( e.fieldName(), "$or" ) == 0 ) {                                                                                                                                                        
-//                massert( 13262, "$or requires nonempty array", e.type() == Array && e.embeddedObject().nFields() > 0 );                                                                                         
-//                BSONObjIterator j( e.embeddedObject() );                                                                                                                                                        
-//                while( j.more() ) {                                                                                                                                                                             
-//                    BSONElement f = j.next();                                                                                                                                                                   
-//                    massert( 13263, "$or array must contain objects", f.type() == Object );                                                                                                                     
-//                    _orSets.push_back( FieldRangeSet( ns, f.embeddedObject(), optimize ) );
-//                }
-//                _orFound = true;
-//                continue;
-//            }
-//
-//            bool equality = ( getGtLtOp( e ) == BSONObj::Equality );
-//            if ( equality && e.type() == Object ) {
-//                equality = ( strcmp( e.embeddedObject().firstElement().fieldName(), "$not" ) != 0 );
-//            }
-//            
-//            if ( equality || ( e.type() == Object && !e.embeddedObject()[ "$regex" ].eoo() ) ) {
-//                _baseSet._ranges[ e.fieldName() ] &= FieldRange( e , false , optimize );
-//            }
-//            if ( !equality ) {
-//                BSONObjIterator j( e.embeddedObject() );
-//                while( j.more() ) {
-//                    BSONElement f = j.next();
-//                    if ( strcmp( f.fieldName(), "$not" ) == 0 ) {
-//                        switch( f.type() ) {
-//                            case Object: {
-//                                BSONObjIterator k( f.embeddedObject() );
-//                                while( k.more() ) {
-//                                    BSONElement g = k.next();
-//                                    uassert( 13264, "invalid use of $not", g.getGtLtOp() != BSONObj::Equality );
-//                                    _baseSet.processOpElement( e.fieldName(), g, true, optimize );
-//                                }
-//                                break;
-//                            }
-//                            case RegEx:
-//                                _baseSet.processOpElement( e.fieldName(), f, true, optimize );
-//                                break;
-//                            default:
-//                                uassert( 13265, "invalid use of $not", false );
-//                        }
-//                    } else {
-//                        _baseSet.processOpElement( e.fieldName(), f, false, optimize );
-//                    }
-//                }                
-//            }
-//        }
-//    }
+            }
+            
+            // documents matching a $nor clause can't match, so where a clause is
+            // described exactly by its ranges there is no need to scan them - this is
+            // how later $or clauses skip keys scanned by earlier ones
+            for( vector< BSONObj >::const_iterator j = nor.begin(); j != nor.end(); ++j ) {
+                if ( !exactRanges( *j ) )
+                    continue;
+                FieldRangeSet norSet( ns, *j, optimize );
+                if ( norSet.exactBounds() )
+                    *this -= norSet;
+            }
+        }
+
+    // true if the ranges generated for query describe exactly the documents it
+    // matches - only scalar equality, $in and range operators qualify
+    static bool exactValue( const BSONElement &e ) {
+        switch( e.type() ) {
+            case NumberDouble:
+            case NumberInt:
+            case NumberLong:
+            case String:
+            case jstOID:
+            case Bool:
+            case Date:
+                return true;
+            default:
+                return false;
+        }
+    }
+    
+    bool FieldRangeSet::exactRanges( const BSONObj &query ) {
+        if ( query.isEmpty() )
+            return false;
+        BSONObjIterator i( query );
+        while( i.more() ) {
+            BSONElement e = i.next();
+            if ( e.fieldName()[ 0 ] == '$' )
+                return false;
+            if ( getGtLtOp( e ) == BSONObj::Equality ) {
+                if ( !exactValue( e ) )
+                    return false;
+                continue;
+            }
+            BSONObjIterator j( e.embeddedObject() );
+            while( j.more() ) {
+                BSONElement f = j.next();
+                switch( f.getGtLtOp() ) {
+                    case BSONObj::LT:
+                    case BSONObj::LTE:
+                    case BSONObj::GT:
+                    case BSONObj::GTE:
+                        if ( !exactValue( f ) )
+                            return false;
+                        break;
+                    case BSONObj::opIN: {
+                        if ( f.type() != Array )
+                            return false;
+                        BSONObjIterator k( f.embeddedObject() );
+                        while( k.more() )
+                            if ( !exactValue( k.next() ) )
+                                return false;
+                        break;
+                    }
+                    default:
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool FieldRangeSet::exactBounds() const {
+        // an open ended range is bracketed by the MaxKey / MinKey of its type, and
+        // those brackets are only of the same type for numbers and dates
+        for( map< string, FieldRange >::const_iterator i = _ranges.begin(); i != _ranges.end(); ++i ) {
+            const vector< FieldInterval > &intervals = i->second.intervals();
+            for( vector< FieldInterval >::const_iterator j = intervals.begin(); j != intervals.end(); ++j ) {
+                if ( j->_lower._bound.canonicalType() != j->_upper._bound.canonicalType() ||
+                    !exactValue( j->_lower._bound ) || !exactValue( j->_upper._bound ) )
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    const FieldRangeSet &FieldRangeSet::operator-=( const FieldRangeSet &other ) {
+        int nUnincluded = 0;
+        string unincludedKey;
+        for( map< string, FieldRange >::const_iterator i = other._ranges.begin(); i != other._ranges.end(); ++i ) {
+            if ( !( range( i->first.c_str() ) <= i->second ) ) {
+                if ( ++nUnincluded > 1 )
+                    return *this;
+                unincludedKey = i->first;
+            }
+        }
+        if ( nUnincluded == 0 ) {
+            // every document we could match matches other, so nothing is left
+            if ( other._ranges.empty() )
+                return *this;
+            unincludedKey = other._ranges.begin()->first;
+        }
+        _ranges[ unincludedKey ] -= other.range( unincludedKey.c_str() );
+        return *this;
+    }
 
     FieldRange *FieldRangeSet::trivialRange_ = 0;
     FieldRange &FieldRangeSet::trivialRange() {
@@ -691,6 +779,17 @@ namespace mongo {
         return b.obj();
     }
     
+    BSONObj QueryPattern::toBSON() const {
+        static const char *typeNames[] = { "equality", "lowerBound", "upperBound", "upperAndLowerBound" };
+        BSONObjBuilder fields;
+        for( map< string, Type >::const_iterator i = _fieldTypes.begin(); i != _fieldTypes.end(); ++i )
+            fields.append( i->first.c_str(), typeNames[ i->second ] );
+        BSONObjBuilder b;
+        b.append( "fields", fields.obj() );
+        b.append( "sort", _sort );
+        return b.obj();
+    }
+
     QueryPattern FieldRangeSet::pattern( const BSONObj &sort ) const {
         QueryPattern qp;
         for( map< string, FieldRange >::const_iterator i = _ranges.begin(); i != _ranges.end(); ++i ) {
@@ -868,6 +967,21 @@ namespace mongo {
         return _source;
     }
 
+    bool FieldMatcher::coveredBy( const BSONObj& keyPattern ) const {
+        if ( _include || _special )
+            return false;
+        if ( _includeID && ! keyPattern.getField( "_id" ).isNumber() )
+            return false;
+        for ( FieldMap::const_iterator i = _fields.begin(); i != _fields.end(); ++i ){
+            const FieldMatcher& fm = *i->second;
+            if ( ! fm._include || fm._special || ! fm._fields.empty() ) // excluded, $slice or dotted
+                return false;
+            if ( ! keyPattern.getField( i->first.c_str() ).isNumber() ) // not in the index, or e.g. "2d"
+                return false;
+        }
+        return true;
+    }
+
     //b will be the value part of an array-typed BSONElement
     void FieldMatcher::appendArray( BSONObjBuilder& b , const BSONObj& a , bool nested) const {
         int skip  = nested ?  0 : _skip;
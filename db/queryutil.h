@@ -51,9 +51,10 @@ namespace mongo {
         FieldRange( const BSONElement &e = BSONObj().firstElement() , bool isNot=false , bool optimize=true );
         const FieldRange &operator&=( const FieldRange &other );
         const FieldRange &operator|=( const FieldRange &other );
-        // does not remove fully contained ranges (eg [1,3] - [2,2] doesn't remove anything)
-        // in future we can change so that an or on $in:[3] combined with $in:{$gt:2} doesn't scan 3 a second time
+        // removes every value in other from this range, eg [1,3] - [2,2] leaves [1,2) (2,3]
         const FieldRange &operator-=( const FieldRange &other );
+        // true if every value in this range is also in other
+        bool operator<=( const FieldRange &other ) const;
         BSONElement min() const { assert( !empty() ); return _intervals[ 0 ]._lower._bound; }
         BSONElement max() const { assert( !empty() ); return _intervals[ _intervals.size() - 1 ]._upper._bound; }
         bool minInclusive() const { assert( !empty() ); return _intervals[ 0 ]._lower._inclusive; }
@@ -125,6 +126,8 @@ namespace mongo {
                 return true;
             return _sort.woCompare( other._sort ) < 0;
         }
+        /** e.g. { fields : { a : "equality" , b : "lowerBound" } , sort : { c : 1 } } */
+        BSONObj toBSON() const;
     private:
         QueryPattern() {}
         void setSort( const BSONObj sort ) {
@@ -159,7 +162,6 @@ namespace mongo {
     // determine index limits
     class FieldRangeSet {
     public:
-        friend class FieldRangeOrSet;
         FieldRangeSet( const char *ns, const BSONObj &query , bool optimize=true );
         const FieldRange &range( const char *fieldName ) const {
             map< string, FieldRange >::const_iterator f = _ranges.find( fieldName );
@@ -186,17 +188,16 @@ namespace mongo {
         QueryPattern pattern( const BSONObj &sort = BSONObj() ) const;
         BoundList indexBounds( const BSONObj &keyPattern, int direction ) const;
         string getSpecial() const;
-        // intended to handle sets without _orSets
-        const FieldRangeSet &operator-=( const FieldRangeSet &other ) {
-            for( map< string, FieldRange >::const_iterator i = other._ranges.begin();
-                i != other._ranges.end(); ++i ) {
-                map< string, FieldRange >::iterator f = _ranges.find( i->first.c_str() );
-                if ( f != _ranges.end() )
-                    f->second -= i->second;
-            }
-            return *this;
-        }
+        // Removes from this set the values covered by other, where that can be done by
+        // narrowing a single field: if our ranges are contained in other's on all
+        // but one of other's fields, that field's range has other's range removed.
+        // Only valid if every document in other's ranges matches other's query.
+        const FieldRangeSet &operator-=( const FieldRangeSet &other );
         BSONObj query() const { return _query; }
+        // true if query only uses operators whose ranges match exactly the values it matches
+        static bool exactRanges( const BSONObj &query );
+        // true if every range is bounded by values of a single type, see exactRanges()
+        bool exactBounds() const;
     private:
         void processQueryField( const BSONElement &e, bool optimize );
         void processOpElement( const char *fieldName, const BSONElement &f, bool isNot, bool optimize );
@@ -207,42 +208,6 @@ namespace mongo {
         BSONObj _query;
     };
 
-    // generages FieldRangeSet objects, accounting for or clauses
-//    class FieldRangeOrSet {
-//    public:
-//        FieldRangeOrSet( const char *ns, const BSONObj &query , bool optimize=true );
-//        // if there's a trivial or clause, we won't use or ranges to help with scanning
-//        bool trivialOr() const {
-//            for( list< FieldRangeSet >::const_iterator i = _orSets.begin(); i != _orSets.end(); ++i ) {
-//                if ( i->nNontrivialRanges() == 0 ) {
-//                    return true;
-//                }
-//            }
-//            return false;
-//        }
-//        bool orFinished() const { return _orFound && _orSets.empty(); }
-//        // removes first or clause, and removes the field ranges it covers from all subsequent or clauses
-//        void popOrClause() {
-//            massert( 13274, "no or clause to pop", !orFinished() );
-//            const FieldRangeSet &toPop = _orSets.front();
-//            list< FieldRangeSet >::iterator i = _orSets.begin();
-//            ++i;
-//            while( i != _orSets.end() ) {
-//                *i -= toPop;
-//                if( !i->matchPossible() ) {
-//                    i = _orSets.erase( i );
-//                } else {
-//                    ++i;
-//                }
-//            }
-//            _orSets.pop_front();
-//        }
-//    private:
-//        FieldRangeSet _baseSet;
-//        list< FieldRangeSet > _orSets;
-//        bool _orFound;
-//    };
-    
     /**
        used for doing field limiting
      */
@@ -262,6 +227,10 @@ namespace mongo {
 
         BSONObj getSpec() const;
         bool includeID() { return _includeID; }
+
+        /** @return true if every field this returns is a top level field of the (btree) index
+            keyPattern, so results can be built from index keys alone */
+        bool coveredBy( const BSONObj& keyPattern ) const;
     private:
 
         void add( const string& field, bool include );
@@ -40,12 +40,14 @@
 #include "../client/dbclient.h"
 #include "../client/connpool.h"
 #include "pdfile.h"
+#include "btree.h"
 #include "query.h"
 #include "db.h"
 #include "commands.h"
 #include "security.h"
 #include "cmdline.h"
 #include "repl_block.h"
+#include "stats/counters.h"
 #include "repl/rs.h"
 
 namespace mongo {
@@ -90,6 +92,14 @@ namespace mongo {
 
     /* output by the web console */
     const char *replInfo = "";
+
+    /* most oplog entries a slave applies under one acquisition of the write lock */
+    const unsigned ReplApplyBatchMaxOps = 1000;
+
+    /* ntoreturn for the oplog query when replies are compressed: big enough that the master's
+       4MB reply limit is what ends a batch */
+    const int ReplCompressedBatchSize = 100000;
+
     struct ReplInfo {
         ReplInfo(const char *msg) {
             replInfo = msg;
@@ -519,13 +529,13 @@ namespace mongo {
 
     /* --------------------------------------------------------------*/
 
-    ReplSource::ReplSource() {
+    ReplSource::ReplSource() : compressed(false) {
         replacing = false;
         nClonedThisPass = 0;
         paired = false;
     }
 
-    ReplSource::ReplSource(BSONObj o) : nClonedThisPass(0) {
+    ReplSource::ReplSource(BSONObj o) : compressed(false), nClonedThisPass(0) {
         replacing = false;
         paired = false;
         only = o.getStringField("only");
@@ -1006,6 +1016,110 @@ namespace mongo {
         }
     }
 
+    /* most ops may be applied back to back under the batch's lock.  cloning a database
+       (resync) and some commands release the lock with dbtemprelease, which can't be done
+       while we hold it recursively -- those take the old path with a lock of their own.
+       a database that isn't open yet might need the initial clone, so it goes that way too.
+    */
+    bool ReplSource::needsOwnLock( const BSONObj& op ) const {
+        const char *ns = op.getStringField( "ns" );
+        if ( *ns == 0 || *ns == '.' || *op.getStringField( "op" ) == 'c' )
+            return true;
+        if ( replPair && replPair->state == ReplPair::State_Master )
+            return true; // updateSetsWithLocalOps() may unlock
+        char clientName[MaxDatabaseLen];
+        nsToDatabase( ns, clientName );
+        if ( incompleteCloneDbs.count( clientName ) )
+            return true;
+        Database *db = dbHolder.get( ns, dbpath );
+        return db == 0 || db->isEmpty();
+    }
+
+    /* the document an update or delete targets, found through the _id index */
+    static DiskLoc prefetchById( NamespaceDetails *d, const BSONObj& query ) {
+        BSONElement e = query["_id"];
+        if ( e.eoo() )
+            return DiskLoc();
+        int idxNo = d->findIdIndex();
+        if ( idxNo < 0 )
+            return DiskLoc();
+        IndexDetails& id = d->idx( idxNo );
+        return id.head.btree()->findSingle( id, id.head, e.wrap( "" ) );
+    }
+
+    /* walk each index down to where obj's keys live -- those are the buckets the apply
+       will insert into or remove from.  the _id index was walked already for updates
+       and deletes, it doesn't hurt to do it again.
+       note: keys are generated index by index, getKeysForAllIndexes() needs the write lock */
+    static void prefetchIndexKeys( NamespaceDetails *d, const BSONObj& obj ) {
+        for ( int i = 0; i < d->nIndexes; i++ ) {
+            IndexDetails& idx = d->idx( i );
+            BSONObjSetDefaultOrder keys;
+            idx.getKeysFromObject( obj, keys );
+            Ordering order = Ordering::make( idx.keyPattern() );
+            for ( BSONObjSetDefaultOrder::const_iterator k = keys.begin(); k != keys.end(); ++k ) {
+                int pos;
+                bool found;
+                idx.head.btree()->locate( idx, idx.head, *k, order, pos, found, minDiskLoc );
+            }
+        }
+    }
+
+    void ReplSource::prefetchBatch( const vector<BSONObj>& ops ) {
+        Timer t;
+        readlock lk( "" );
+        for ( unsigned i = 0; i < ops.size(); i++ ) {
+            const BSONObj& op = ops[ i ];
+            const char *opType = op.getStringField( "op" );
+            if ( !( *opType == 'i' || *opType == 'u' || *opType == 'd' ) )
+                continue;
+            const char *ns = op.getStringField( "ns" );
+            Database *db = dbHolder.get( ns, dbpath );
+            if ( db == 0 || !db->isOk() )
+                continue; // not open yet, the apply will clone or create it
+            try {
+                Client::Context ctx( ns, db, false );
+                NamespaceDetails *d = nsdetails( ns );
+                if ( d == 0 )
+                    continue;
+                BSONObj o = op.getObjectField( "o" );
+                if ( *opType == 'i' ) {
+                    prefetchIndexKeys( d, o );
+                    continue;
+                }
+                DiskLoc loc = prefetchById( d, *opType == 'u' ? op.getObjectField( "o2" ) : o );
+                if ( loc.isNull() )
+                    continue;
+                // keys of the existing document, which also reads all of it in
+                prefetchIndexKeys( d, loc.obj() );
+            }
+            catch ( DBException& e ) {
+                // only a hint -- the apply will run into the same problem and report it
+                log( 2 ) << "repl: prefetch failed " << e << " for op: " << op << endl;
+            }
+        }
+        globalReplApplyBatchCounters.prefetched( t.millis() );
+    }
+
+    void ReplSource::sync_pullOpLog_applyBatch( vector<BSONObj>& ops, OpTime *localLogTail ) {
+        if ( replSettings.prefetch )
+            prefetchBatch( ops );
+        Timer t;
+        unsigned i = 0;
+        while ( i < ops.size() ) {
+            {
+                dblock lk;
+                for ( ; i < ops.size() && !needsOwnLock( ops[ i ] ); i++ )
+                    sync_pullOpLog_applyOperation( ops[ i ], localLogTail );
+            }
+            if ( i < ops.size() ) {
+                globalReplApplyBatchCounters.ownLock();
+                sync_pullOpLog_applyOperation( ops[ i++ ], localLogTail );
+            }
+        }
+        globalReplApplyBatchCounters.applied( ops.size(), t.millis() );
+    }
+
     BSONObj ReplSource::idForOp( const BSONObj &op, bool &mod ) {
         mod = false;
         const char *opType = op.getStringField( "op" );
@@ -1192,9 +1306,11 @@ namespace mongo {
             // queryObj = { ts: { $gte: syncedTo } }
 
             log(2) << "repl: " << ns << ".find(" << queryObj.toString() << ')' << '\n';
+            // compressed, ask for batches of up to 4MB rather than 1MB -- a larger block compresses better
             cursor = conn->query( ns.c_str(), queryObj, 0, 0, 0, 
                                   QueryOption_CursorTailable | QueryOption_SlaveOk | QueryOption_OplogReplay |
-                                  QueryOption_AwaitData
+                                  QueryOption_AwaitData,
+                                  compressed ? ReplCompressedBatchSize : 0
                                   );
             c = cursor.get();
             tailing = false;
@@ -1358,31 +1474,54 @@ namespace mongo {
 					n = 0;
 				}
 
-                BSONObj op = c->next();
-                BSONElement ts = op.getField("ts");
-                if( !( ts.type() == Date || ts.type() == Timestamp ) ) { 
-                    log() << "sync error: problem querying remote oplog record\n";
-                    log() << "op: " << op.toString() << '\n';
-                    log() << "halting replication" << endl;
-                    replInfo = replAllDead = "sync error: no ts found querying remote oplog record";
-                    throw SyncException();
-                }
+                /* gather what the master already sent us -- we never wait on the network
+                   while holding the lock -- and apply it as one batch.  nextOpTime (and so
+                   syncedTo) only moves past ops once their whole batch has been applied.
+                */
+                vector<BSONObj> batch;
                 OpTime last = nextOpTime;
-                nextOpTime = OpTime( ts.date() );
-                if ( !( last < nextOpTime ) ) {
-                    log() << "sync error: last applied optime at slave >= nextOpTime from master" << endl;
-                    log() << " last:       " << last.toStringLong() << '\n';
-                    log() << " nextOpTime: " << nextOpTime.toStringLong() << '\n';
-                    log() << " halting replication" << endl;
-                    replInfo = replAllDead = "sync error last >= nextOpTime";
-                    uassert( 10123 , "replication error last applied optime at slave >= nextOpTime from master", false);
+                bool delayed = false;
+                while ( 1 ) {
+                    BSONObj op = c->next();
+                    BSONElement ts = op.getField("ts");
+                    if( !( ts.type() == Date || ts.type() == Timestamp ) ) { 
+                        log() << "sync error: problem querying remote oplog record\n";
+                        log() << "op: " << op.toString() << '\n';
+                        log() << "halting replication" << endl;
+                        replInfo = replAllDead = "sync error: no ts found querying remote oplog record";
+                        throw SyncException();
+                    }
+                    OpTime opTime( ts.date() );
+                    if ( !( last < opTime ) ) {
+                        log() << "sync error: last applied optime at slave >= nextOpTime from master" << endl;
+                        log() << " last:       " << last.toStringLong() << '\n';
+                        log() << " nextOpTime: " << opTime.toStringLong() << '\n';
+                        log() << " halting replication" << endl;
+                        replInfo = replAllDead = "sync error last >= nextOpTime";
+                        uassert( 10123 , "replication error last applied optime at slave >= nextOpTime from master", false);
+                    }
+                    if ( replSettings.slavedelay && ( unsigned( time( 0 ) ) < opTime.getSecs() + replSettings.slavedelay ) ) {
+                        c->putBack( op );
+                        _sleepAdviceTime = opTime.getSecs() + replSettings.slavedelay + 1;
+                        delayed = true;
+                        break;
+                    }
+                    batch.push_back( op ); // points into the cursor's batch, which outlives ours
+                    last = opTime;
+                    if ( batch.size() >= ReplApplyBatchMaxOps || !c->moreInCurrentBatch() )
+                        break;
                 }
-                if ( replSettings.slavedelay && ( unsigned( time( 0 ) ) < nextOpTime.getSecs() + replSettings.slavedelay ) ) {
-                    c->putBack( op );
-                    _sleepAdviceTime = nextOpTime.getSecs() + replSettings.slavedelay + 1;
+
+                if ( !batch.empty() ) {
+                    sync_pullOpLog_applyBatch( batch, &localLogTail );
+                    n += batch.size();
+                    nextOpTime = last;
+                }
+
+                if ( delayed ) {
                     dblock lk;
                     if ( n > 0 ) {
-                        syncedTo = last;
+                        syncedTo = nextOpTime;
                         save();
                     }
                     log() << "repl:   applied " << n << " operations" << endl;
@@ -1390,9 +1529,6 @@ namespace mongo {
                     log() << "waiting until: " << _sleepAdviceTime << " to continue" << endl;
                     break;
                 }
-
-                sync_pullOpLog_applyOperation(op, &localLogTail);
-                n++;
             }
         }
 
@@ -1459,6 +1595,18 @@ namespace mongo {
         return true;
     }
 
+    /* ask the master to compress its replies on conn.  an older one won't know how, which is fine.
+       conn takes compressed messages from before asking, as the answer may already be one */
+    bool replCompression(DBClientConnection *conn) {
+        BSONObj res;
+        conn->port()._acceptCompressed = true;
+        bool ok = conn->runCommand( "admin" , BSON( "setCompression" << "lz" ) , res );
+        conn->port()._acceptCompressed = ok;
+        log() << "repl: compressed replies " << ( ok ? "on" : "not supported by master" ) << endl;
+        log(1) << "repl: setCompression res: " << res << endl;
+        return ok;
+    }
+
     bool ReplSource::connect() {
         if ( conn.get() == 0 ) {
             conn = auto_ptr<DBClientConnection>(new DBClientConnection( false, 0, replPair ? 20 : 0 /* tcp timeout */));
@@ -1471,6 +1619,8 @@ namespace mongo {
                 log() << "repl:  " << errmsg << endl;
                 return false;
             }
+            if ( replSettings.compress )
+                compressed = replCompression(conn.get());
         }
         return true;
     }
@@ -63,8 +63,14 @@ namespace mongo {
         
         int slavedelay;
 
+        /* touch the pages a batch of ops will need before taking the write lock to apply it */
+        bool prefetch;
+
+        /* ask the master for compressed replies, and larger batches of the oplog */
+        bool compress;
+
         ReplSettings()
-            : slave(NotSlave) , master(false) , opIdMem(100000000) , fastsync() , autoresync(false), slavedelay() {
+            : slave(NotSlave) , master(false) , opIdMem(100000000) , fastsync() , autoresync(false), slavedelay() , prefetch(true) , compress(false) {
         }
 
     };
@@ -98,9 +104,19 @@ namespace mongo {
         int sync_pullOpLog(int& nApplied);
 
         void sync_pullOpLog_applyOperation(BSONObj& op, OpTime *localLogTail);
+
+        /* apply a batch of ops from the remote oplog, in order, under one write lock.
+           ops that may clone a database (or run a command) get their own lock. */
+        void sync_pullOpLog_applyBatch(vector<BSONObj>& ops, OpTime *localLogTail);
+        // true if op can't be applied while the batch holds the lock
+        bool needsOwnLock(const BSONObj& op) const;
+        /* read in the documents and index pages ops will touch, under a read lock only,
+           so page faults are taken before sync_pullOpLog_applyBatch() locks for writing */
+        void prefetchBatch(const vector<BSONObj>& ops);
         
         auto_ptr<DBClientConnection> conn;
         auto_ptr<DBClientCursor> cursor;
+        bool compressed; // the master agreed to compress replies on conn
 
         /* we only clone one database per pass, even if a lot need done.  This helps us
            avoid overflowing the master's transaction log by doing too much work before going
@@ -168,6 +184,7 @@ namespace mongo {
         void resetConnection() {
             cursor = auto_ptr<DBClientCursor>(0);
             conn = auto_ptr<DBClientConnection>(0);
+            compressed = false;
         }
 
         // make a jsobj from our member fields of the form
@@ -20,11 +20,15 @@
 
 #pragma once
 
+#include "keystring.h"
+#include "extsort.h"
+#include "cursor.h"
+#include "query.h"
+
 namespace mongo {
 
     /* todo:
        _ handle compound keys with differing directions.  we don't handle this yet: neither here nor in indexes i think!!!
-       _ limit amount of data
     */
 
     /* see also IndexDetails::getKeysFromObject, which needs some merging with this. */
@@ -45,8 +49,6 @@ namespace mongo {
     };
 
     /* todo:
-       _ respect limit
-       _ check for excess mem usage
        _ response size limit from runquery; push it up a bit.
     */
 
@@ -78,83 +80,239 @@ namespace mongo {
         }
     }
     
-    typedef multimap<BSONObj,BSONObj,BSONObjCmp> BestMap;
-    class ScanAndOrder {
-        BestMap best; // key -> full object
+    /* what an index key tells of its document, e.g. { user_id : 5 , ts : ... } from an index on
+       { user_id : 1 , ts : 1 }.  empty if a value is null, as the field may really be missing, and
+       then the record has to be used.
+    */
+    inline BSONObj objFromKey( const BSONObj& keyPattern , const BSONObj& key ) {
+        BSONObjBuilder b( 64 );
+        BSONObjIterator p( keyPattern );
+        BSONObjIterator k( key );
+        while ( p.more() && k.more() ) {
+            BSONElement e = k.next();
+            if ( e.isNull() || e.type() == Undefined )
+                return BSONObj();
+            b.appendAs( e , p.next().fieldName() );
+        }
+        return b.obj();
+    }
+
+    /* the sorted results of a ScanAndOrder that didn't fit in the first reply, for getMore.  they
+       come out of the external sorter with their documents: the lock is released between getMores
+       and the records may be gone, so currLoc() is only there for $diskLoc and is never read.
+    */
+    class ScanAndOrderCursor : public Cursor {
+    public:
+        typedef BSONObjExternalSorter::Data Data;
+
+        ScanAndOrderCursor( auto_ptr<BSONObjExternalSorter> sorter, auto_ptr<BSONObjExternalSorter::Iterator> i,
+                            int nKeyFields, int limit ) :
+            _sorter( sorter ), _i( i ), _nKeyFields( nKeyFields ), _left( limit ), _ok( false ) {
+            advance();
+        }
+
+        /* the document stored after the nKeyFields sort key fields */
+        static BSONObj docOf( const BSONObj& stored, int nKeyFields ) {
+            BSONObjIterator j( stored );
+            for ( int k = 0; k < nKeyFields; k++ )
+                j.next();
+            return j.next().embeddedObject();
+        }
+
+        virtual bool ok() { return _ok; }
+        virtual Record* _current() {
+            massert( 13304, "ScanAndOrderCursor has no record", false );
+            return 0;
+        }
+        virtual BSONObj current() { return _obj; }
+        virtual DiskLoc currLoc() { return _curr.second; }
+        virtual DiskLoc refLoc() { return DiskLoc(); }
+        virtual bool advance() {
+            _ok = _left > 0 && _i->more();
+            if ( _ok ) {
+                _curr = _i->next();
+                _obj = docOf( _curr.first, _nKeyFields );
+                _left--;
+            }
+            return _ok;
+        }
+        virtual bool currentIsRecord() const { return false; }
+        virtual bool supportGetMore() { return true; }
+        virtual bool getsetdup( DiskLoc loc ) { return false; }
+        virtual string toString() { return "ScanAndOrderCursor"; }
+        // everything here matched during the scan
+        virtual void setMatcher( auto_ptr< CoveredIndexMatcher > matcher ) { }
+
+    private:
+        auto_ptr<BSONObjExternalSorter> _sorter;
+        auto_ptr<BSONObjExternalSorter::Iterator> _i; // reads the sorter's files, so destroyed first
+        int _nKeyFields;
+        int _left;
+        bool _ok;
+        Data _curr;
+        BSONObj _obj;
+    };
+
+    /* keeps the best 'limit' matches, or all of them when there's no limit, in sort order.
+
+       each match is its sort key and DiskLoc; the document is fetched again for the ones returned.
+       objects that aren't the record (index keys for covered queries, $returnKey) are kept as is.
+       once the keys use more than InMemoryLimit they are all spilled to a BSONObjExternalSorter
+       with their documents, so large sorts without an index cost disk instead of failing.  what
+       doesn't fit in the first reply is returned by a ScanAndOrderCursor, see rest().
+
+       DiskLocs are used after the scan, so the caller must not yield in between.
+    */
+    class ScanAndOrder : boost::noncopyable {
+    public:
+        enum { InMemoryLimit = 1024 * 1024 };
+
+    private:
+        struct Entry {
+            SortKey key; // the sort pattern's field names are left out of its KeyString
+            DiskLoc loc;
+            BSONObj obj; // empty if it's the record at loc
+            unsigned n;  // order added, so that ties go to the earliest match as before
+        };
+
+        class EntryCmp {
+        public:
+            EntryCmp( const Ordering& o ) : _order( o ) {}
+            bool operator()( const Entry& l , const Entry& r ) const {
+                int c = l.key.woCompare( r.key , _order );
+                if ( c )
+                    return c < 0;
+                return l.n < r.n;
+            }
+        private:
+            Ordering _order;
+        };
+
+        vector<Entry> best; // a max heap -- worst on top -- once there are 'limit' of them
+        auto_ptr<BSONObjExternalSorter> _sorter;
         int startFrom;
         int limit;   // max to send back.
         KeyType order;
+        Ordering _ordering;
         unsigned approxSize;
+        unsigned nAdded;
+        auto_ptr<BSONObjExternalSorter::Iterator> _it; // after fill(), where the results that didn't fit begin
+        int _nLeft;  // how many of those may still be returned
 
-        void _add(BSONObj& k, BSONObj o, DiskLoc* loc) {
-            if (!loc){
-                best.insert(make_pair(k,o));
-            } else {
-                BSONObjBuilder b;
-                b.appendElements(o);
-                b.append("$diskLoc", loc->toBSONObj());
-                best.insert(make_pair(k, b.obj()));
-            }
+        /* everything from begin on goes to disk from now on.  documents are appended to their 
+           keys with no field name, as the sorter only keeps a key and a DiskLoc, and the results
+           may be read after the lock has been released.
+        */
+        void spill( vector<Entry>::iterator begin ) {
+            log(1) << "ScanAndOrder spilling " << best.end() - begin << " keys to disk" << endl;
+            _sorter.reset( new BSONObjExternalSorter( order.pattern , 16 * 1024 * 1024 ) );
+            _sorter->hintNumObjects( 100000 ); // runs are bounded by size, don't preallocate for a million keys
+            for ( vector<Entry>::iterator i = begin; i != best.end(); ++i )
+                _spill( *i );
+            best.clear();
         }
 
-        void _addIfBetter(BSONObj& k, BSONObj o, BestMap::iterator i, DiskLoc* loc) {
-            const BSONObj& worstBestKey = i->first;
-            int c = worstBestKey.woCompare(k, order.pattern);
-            if ( c > 0 ) {
-                // k is better, 'upgrade'
-                best.erase(i);
-                _add(k, o, loc);
-            }
+        void _spill( const Entry& e ) {
+            BSONObjBuilder b;
+            b.appendElements( e.key.obj() );
+            b.append( "" , e.obj.isEmpty() ? e.loc.obj() : e.obj );
+            _sorter->add( b.obj() , e.loc );
+        }
+
+        void _fillOne( BufBuilder& b, FieldMatcher *filter, BSONObj o, DiskLoc loc, bool showDiskLoc ) {
+            if ( o.isEmpty() )
+                o = loc.obj();
+            fillQueryResultFromObj(b, filter, o, showDiskLoc ? &loc : 0);
         }
 
     public:
         ScanAndOrder(int _startFrom, int _limit, BSONObj _order) :
-                best( BSONObjCmp( _order ) ),
-                startFrom(_startFrom), order(_order) {
+                startFrom(_startFrom), order(_order), _ordering( Ordering::make( _order ) ) {
             limit = _limit > 0 ? _limit + startFrom : 0x7fffffff;
             approxSize = 0;
+            nAdded = 0;
+            _nLeft = 0;
         }
 
         int size() const {
+            if ( _sorter.get() )
+                return min( nAdded , (unsigned) limit );
             return best.size();
         }
 
-        void add(BSONObj o, DiskLoc* loc) {
+        /** @param fromRecord o is the record at loc, so it can be fetched again rather than kept */
+        void add(BSONObj o, const DiskLoc& loc, bool fromRecord = true) {
             assert( o.isValid() );
-            BSONObj k = order.getKeyFromObject(o);
+            Entry e = { SortKey( order.getKeyFromObject(o), _ordering, true ), loc, 
+                        fromRecord ? BSONObj() : o.getOwned(), nAdded++ };
+
+            if ( _sorter.get() ) {
+                _spill( e );
+                return;
+            }
+
+            EntryCmp cmp( _ordering );
             if ( (int) best.size() < limit ) {
-                approxSize += k.objsize();
-                uassert( 10128 ,  "too much key data for sort() with no index.  add an index or specify a smaller limit", approxSize < 1 * 1024 * 1024 );
-                _add(k, o, loc);
+                approxSize += e.key.obj().objsize() + e.obj.objsize();
+                best.push_back( e );
+                if ( (int) best.size() == limit )
+                    make_heap( best.begin(), best.end(), cmp );
+                else if ( approxSize > InMemoryLimit )
+                    spill( best.begin() );
                 return;
             }
-            BestMap::iterator i;
-            assert( best.end() != best.begin() );
-            i = best.end();
-            i--;
-            _addIfBetter(k, o, i, loc);
+
+            // full: replace the worst if this is better
+            if ( cmp( e, best.front() ) ) {
+                pop_heap( best.begin(), best.end(), cmp );
+                best.back() = e;
+                push_heap( best.begin(), best.end(), cmp );
+            }
         }
 
-        void _fill(BufBuilder& b, FieldMatcher *filter, int& nout, BestMap::iterator begin, BestMap::iterator end) {
+        /* scanning complete. stick the query result in b for n objects, as many as fit in a reply.
+           the rest, if any, go to disk for rest() to return. */
+        void fill(BufBuilder& b, FieldMatcher *filter, int& nout, bool showDiskLoc = false) {
             int n = 0;
             int nFilled = 0;
-            for ( BestMap::iterator i = begin; i != end; i++ ) {
-                n++;
-                if ( n <= startFrom )
+            if ( !_sorter.get() ) {
+                sort( best.begin(), best.end(), EntryCmp( _ordering ) );
+                vector<Entry>::iterator i = best.begin();
+                for ( ; i != best.end() && b.len() <= MaxBytesToReturnToClientAtOnce; ++i ) {
+                    if ( ++n <= startFrom )
+                        continue;
+                    _fillOne( b, filter, i->obj, i->loc, showDiskLoc );
+                    nFilled++;
+                }
+                if ( i != best.end() ) {
+                    _nLeft = best.end() - i;
+                    spill( i );
+                    _sorter->sort();
+                    _it = _sorter->iterator();
+                }
+                nout = nFilled;
+                return;
+            }
+
+            _sorter->sort();
+            int nKeyFields = order.pattern.nFields();
+            _it = _sorter->iterator();
+            while ( _it->more() && n < limit && b.len() <= MaxBytesToReturnToClientAtOnce ) {
+                BSONObjExternalSorter::Data d = _it->next();
+                if ( ++n <= startFrom )
                     continue;
-                BSONObj& o = i->second;
-                fillQueryResultFromObj(b, filter, o);
+                _fillOne( b, filter, ScanAndOrderCursor::docOf( d.first, nKeyFields ), d.second, showDiskLoc );
                 nFilled++;
-                if ( nFilled >= limit )
-                    break;
-                uassert( 10129 ,  "too much data for sort() with no index", b.len() < 4000000 ); // appserver limit
             }
+            _nLeft = limit - n;
             nout = nFilled;
         }
 
-        /* scanning complete. stick the query result in b for n objects. */
-        void fill(BufBuilder& b, FieldMatcher *filter, int& nout) {
-            _fill(b, filter, nout, best.begin(), best.end());
+        /* after fill(): a cursor over the results that didn't fit in the reply, or null if they all did */
+        shared_ptr<Cursor> rest() {
+            if ( !_it.get() || _nLeft <= 0 || !_it->more() )
+                return shared_ptr<Cursor>();
+            return shared_ptr<Cursor>( new ScanAndOrderCursor( _sorter, _it, order.pattern.nFields(), _nLeft ) );
         }
 
     };
@@ -18,6 +18,7 @@
 
 #include "pch.h"
 #include "../jsobj.h"
+#include "../namespace.h"
 #include "counters.h"
 
 namespace mongo {
@@ -103,6 +104,59 @@ namespace mongo {
         }
     }
     
+    ReadAheadCounters::ReadAheadCounters(){
+        _memSupported = _pi.blockCheckSupported();
+        _sampling = 0;
+        _samplingrate = 100;
+        _advised = 0;
+        _bytes = 0;
+        _hits = 0;
+        _misses = 0;
+    }
+
+    void ReadAheadCounters::append( BSONObjBuilder& b ){
+        b.appendNumber( "advised" , _advised );
+        b.appendNumber( "bytes" , _bytes );
+        if ( ! _memSupported ){
+            b.append( "note" , "hits not supported on this platform" );
+            return;
+        }
+        b.appendNumber( "hits" , _hits );
+        b.appendNumber( "misses" , _misses );
+        long long n = _hits + _misses;
+        b.append( "hitRatio" , ( n ? ( _hits / (double) n ) : 0 ) );
+    }
+
+    ReplApplyBatchCounters::ReplApplyBatchCounters()
+        : _batches(0)
+        , _ops(0)
+        , _ownLock(0)
+        , _total_time(0)
+        , _prefetch_time(0)
+        , _largest(0)
+        , _last_ops(0)
+    {}
+
+    void ReplApplyBatchCounters::applied( int ops , int ms ){
+        _batches++;
+        _ops += ops;
+        _total_time += ms;
+        _last_ops = ops;
+        if ( ops > _largest )
+            _largest = ops;
+    }
+
+    void ReplApplyBatchCounters::append( BSONObjBuilder& b ){
+        b.appendNumber( "batches" , _batches );
+        b.appendNumber( "ops" , _ops );
+        b.appendNumber( "total_ms" , _total_time );
+        b.appendNumber( "prefetch_ms" , _prefetch_time );
+        b.appendNumber( "average_ops" , (_batches ? (_ops / double(_batches)) : 0.0) );
+        b.appendNumber( "largest_ops" , _largest );
+        b.appendNumber( "last_ops" , _last_ops );
+        b.appendNumber( "ownLock" , _ownLock );
+    }
+
     FlushCounters::FlushCounters()
         : _total_time(0)
         , _flushes(0)
@@ -125,6 +179,119 @@ namespace mongo {
     }
 
 
+    namespace {
+        inline void atomicAdd( volatile long long& x , long long n ){
+#if defined(_WIN32)
+            InterlockedExchangeAdd64( &x , n );
+#else
+            __sync_fetch_and_add( &x , n );
+#endif
+        }
+
+        inline void memoryBarrier(){
+#if defined(_WIN32)
+            MemoryBarrier();
+#else
+            __sync_synchronize();
+#endif
+        }
+    }
+
+    struct LockUsage {
+        struct Usage {
+            volatile long long acquireCount;
+            volatile long long timeAcquiringMicros;
+            volatile long long timeLockedMicros;
+
+            void add( unsigned long long timeAcquiringMicros , unsigned long long timeLockedMicros ){
+                atomicAdd( acquireCount , 1 );
+                atomicAdd( this->timeAcquiringMicros , timeAcquiringMicros );
+                atomicAdd( this->timeLockedMicros , timeLockedMicros );
+            }
+
+            void append( BSONObjBuilder& b , const char * name ) const {
+                BSONObjBuilder bb( b.subobjStart( name ) );
+                bb.appendNumber( "acquireCount" , (long long)acquireCount );
+                bb.appendNumber( "timeAcquiringMicros" , (long long)timeAcquiringMicros );
+                bb.appendNumber( "timeLockedMicros" , (long long)timeLockedMicros );
+                bb.done();
+            }
+        };
+
+        char db[MaxDatabaseLen];
+        volatile bool used; // db is set, and never changes again
+        Usage r;
+        Usage w;
+    };
+
+    static LockUsage* newLockUsageTable( unsigned n ){
+        LockUsage *t = new LockUsage[n];
+        memset( t , 0 , sizeof(LockUsage) * n );
+        strcpy( t[0].db , "." );
+        t[0].used = true;
+        return t;
+    }
+
+    LockUsage* LockCounters::dbs(){
+        static LockUsage *t = newLockUsageTable( MaxDbs );
+        return t;
+    }
+
+    mongo::mutex& LockCounters::slotMutex(){
+        static mongo::mutex *m = new mongo::mutex( "LockCounters" );
+        return *m;
+    }
+
+    LockUsage* LockCounters::get( const char *ns ){
+        LockUsage *table = dbs();
+        const char *p = strchr( ns , '.' );
+        size_t len = p ? p - ns : strlen( ns );
+        if ( len == 0 || len >= (size_t) MaxDatabaseLen )
+            return &table[0];
+
+        unsigned h = 0;
+        for ( size_t i = 0; i < len; i++ )
+            h = h * 31 + ns[i];
+
+        for ( unsigned n = 0; n < MaxDbs - 1; n++ ){
+            LockUsage& u = table[ 1 + ( h + n ) % ( MaxDbs - 1 ) ];
+            if ( !u.used ){
+                scoped_lock lk( slotMutex() );
+                if ( !u.used ){
+                    memcpy( u.db , ns , len );
+                    u.db[len] = 0;
+                    memoryBarrier(); // the name before anyone can see the slot used
+                    u.used = true;
+                    return &u;
+                }
+            }
+            if ( strncmp( u.db , ns , len ) == 0 && u.db[len] == 0 )
+                return &u;
+        }
+        return &table[0];
+    }
+
+    void LockCounters::append( BSONObjBuilder& b ){
+        LockUsage *table = dbs();
+        for ( unsigned i = 0; i < MaxDbs; i++ ){
+            const LockUsage& u = table[i];
+            if ( !u.used )
+                continue;
+            BSONObjBuilder bb( b.subobjStart( u.db ) );
+            u.r.append( bb , "r" );
+            u.w.append( bb , "w" );
+            bb.done();
+        }
+    }
+
+    LockUsage* lockUsageFor( const string& ns ){
+        return globalLockCounters.get( ns.c_str() );
+    }
+
+    void recordLockUsage( LockUsage *u , int type , unsigned long long timeAcquiringMicros , unsigned long long timeLockedMicros ){
+        ( type > 0 ? u->w : u->r ).add( timeAcquiringMicros , timeLockedMicros );
+    }
+
     void GenericCounter::hit( const string& name , int count ){
         scoped_lock lk( _mutex );
         _counts[name]++;
@@ -145,5 +312,8 @@ namespace mongo {
 
     OpCounters globalOpCounters;
     IndexCounters globalIndexCounters;
+    ReadAheadCounters globalReadAheadCounters;
+    ReplApplyBatchCounters globalReplApplyBatchCounters;
     FlushCounters globalFlushCounters;
+    LockCounters globalLockCounters;
 }
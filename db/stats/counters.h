@@ -103,6 +103,74 @@ namespace mongo {
 
     extern IndexCounters globalIndexCounters;
 
+    /**
+     * read ahead done for collection scans (see ReadAhead in cursor.h), and how often the
+     * records a scan then reached were already in memory -- sampled, like IndexCounters
+     * note: not thread safe.  ok with that for speed
+     */
+    class ReadAheadCounters {
+    public:
+        ReadAheadCounters();
+
+        void advised( long long bytes ){ _advised++; _bytes += bytes; }
+
+        /* a scan reached a record in a range it had advised */
+        void reached( char * record ){
+            if ( ! _memSupported )
+                return;
+            if ( _sampling++ % _samplingrate )
+                return;
+            if ( _pi.blockInMemory( record ) )
+                _hits++;
+            else
+                _misses++;
+        }
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        ProcessInfo _pi;
+        bool _memSupported;
+
+        int _sampling;
+        int _samplingrate;
+
+        long long _advised;
+        long long _bytes;
+        long long _hits;
+        long long _misses;
+    };
+
+    extern ReadAheadCounters globalReadAheadCounters;
+
+    /**
+     * batches of oplog entries applied by a slave, see ReplSource::sync_pullOpLog_applyBatch
+     * only the replication thread records, so no mutex
+     */
+    class ReplApplyBatchCounters {
+    public:
+        ReplApplyBatchCounters();
+
+        void applied( int ops , int ms );
+        /* an op in a batch had to be applied under its own lock */
+        void ownLock(){ _ownLock++; }
+        /* time spent in ReplSource::prefetchBatch, under a read lock */
+        void prefetched( int ms ){ _prefetch_time += ms; }
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        long long _batches;
+        long long _ops;
+        long long _ownLock;
+        long long _total_time;
+        long long _prefetch_time;
+        int _largest;
+        int _last_ops;
+    };
+
+    extern ReplApplyBatchCounters globalReplApplyBatchCounters;
+
     class FlushCounters {
     public:
         FlushCounters();
@@ -120,6 +188,38 @@ namespace mongo {
 
     extern FlushCounters globalFlushCounters;
 
+    struct LockUsage;
+
+    /**
+     * lock usage by database, fed by recordLockUsage() in concurrency.h
+     * all databases still share dbMutex, so timeAcquiring on one database is
+     * mostly time spent waiting for work on another
+     *
+     * this is on every lock release, so there is no map and no mutex there: each database
+     * gets a LockUsage slot the first time it is seen, found again by hashing its name, and the
+     * counters in it are added to atomically
+     *
+     * only instrumentation: the lock itself is still the one dbMutex
+     */
+    class LockCounters {
+    public:
+        enum { MaxDbs = 512 }; // past this many databases the rest are counted under "."
+
+        /* the slot for ns's database */
+        LockUsage* get( const char *ns );
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        /* [MaxDbs], open addressing; [0] is "." for acquisitions not tied to a database.  made on 
+           first use, as locks are taken by other static initializers and the order of those isn't 
+           defined */
+        static LockUsage* dbs();
+        static mongo::mutex& slotMutex(); // for taking a free slot
+    };
+
+    extern LockCounters globalLockCounters;
+
 
     class GenericCounter {
     public:
@@ -804,11 +804,27 @@ namespace mongo {
         shared_ptr< MultiCursor > c( new MultiCursor( ns, patternOrig, BSONObj(), opPtr ) );
         
         auto_ptr<ClientCursor> cc;
+        DiskLoc faultYieldLoc; // so we yield at most once for a record not in memory
             
         while ( c->ok() ) {
-            nscanned++;
-
             bool atomic = c->matcher()->docMatcher().atomic();
+
+            if ( ! atomic && c->currLoc() != faultYieldLoc && ! c->_current()->likelyInPhysicalMemory() ) {
+                faultYieldLoc = c->currLoc();
+                if ( cc.get() == 0 ) {
+                    shared_ptr< Cursor > cPtr = c;
+                    cc.reset( new ClientCursor( QueryOption_NoCursorTimeout , cPtr , ns ) );
+                }
+                if ( ! cc->yieldForPageFault( c->_current() ) ){
+                    cc.release();
+                    break;
+                }
+                d = nsdetails(ns);
+                nsdt = &NamespaceDetailsTransient::get_w(ns);
+                continue;
+            }
+
+            nscanned++;
                 
             // May have already matched in UpdateOp, but do again to get details set correctly
             if ( ! c->matcher()->matches( c->currKey(), c->currLoc(), &details ) ){
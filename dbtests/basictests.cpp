@@ -23,6 +23,7 @@
 #include "../util/base64.h"
 #include "../util/array.h"
 #include "../util/text.h"
+#include "../util/compress.h"
 
 namespace BasicTests {
 
@@ -113,6 +114,48 @@ namespace BasicTests {
         }
     };
 
+    class CompressTests {
+    public:
+        void roundTrip( const string& s , bool shrinks ){
+            int len = s.size();
+            vector<char> c( lz::maxCompressedLength( len ) );
+            int n = lz::compress( s.data() , len , &c[0] );
+            ASSERT( n <= lz::maxCompressedLength( len ) );
+            if ( shrinks )
+                ASSERT( n < len / 2 );
+            vector<char> out( len + 1 );
+            ASSERT( lz::uncompress( &c[0] , n , &out[0] , len ) );
+            ASSERT( string( &out[0] , len ) == s );
+            // wrong length, or cut short
+            ASSERT( !lz::uncompress( &c[0] , n , &out[0] , len + 1 ) );
+            if ( len > 0 )
+                ASSERT( !lz::uncompress( &c[0] , n , &out[0] , len - 1 ) );
+        }
+
+        void run(){
+            roundTrip( "" , false );
+            roundTrip( "e" , false );
+            roundTrip( "eliot" , false );
+            roundTrip( "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" , true );
+
+            // repeated field names, as in a batch of documents
+            BSONObjBuilder b;
+            for ( int i=0; i<1000; i++ )
+                b.append( BSON( "ts" << i << "op" << "i" << "ns" << "test.foo" << "o" << BSON( "_id" << i ) ).toString() , i );
+            BSONObj o = b.obj();
+            roundTrip( string( o.objdata() , o.objsize() ) , true );
+
+            // nothing to find -- longer literal runs than a token holds
+            string r;
+            unsigned x = 1;
+            for ( int i=0; i<100000; i++ ){
+                x = x * 1103515245 + 12345;
+                r += (char)( x >> 16 );
+            }
+            roundTrip( r , false );
+        }
+    };
+
     namespace stringbuildertests {
 #define SBTGB(x) ss << (x); sb << (x);
         
@@ -433,6 +476,7 @@ namespace BasicTests {
         void setupTests(){
             add< Rarely >();
             add< Base64Tests >();
+            add< CompressTests >();
             
             add< stringbuildertests::simple1 >();
             add< stringbuildertests::simple2 >();
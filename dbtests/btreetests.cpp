@@ -28,7 +28,8 @@ namespace BtreeTests {
 
     class Base {
     public:
-        Base() : 
+        /* compact: buckets in the CompactKeys format, as for a collection made with --compactKeys */
+        Base( bool compact = false ) : 
             _context( ns() ) {
             
             {
@@ -42,6 +43,7 @@ namespace BtreeTests {
             BSONObj bobj = builder.done();
             idx_.info =
                 theDataFileMgr.insert( ns(), bobj.objdata(), bobj.objsize() );
+            nsdetails( ns() )->indexFileVersion = compact ? 1 : 0;
             idx_.head = BtreeBucket::addBucket( idx_ );
         }
         ~Base() {
@@ -252,6 +254,65 @@ namespace BtreeTests {
         }        
     };
     
+    /* keys with empty field names, as real indexes have, are stored as KeyStrings */
+    class CompactKeys : public Base {
+    public:
+        CompactKeys() : Base( true ) { }
+        void run() {
+            int n = 2000;
+            for ( int i = 0; i < n; ++i ) {
+                BSONObj k = key( ( i * 7 ) % n );
+                insert( k );
+            }
+            checkValid( n );
+            for ( int i = 0; i < n; ++i )
+                ASSERT( found( key( i ) ) );
+            for ( int i = 0; i < n; i += 2 ) {
+                BSONObj k = key( i );
+                unindex( k );
+            }
+            checkValid( n / 2 );
+            for ( int i = 0; i < n; ++i )
+                ASSERT_EQUALS( i % 2 == 1, found( key( i ) ) );
+            // exists() compares the stored bytes, which keep types, as woEqual() would.
+            // findSingle() compares values, as woCompare() would
+            BSONObjBuilder b;
+            b.append( "", "user_00000001" );
+            b.append( "", 1.0 );
+            BSONObj asDouble = b.obj();
+            ASSERT( !found( asDouble ) );
+            ASSERT( bt()->findSingle( id(), dl(), asDouble ) == recordLoc() );
+            ASSERT( bt()->findSingle( id(), dl(), key( 2 ) ).isNull() );
+        }
+    private:
+        static BSONObj key( int i ) {
+            stringstream ss;
+            ss << "user_" << setw( 8 ) << setfill( '0' ) << i;
+            return BSON( "" << ss.str() << "" << i );
+        }
+        bool found( const BSONObj &k ) {
+            return bt()->exists( id(), dl(), k, Ordering::make( order() ) );
+        }
+    };
+
+    /* keys that can't be KeyStrings share buckets with ones that can */
+    class CompactKeysMixed : public Base {
+    public:
+        CompactKeysMixed() : Base( true ) { }
+        void run() {
+            for ( int i = 0; i < 300; ++i ) {
+                BSONObj k = i % 3 ? BSON( "" << i ) : BSON( "" << BSON( "x" << i ) );
+                insert( k );
+            }
+            checkValid( 300 );
+            BSONObj k = BSON( "" << BSON( "x" << 3 ) );
+            unindex( k );
+            k = BSON( "" << 4 );
+            unindex( k );
+            checkValid( 298 );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "btree" ){
@@ -265,6 +326,8 @@ namespace BtreeTests {
             add< MissingLocate >();
             add< MissingLocateMultiBucket >();
             add< SERVER983 >();
+            add< CompactKeys >();
+            add< CompactKeysMixed >();
         }
     } myall;
 }
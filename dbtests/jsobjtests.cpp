@@ -23,6 +23,7 @@
 #include "../db/json.h"
 #include "../db/repl.h"
 #include "../db/extsort.h"
+#include "../db/keystring.h"
 
 #include "dbtests.h"
 
@@ -1184,6 +1185,79 @@ namespace JsobjTests {
             }
         };
 
+        class Big3 {
+        public:
+            void run(){
+                const int total = 50000;
+                BSONObjExternalSorter sorter( BSON( "x" << -1 ) , 20000 );
+                for ( int i=0; i<total; i++ ){
+                    sorter.add( BSON( "x" << ( i * 7 ) % 1000 ) , 5  , i );
+                }
+
+                sorter.sort();
+                ASSERT( sorter.numFiles() > 10 );
+                
+                auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+                int num=0;
+                double prev = 1000;
+                DiskLoc prevLoc;
+                while ( i->more() ){
+                    pair<BSONObj,DiskLoc> p = i->next();
+                    num++;
+                    double cur = p.first["x"].number();
+                    ASSERT( cur <= prev );
+                    if ( cur == prev )
+                        ASSERT( prevLoc < p.second );
+                    prev = cur;
+                    prevLoc = p.second;
+                }
+                ASSERT_EQUALS( total , num );
+            }
+        };
+
+        /* index keys, which are sorted by KeyString where they can be */
+        class IndexKeys {
+        public:
+            void run(){
+                const int total = 20000;
+                BSONObj order = BSON( "a" << 1 << "b" << -1 );
+                BSONObjExternalSorter sorter( order , 100000 );
+                for ( int i=0; i<total; i++ ){
+                    BSONObjBuilder b;
+                    b.append( "" , i % 7 );
+                    if ( i % 10 == 0 )
+                        b.append( "" , BSON( "x" << i % 13 ) ); // can't be encoded
+                    else if ( i % 3 )
+                        b.append( "" , "s" + BSONObjBuilder::numStr( i % 11 ) );
+                    else
+                        b.append( "" , i % 11 );
+                    sorter.add( b.obj() , 5 , i );
+                }
+
+                sorter.sort();
+                ASSERT( sorter.numFiles() > 1 );
+
+                Ordering o = Ordering::make( order );
+                auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+                int num=0;
+                BSONObj prev;
+                DiskLoc prevLoc;
+                while ( i->more() ){
+                    pair<BSONObj,DiskLoc> p = i->next();
+                    num++;
+                    if ( num > 1 ){
+                        int x = prev.woCompare( p.first , o );
+                        ASSERT( x <= 0 );
+                        if ( x == 0 )
+                            ASSERT( prevLoc < p.second );
+                    }
+                    prev = p.first.getOwned();
+                    prevLoc = p.second;
+                }
+                ASSERT_EQUALS( total , num );
+            }
+        };
+
         class D1 {
         public:
             void run(){
@@ -1512,6 +1586,146 @@ namespace JsobjTests {
         }
     };
 
+    namespace KeyStringTests {
+
+        /* keys in the order woCompare puts them in */
+        static vector< BSONObj > orderedKeys() {
+            vector< BSONObj > v;
+            OID a; a.init( "000000000000000000000001" );
+            OID b; b.init( "0000000000000000000000ff" );
+            {
+                BSONObjBuilder bb;
+                bb.appendMinKey( "" );
+                v.push_back( bb.obj() );
+            }
+            {
+                BSONObjBuilder bb;
+                bb.appendNull( "" );
+                v.push_back( bb.obj() );
+            }
+            v.push_back( BSON( "" << -1e300 ) );
+            v.push_back( BSON( "" << (long long) -5 ) );
+            v.push_back( BSON( "" << -1.5 ) );
+            v.push_back( BSON( "" << 0 ) );
+            v.push_back( BSON( "" << 1e-300 ) );
+            v.push_back( BSON( "" << 1 ) );
+            v.push_back( BSON( "" << 1.5 ) );
+            v.push_back( BSON( "" << 2 ) );
+            v.push_back( BSON( "" << ( 1LL << 40 ) ) );
+            v.push_back( BSON( "" << 1e300 ) );
+            v.push_back( BSON( "" << "" ) );
+            v.push_back( BSON( "" << "a" ) );
+            v.push_back( BSON( "" << "a" << "" << 1 ) );
+            v.push_back( BSON( "" << "ab" ) );
+            v.push_back( BSON( "" << "b" ) );
+            v.push_back( BSON( "" << "\xc3\xa9" ) );
+            {
+                BSONObjBuilder bb;
+                bb.appendBinData( "" , 2 , ByteArray , "zz" );
+                v.push_back( bb.obj() );
+            }
+            {
+                BSONObjBuilder bb;
+                bb.appendBinData( "" , 3 , ByteArray , "aaa" );
+                v.push_back( bb.obj() );
+            }
+            v.push_back( BSON( "" << a ) );
+            v.push_back( BSON( "" << b ) );
+            v.push_back( BSON( "" << false ) );
+            v.push_back( BSON( "" << true ) );
+            {
+                BSONObjBuilder bb;
+                bb.appendDate( "" , 1 );
+                v.push_back( bb.obj() );
+            }
+            {
+                BSONObjBuilder bb;
+                bb.appendDate( "" , 1ULL << 40 );
+                v.push_back( bb.obj() );
+            }
+            {
+                BSONObjBuilder bb;
+                bb.appendMaxKey( "" );
+                v.push_back( bb.obj() );
+            }
+            return v;
+        }
+
+        static string encode( const BSONObj& key , const Ordering& o , int& comparableSize ) {
+            BufBuilder b;
+            ASSERT( KeyString::encode( key , o , b , &comparableSize ) );
+            ASSERT_EQUALS( comparableSize , KeyString::comparableSize( b.buf() ) );
+            ASSERT_EQUALS( b.len() , KeyString::size( b.buf() ) );
+            return string( b.buf() , b.len() );
+        }
+
+        static int sign( int x ) {
+            return x == 0 ? 0 : ( x > 0 ? 1 : -1 );
+        }
+
+        class RoundTrip {
+        public:
+            void run() {
+                vector< BSONObj > v = orderedKeys();
+                v.push_back( BSON( "" << 3 << "" << "x" << "" << 4.5 << "" << (long long) 7 ) );
+                Ordering asc = Ordering::make( BSON( "a" << 1 << "b" << 1 << "c" << 1 << "d" << 1 ) );
+                Ordering desc = Ordering::make( BSON( "a" << -1 << "b" << 1 << "c" << -1 << "d" << -1 ) );
+                for ( unsigned i = 0; i < v.size(); i++ ) {
+                    int cs;
+                    BSONObj a = KeyString::toBSON( encode( v[ i ] , asc , cs ).c_str() );
+                    ASSERT( a.woEqual( v[ i ] ) );
+                    BSONObj d = KeyString::toBSON( encode( v[ i ] , desc , cs ).c_str() );
+                    ASSERT( d.woEqual( v[ i ] ) );
+                }
+            }
+        };
+
+        class Order {
+        public:
+            void run() {
+                vector< BSONObj > v = orderedKeys();
+                check( v , BSON( "a" << 1 << "b" << 1 ) );
+                check( v , BSON( "a" << -1 << "b" << -1 ) );
+            }
+        private:
+            void check( const vector< BSONObj >& v , const BSONObj& pattern ) {
+                Ordering o = Ordering::make( pattern );
+                for ( unsigned i = 0; i < v.size(); i++ ) {
+                    for ( unsigned j = 0; j < v.size(); j++ ) {
+                        int ci, cj;
+                        string a = encode( v[ i ] , o , ci );
+                        string b = encode( v[ j ] , o , cj );
+                        int x = sign( memcmp( a.data() , b.data() , min( ci , cj ) ) );
+                        ASSERT_EQUALS( sign( v[ i ].woCompare( v[ j ] , o ) ) , x );
+                    }
+                }
+            }
+        };
+
+        class NotEncodable {
+        public:
+            void run() {
+                Ordering o = Ordering::make( BSON( "a" << 1 << "b" << 1 ) );
+                no( BSON( "a" << 1 ) , o );
+                no( BSON( "" << BSON( "x" << 1 ) ) , o );
+                no( BSON( "" << BSON_ARRAY( 1 << 2 ) ) , o );
+                no( BSON( "" << numeric_limits< double >::quiet_NaN() ) , o );
+                no( BSON( "" << numeric_limits< double >::infinity() ) , o );
+                no( BSON( "" << -0.0 ) , o );
+                no( BSON( "" << ( ( 1LL << 53 ) + 1 ) ) , o );
+                no( BSON( "" << 1 << "" << BSON( "x" << 1 ) ) , o );
+            }
+        private:
+            void no( const BSONObj& key , const Ordering& o ) {
+                BufBuilder b;
+                b.append( 'x' );
+                ASSERT( !KeyString::encode( key , o , b ) );
+                ASSERT_EQUALS( 1 , b.len() );
+            }
+        };
+
+    } // namespace KeyStringTests
+
     class All : public Suite {
     public:
         All() : Suite( "jsobj" ){
@@ -1594,6 +1808,8 @@ namespace JsobjTests {
             add< external_sort::ByDiskLock >();
             add< external_sort::Big1 >();
             add< external_sort::Big2 >();
+            add< external_sort::Big3 >();
+            add< external_sort::IndexKeys >();
             add< external_sort::D1 >();
             add< CompatBSON >();
             add< CompareDottedFieldNamesTest >();
@@ -1607,6 +1823,9 @@ namespace JsobjTests {
             add< ElementSetTest >();
             add< EmbeddedNumbers >();
             add< BuilderPartialItearte >();
+            add< KeyStringTests::RoundTrip >();
+            add< KeyStringTests::Order >();
+            add< KeyStringTests::NotEncodable >();
         }
     } myall;
     
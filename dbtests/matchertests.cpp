@@ -116,6 +116,55 @@ namespace MatcherTests {
         }        
     };
     
+    /** compiled comparisons keep the general matcher's semantics, and defer to it on arrays */
+    class Compiled {
+    public:
+        void run() {
+            BSONObj q = fromjson( "{a:{$gt:4,$lte:10},'b.c':'x',d:true}" );
+            ElementMatcher gt( q[ "a" ].embeddedObject()[ "$gt" ], BSONObj::GT, false );
+            CompiledPredicates c;
+            ASSERT( c.add( gt ) );
+            ASSERT( !c.add( ElementMatcher( q[ "a" ], BSONObj::opSIZE, false ) ) );
+            ASSERT( !c.add( ElementMatcher( q[ "a" ].embeddedObject()[ "$gt" ], BSONObj::GT, true ) ) );
+            ASSERT_EQUALS( 1U, c.size() );
+
+            Matcher m( q );
+            check( m, "{a:5,b:{c:'x'},d:true}", true );
+            check( m, "{a:10.0,b:{c:'x'},d:true}", true );
+            check( m, "{a:4,b:{c:'x'},d:true}", false );
+            check( m, "{a:11,b:{c:'x'},d:true}", false );
+            check( m, "{a:'5',b:{c:'x'},d:true}", false );
+            check( m, "{b:{c:'x'},d:true}", false );
+            check( m, "{a:5,b:{c:'y'},d:true}", false );
+            check( m, "{a:5,b:'x',d:true}", false );
+            check( m, "{a:5,b:{c:'x'},d:false}", false );
+            // only the first of two fields with the same name is matched
+            check( m, "{a:5,a:1,b:{c:'x'},d:true}", true );
+            check( m, "{a:1,a:5,b:{c:'x'},d:true}", false );
+            // arrays go to the general matcher
+            check( m, "{a:[1,5],b:{c:'x'},d:true}", true );
+            check( m, "{a:5,b:[{c:'y'},{c:'x'}],d:true}", true );
+            check( m, "{a:[1,2],b:{c:'x'},d:true}", false );
+
+            BSONObjBuilder b;
+            b.append( "a", 5LL ).append( "b", BSON( "c" << "x" ) ).appendBool( "d", true );
+            check( m, b.obj(), true );
+
+            Matcher n( BSON( "a" << numeric_limits< double >::quiet_NaN() ) );
+            check( n, BSON( "a" << numeric_limits< double >::quiet_NaN() ), true );
+            check( n, BSON( "a" << 1 ), false );
+            Matcher l( BSON( "a" << GT << 9007199254740992LL ) );
+            check( l, BSON( "a" << 9007199254740993LL ), true );
+            check( l, BSON( "a" << 9007199254740992LL ), false );
+        }
+    private:
+        void check( Matcher &m, const char *json, bool expected ) {
+            check( m, fromjson( json ), expected );
+        }
+        void check( Matcher &m, const BSONObj &o, bool expected ) {
+            ASSERT_EQUALS( expected, m.matches( o ) );
+        }
+    };
 
     class All : public Suite {
     public:
@@ -130,6 +179,7 @@ namespace MatcherTests {
             add< MixedNumericIN >();
             add< Size >();
             add< MixedNumericEmbedded >();
+            add< Compiled >();
         }
     } dball;
     
@@ -23,6 +23,7 @@
 
 #include "../db/db.h"
 #include "../db/json.h"
+#include "../db/dbhelpers.h"
 
 #include "dbtests.h"
 
@@ -437,6 +438,63 @@ namespace NamespaceTests {
             }
             
         };
+
+        /* keys from the merged key field walk must match IndexSpec::getKeys() for each index */
+        class KeyFieldTrie {
+        public:
+            void run() {
+                const char *patterns[] = { "{a:1}", "{a:1,b:1}", "{'a.b':1}", "{'a.b':1,'a.c':1}", "{'a.b.c':1,x:1}",
+                                           "{x:1,y:-1,'z.w':1}", "{a:1,'a.b':1}", "{'x.y':1,a:1}", 0 };
+                vector< shared_ptr< IndexSpec > > specs;
+                IndexKeyFieldTrie trie;
+                for( int i = 0; patterns[ i ]; ++i ) {
+                    specs.push_back( shared_ptr< IndexSpec >( new IndexSpec( fromjson( patterns[ i ] ) ) ) );
+                    trie.addIndex( specs.back().get() );
+                }
+                ASSERT_EQUALS( (int) specs.size(), trie.nIndexes() );
+
+                const char *docs[] = { "{}", "{a:1,b:2}", "{a:{b:1,c:2}}", "{a:[{b:1},{b:2,c:3}]}", "{a:[]}",
+                                       "{a:{b:[1,2]},x:3}", "{a:{b:{c:[4,5]}},x:[]}", "{a:5,x:{y:[1,{z:2}]}}",
+                                       "{a:[1,2],a:3,x:1}", "{x:1,y:'q',z:[{w:1},{w:2},{v:3}]}", "{a:{b:1},a:{b:2}}",
+                                       "{x:{y:1},a:[{b:[1,2]}]}", "{a:[[1],[2]],b:[]}", "{z:5,a:{c:1}}",
+                                       "{a:[1,2],b:[3]}", "{a:[],x:{y:[]}}", 0 };
+                for( int d = 0; docs[ d ]; ++d ) {
+                    BSONObj obj = fromjson( docs[ d ] );
+                    vector< BSONObjSetDefaultOrder > keys;
+                    bool trieThrew = false;
+                    try {
+                        trie.getKeys( obj, keys );
+                    }
+                    catch( UserException& ) {
+                        trieThrew = true;
+                    }
+                    bool anyThrew = false;
+                    for( unsigned i = 0; i < specs.size(); ++i ) {
+                        BSONObjSetDefaultOrder expected;
+                        bool threw = false;
+                        try {
+                            specs[ i ]->getKeys( obj, expected );
+                        }
+                        catch( UserException& ) {
+                            threw = true;
+                        }
+                        if ( threw ) {
+                            // parallel arrays
+                            anyThrew = true;
+                            continue;
+                        }
+                        if ( trieThrew )
+                            continue;
+                        ASSERT_EQUALS( expected.size(), keys[ i ].size() );
+                        BSONObjSetDefaultOrder::iterator j = expected.begin();
+                        BSONObjSetDefaultOrder::iterator k = keys[ i ].begin();
+                        for( ; j != expected.end(); ++j, ++k )
+                            ASSERT_EQUALS( *j, *k );
+                    }
+                    ASSERT_EQUALS( anyThrew, trieThrew );
+                }
+            }
+        };
         
         class ArraySubelementComplex : public Base {
         public:
@@ -729,6 +787,130 @@ namespace NamespaceTests {
             }
         };
 
+        class PowerOf2Alloc : public Base {
+        public:
+            void run() {
+                create();
+                ASSERT( nsd()->usePowerOf2Sizes() );
+                BSONObj b = bigObj();
+                DiskLoc l[ 2 ];
+                for ( int i = 0; i < 2; ++i ) {
+                    l[ i ] = theDataFileMgr.insert( ns(), b.objdata(), b.objsize() );
+                    ASSERT( !l[ i ].isNull() );
+                    ASSERT_EQUALS( 256, l[ i ].rec()->lengthWithHeaders );
+                }
+                ASSERT_EQUALS( 2, nRecords() );
+                long long size, n;
+                int largest;
+                nsd()->deletedStats( size, n, largest ); // the rest of the extent
+                ASSERT_EQUALS( 1, n );
+                theDataFileMgr.deleteRecord( ns(), l[ 0 ].rec(), l[ 0 ] );
+                ASSERT_EQUALS( 1, nRecords() );
+                nsd()->deletedStats( size, n, largest );
+                ASSERT_EQUALS( 2, n );
+                // a smaller object is given the freed slot whole, not split from it
+                BSONObj small = BSON( "a" << 1 );
+                DiskLoc reused = theDataFileMgr.insert( ns(), small.objdata(), small.objsize() );
+                ASSERT( reused == l[ 0 ] );
+                ASSERT_EQUALS( 256, reused.rec()->lengthWithHeaders );
+                long long size2;
+                nsd()->deletedStats( size2, n, largest );
+                ASSERT_EQUALS( 1, n );
+                ASSERT_EQUALS( size - 256, size2 );
+                ASSERT_EQUALS( 32, NamespaceDetails::quantizePowerOf2AllocationSpace( 1 ) );
+                ASSERT_EQUALS( 256, NamespaceDetails::quantizePowerOf2AllocationSpace( 129 ) );
+                ASSERT_EQUALS( 0x800000, NamespaceDetails::quantizePowerOf2AllocationSpace( 0x800000 ) );
+                ASSERT_EQUALS( 0x900000, NamespaceDetails::quantizePowerOf2AllocationSpace( 0x800001 ) );
+            }
+        private:
+            virtual string spec() const {
+                return "{\"usePowerOf2Sizes\":true}";
+            }
+        };
+
+        class Compact : public Base {
+        public:
+            void run() {
+                create();
+                DiskLoc l[ 300 ];
+                for ( int i = 0; i < 300; ++i ) {
+                    BSONObj o = BSON( "_id" << i << "a" << string( 187, 'a' ) );
+                    l[ i ] = theDataFileMgr.insert( ns(), o.objdata(), o.objsize() );
+                    ASSERT( !l[ i ].isNull() );
+                }
+                int extentsBefore = nExtents();
+                ASSERT( extentsBefore > 1 );
+                DiskLoc firstBefore = nsd()->firstExtent;
+                for ( int i = 0; i < 300; ++i ) {
+                    if ( i % 3 != 0 )
+                        theDataFileMgr.deleteRecord( ns(), l[ i ].rec(), l[ i ] );
+                }
+                ASSERT_EQUALS( 100, nRecords() );
+
+                string errmsg;
+                BSONObjBuilder result;
+                ASSERT( compactCollection( ns(), errmsg, result ) );
+                BSONObj res = result.done();
+                ASSERT_EQUALS( 100, res[ "moved" ].number() );
+                ASSERT_EQUALS( extentsBefore, res[ "extentsFreed" ].number() );
+                ASSERT( res[ "storageSizeAfter" ].number() < res[ "storageSizeBefore" ].number() );
+
+                ASSERT_EQUALS( 100, nRecords() );
+                for ( DiskLoc i = nsd()->firstExtent; !i.isNull(); i = i.ext()->xnext )
+                    ASSERT( i != firstBefore );
+                // the _id index points at the moved records
+                for ( int i = 0; i < 300; ++i ) {
+                    BSONObj o;
+                    ASSERT_EQUALS( i % 3 == 0, Helpers::findOne( ns(), BSON( "_id" << i ), o, true ) );
+                    if ( i % 3 == 0 )
+                        ASSERT_EQUALS( 187, o[ "a" ].valuestrsize() - 1 );
+                }
+            }
+        private:
+            virtual string spec() const {
+                return "{\"size\":4096}";
+            }
+        };
+
+        class AdaptivePadding : public Base {
+        public:
+            void run() {
+                create();
+                NamespaceDetails *d = nsd();
+                ASSERT_EQUALS( 1.0, d->paddingFactor );
+                // objects growing by 50%: the padding covers them after one window
+                for ( int i = 0; i < NamespaceDetails::GrowthWindow - 1; ++i )
+                    d->noteUpdateSize( 150, 100 );
+                ASSERT_EQUALS( 1.0, d->paddingFactor );
+                d->noteUpdateSize( 150, 100 );
+                ASSERT_EQUALS( 1.5, d->paddingFactor );
+                // then shrinking objects lower it once the old updates have decayed, never raise it
+                for ( int i = 0; i < 2 * NamespaceDetails::GrowthWindow; ++i )
+                    d->noteUpdateSize( 50, 100 );
+                ASSERT_EQUALS( 1.5, d->paddingFactor );
+                for ( int i = 0; i < NamespaceDetails::GrowthWindow; ++i )
+                    d->noteUpdateSize( 50, 100 );
+                ASSERT_EQUALS( 1.0, d->paddingFactor );
+                // and growth of 1/8 gives that much padding, whatever the padding was before
+                for ( int i = 0; i < NamespaceDetails::GrowthWindow; ++i )
+                    d->noteUpdateSize( 900, 800 );
+                ASSERT_EQUALS( 1.125, d->paddingFactor );
+                for ( int i = 0; i < NamespaceDetails::GrowthWindow; ++i )
+                    d->noteUpdateSize( 900, 800 );
+                ASSERT_EQUALS( 1.125, d->paddingFactor );
+
+                // padded sizes are rounded up to 1/32 of the bucket above
+                ASSERT_EQUALS( 304, NamespaceDetails::quantizeAllocationSpace( 300 ) );
+                ASSERT_EQUALS( 256, NamespaceDetails::quantizeAllocationSpace( 256 ) );
+                ASSERT_EQUALS( 32, NamespaceDetails::quantizeAllocationSpace( 31 ) );
+                ASSERT_EQUALS( 304, d->allocationSize( 260 ) ); // 292.5 padded
+            }
+        private:
+            virtual string spec() const {
+                return "{}";
+            }
+        };
+
         // This isn't a particularly useful test, and because it doesn't clean up
         // after itself, /tmp/unittest needs to be cleared after running.
         //        class BigCollection : public Base {
@@ -784,12 +966,16 @@ namespace NamespaceTests {
             add< IndexDetailsTests::MissingField >();
             add< IndexDetailsTests::SubobjectMissing >();
             add< IndexDetailsTests::CompoundMissing >();
+            add< IndexDetailsTests::KeyFieldTrie >();
             add< NamespaceDetailsTests::Create >();
             add< NamespaceDetailsTests::SingleAlloc >();
             add< NamespaceDetailsTests::Realloc >();
             add< NamespaceDetailsTests::TwoExtent >();
             add< NamespaceDetailsTests::Migrate >();
             //            add< NamespaceDetailsTests::BigCollection >();
+            add< NamespaceDetailsTests::PowerOf2Alloc >();
+            add< NamespaceDetailsTests::Compact >();
+            add< NamespaceDetailsTests::AdaptivePadding >();
             add< NamespaceDetailsTests::Size >();
         }
     } myall;
@@ -22,6 +22,8 @@
 
 #include "../db/db.h"
 #include "../db/json.h"
+#include "../db/dbhelpers.h"
+#include "../db/btree.h"
 
 #include "dbtests.h"
 
@@ -300,6 +302,40 @@ namespace PdfileTests {
                 ASSERT( 0 != o.getField( "a" ).date() );
             }
         };
+
+        class Batch : public Base {
+        public:
+            void run() {
+                Helpers::ensureIndex( ns(), BSON( "a" << 1 ), false, "a_1" );
+                Helpers::ensureIndex( ns(), BSON( "b" << 1 ), true, "b_1" );
+                vector< BSONObj > objs;
+                for( int i = 0; i < 10; ++i )
+                    objs.push_back( BSON( "a" << 10 - i << "b" << i ) );
+                objs.push_back( BSON( "a" << 0 << "b" << 3 ) ); // duplicate b stops the batch
+                objs.push_back( BSON( "a" << -1 << "b" << 11 ) );
+                int n = -1;
+                ASSERT_EXCEPTION( theDataFileMgr.insertBatch( ns(), objs, n ), UserException );
+                ASSERT_EQUALS( 10, n );
+                ASSERT_EQUALS( 10, nsd()->nrecords );
+                ASSERT( objs[ 0 ].hasField( "_id" ) );
+                // the deferred non-unique keys went in for the records inserted, and no others
+                ASSERT_EQUALS( 10, keyCount( "a_1" ) );
+                ASSERT_EQUALS( 10, keyCount( "b_1" ) );
+                ASSERT_EQUALS( 10, keyCount( "_id_" ) );
+
+                vector< BSONObj > more;
+                more.push_back( BSON( "a" << 20 << "b" << 20 ) );
+                more.push_back( BSON( "a" << 5 << "b" << 21 ) );
+                theDataFileMgr.insertBatch( ns(), more, n );
+                ASSERT_EQUALS( 2, n );
+                ASSERT_EQUALS( 12, keyCount( "a_1" ) );
+            }
+        private:
+            int keyCount( const char *name ) {
+                IndexDetails &id = nsd()->idx( nsd()->findIndexByName( name ) );
+                return id.head.btree()->fullValidate( id.head, id.keyPattern() );
+            }
+        };
     } // namespace Insert
     
     class All : public Suite {
@@ -321,6 +357,7 @@ namespace PdfileTests {
             add< ScanCapped::FirstInExtent >();
             add< ScanCapped::LastInExtent >();
             add< Insert::UpdateDate >();
+            add< Insert::Batch >();
         }
     } myall;
 
@@ -23,6 +23,8 @@
 #include "../../db/instance.h"
 #include "../../db/query.h"
 #include "../../db/queryoptimizer.h"
+#include "../../db/keystring.h"
+#include "../../db/matcher.h"
 #include "../../util/file_allocator.h"
 
 #include "../framework.h"
@@ -687,6 +689,145 @@ namespace Plan {
 
 } // namespace Plan
 
+namespace MatcherPerf {
+
+    // documents shaped like a typical collection scan: a few scalars and an embedded object
+    class Base {
+    public:
+        Base() {
+            for( int i = 0; i < 1000; ++i ) {
+                docs_.push_back( BSON( "_id" << OID::gen() << "name" << "item" << "qty" << i << 
+                                       "price" << i * 0.25 << "dim" << BSON( "w" << i % 17 << "h" << i % 13 ) <<
+                                       "tag" << ( i % 2 ? "even" : "odd" ) ) );
+            }
+        }
+        void run() {
+            Matcher m( query() );
+            int n = 0;
+            for( int j = 0; j < 1000; ++j )
+                for( vector< BSONObj >::const_iterator i = docs_.begin(); i != docs_.end(); ++i )
+                    if ( m.matches( *i ) )
+                        ++n;
+            ASSERT( n > 0 );
+        }
+        virtual ~Base() {}
+    protected:
+        virtual BSONObj query() const = 0;
+    private:
+        vector< BSONObj > docs_;
+    };
+
+    class IntRange : public Base {
+        BSONObj query() const { return BSON( "qty" << GT << 100 << LT << 900 ); }
+    };
+
+    class DoubleRangeAndString : public Base {
+        BSONObj query() const { return BSON( "price" << GTE << 10.0 << "tag" << "even" ); }
+    };
+
+    class Dotted : public Base {
+        BSONObj query() const { return BSON( "dim.w" << 3 << "dim.h" << LTE << 6 ); }
+    };
+
+    class NoMatchLastField : public Base {
+        BSONObj query() const { return BSON( "tag" << "none" ); }
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "matcher" ){}
+        void setupTests(){
+            add< IntRange >();
+            add< DoubleRangeAndString >();
+            add< Dotted >();
+            add< NoMatchLastField >();
+        }
+    } all;
+
+} // namespace MatcherPerf
+
+namespace KeyCompare {
+
+    // compound index keys, { "" : string, "" : int, "" : double }
+    class Base {
+    public:
+        Base() : order_( Ordering::make( BSON( "a" << 1 << "b" << -1 << "c" << 1 ) ) ) {
+            srand( 5 );
+            for( int i = 0; i < 100000; ++i ) {
+                stringstream ss;
+                ss << "user" << rand() % 1000;
+                keys_.push_back( BSON( "" << ss.str() << "" << rand() % 100 << "" << rand() / 7.0 ) );
+            }
+        }
+    protected:
+        Ordering order_;
+        vector< BSONObj > keys_;
+    };
+
+    class WoCompare : public Base {
+    public:
+        void run() {
+            vector< const BSONObj* > v;
+            for( vector< BSONObj >::const_iterator i = keys_.begin(); i != keys_.end(); ++i )
+                v.push_back( &*i );
+            sort( v.begin(), v.end(), Cmp( order_ ) );
+        }
+    private:
+        struct Cmp {
+            Cmp( const Ordering &o ) : o_( o ) {}
+            bool operator()( const BSONObj *l, const BSONObj *r ) const {
+                return l->woCompare( *r, o_ ) < 0;
+            }
+            Ordering o_;
+        };
+    };
+
+    class Encode : public Base {
+    public:
+        void run() {
+            BufBuilder b;
+            for( vector< BSONObj >::const_iterator i = keys_.begin(); i != keys_.end(); ++i ) {
+                b.reset();
+                KeyString::encode( *i, order_, b );
+            }
+        }
+    };
+
+    // includes the encoding
+    class Memcmp : public Base {
+    public:
+        void run() {
+            vector< SortKey > keys;
+            keys.reserve( keys_.size() );
+            for( vector< BSONObj >::const_iterator i = keys_.begin(); i != keys_.end(); ++i )
+                keys.push_back( SortKey( *i, order_ ) );
+            vector< const SortKey* > v;
+            for( vector< SortKey >::const_iterator i = keys.begin(); i != keys.end(); ++i )
+                v.push_back( &*i );
+            sort( v.begin(), v.end(), Cmp( order_ ) );
+        }
+    private:
+        struct Cmp {
+            Cmp( const Ordering &o ) : o_( o ) {}
+            bool operator()( const SortKey *l, const SortKey *r ) const {
+                return l->woCompare( *r, o_ ) < 0;
+            }
+            Ordering o_;
+        };
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "keycompare" ){}
+        void setupTests(){
+            add< WoCompare >();
+            add< Encode >();
+            add< Memcmp >();
+        }
+    } all;
+
+} // namespace KeyCompare
+
 int main( int argc, char **argv ) {
     logLevel = -1;
     client_ = new DBDirectClient();
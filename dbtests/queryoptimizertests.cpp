@@ -336,6 +336,86 @@ namespace QueryOptimizerTests {
 				ASSERT( j == intervals.end() );
 			}
 		};
+
+        class Diff {
+        public:
+            void run() {
+                FieldRange r = FieldRangeSet( "", fromjson( "{a:{$gte:1,$lte:10}}" ) ).range( "a" );
+                r -= FieldRangeSet( "", fromjson( "{a:{$in:[0,3,5]}}" ) ).range( "a" );
+                vector< FieldInterval > intervals = r.intervals();
+                ASSERT_EQUALS( 3U, intervals.size() );
+                ASSERT_EQUALS( 1, intervals[ 0 ]._lower._bound.number() );
+                ASSERT( intervals[ 0 ]._lower._inclusive );
+                ASSERT_EQUALS( 3, intervals[ 0 ]._upper._bound.number() );
+                ASSERT( !intervals[ 0 ]._upper._inclusive );
+                ASSERT_EQUALS( 3, intervals[ 1 ]._lower._bound.number() );
+                ASSERT( !intervals[ 1 ]._lower._inclusive );
+                ASSERT_EQUALS( 5, intervals[ 1 ]._upper._bound.number() );
+                ASSERT_EQUALS( 10, intervals[ 2 ]._upper._bound.number() );
+                ASSERT( intervals[ 2 ]._upper._inclusive );
+                
+                r -= FieldRangeSet( "", fromjson( "{a:{$gt:0,$lt:20}}" ) ).range( "a" );
+                ASSERT( r.empty() );
+            }
+        };
+
+        class Contains {
+        public:
+            void run() {
+                FieldRange outer = FieldRangeSet( "", fromjson( "{a:{$gte:1,$lte:10}}" ) ).range( "a" );
+                ASSERT( FieldRangeSet( "", fromjson( "{a:{$in:[1,4,10]}}" ) ).range( "a" ) <= outer );
+                ASSERT( FieldRangeSet( "", fromjson( "{a:{$gt:1,$lt:10}}" ) ).range( "a" ) <= outer );
+                ASSERT( !( FieldRangeSet( "", fromjson( "{a:{$in:[1,11]}}" ) ).range( "a" ) <= outer ) );
+                ASSERT( !( outer <= FieldRangeSet( "", fromjson( "{a:{$gt:1,$lte:10}}" ) ).range( "a" ) ) );
+            }
+        };
+
+        class NorRange {
+        public:
+            void run() {
+                FieldRangeSet f( "", fromjson( "{a:{$gte:1,$lte:10},$nor:[{a:{$gte:0,$lt:5}}]}" ) );
+                ASSERT_EQUALS( 5, f.range( "a" ).min().number() );
+                ASSERT( f.range( "a" ).minInclusive() );
+                ASSERT_EQUALS( 10, f.range( "a" ).max().number() );
+            }
+        };
+
+        class NorOtherFieldsIncluded {
+        public:
+            void run() {
+                FieldRangeSet f( "", fromjson( "{a:1,b:{$gte:1,$lte:10},$nor:[{a:{$in:[1,2]},b:{$lte:5}}]}" ) );
+                ASSERT( f.range( "a" ).equality() );
+                ASSERT_EQUALS( 5, f.range( "b" ).min().number() );
+                ASSERT( !f.range( "b" ).minInclusive() );
+                
+                FieldRangeSet g( "", fromjson( "{a:1,b:2,$nor:[{a:1,b:2}]}" ) );
+                ASSERT( !g.matchPossible() );
+            }
+        };
+
+        class NorNotIncluded {
+        public:
+            void run() {
+                // neither field's range is within the $nor clause's, so nothing can be removed
+                FieldRangeSet f( "", fromjson( "{a:{$gte:1,$lte:10},b:{$gte:1,$lte:10},$nor:[{a:5,b:5}]}" ) );
+                ASSERT_EQUALS( 1U, f.range( "a" ).intervals().size() );
+                ASSERT_EQUALS( 1U, f.range( "b" ).intervals().size() );
+            }
+        };
+
+        class NorInexact {
+        public:
+            void run() {
+                // { $gt:'a' } doesn't match every key in its range
+                FieldRangeSet f( "", fromjson( "{a:{$gte:'a'},$nor:[{a:{$gt:'a'}}]}" ) );
+                ASSERT( f.range( "a" ).nontrivial() );
+                ASSERT( f.range( "a" ).max().woCompare( BSON( "" << "b" ).firstElement(), false ) > 0 );
+                FieldRangeSet g( "", fromjson( "{a:{$gte:1,$lte:10},$nor:[{a:{$gte:1,$lte:10,$ne:5}}]}" ) );
+                ASSERT_EQUALS( 1, g.range( "a" ).min().number() );
+                FieldRangeSet h( "", fromjson( "{a:{$gte:1,$lte:10},$nor:[{a:/^a/}]}" ) );
+                ASSERT_EQUALS( 1, h.range( "a" ).min().number() );
+            }
+        };
         
     } // namespace FieldRangeTests
     
@@ -939,6 +1019,94 @@ namespace QueryOptimizerTests {
             };
         };        
         
+        class CachedPlans : public Base {
+        public:
+            void run() {
+                CachedQueryPlan p;
+                p.won( BSON( "a" << 1 ), 5, 1000, 0 );
+                ASSERT( BSON( "a" << 1 ).woCompare( p.indexKey ) == 0 );
+                ASSERT( !p.stale( 1000, 1000 ) );
+                ASSERT( p.stale( 1000, 1001 ) );
+                ASSERT( !p.stale( 1250, 0 ) );
+                ASSERT( p.stale( 1251, 0 ) );
+                ASSERT( p.stale( 749, 0 ) );
+
+                p.ran( BSON( "a" << 1 ), 10 );
+                p.ran( BSON( "a" << 1 ), 20 );
+                p.ran( BSON( "b" << 1 ), 1000 ); // not the cached plan
+                ASSERT_EQUALS( 2, p.runs );
+                ASSERT_EQUALS( 11, p.avgNScanned );
+                ASSERT_EQUALS( 5, p.nScanned );
+                
+                // a new winner starts over
+                p.won( BSON( "b" << 1 ), 3, 1000, 0 );
+                ASSERT( BSON( "b" << 1 ).woCompare( p.indexKey ) == 0 );
+                ASSERT_EQUALS( 3, p.nScanned );
+                ASSERT_EQUALS( 0, p.runs );
+
+                // small collections
+                CachedQueryPlan q;
+                q.won( BSON( "a" << 1 ), 1, 0, 50 );
+                ASSERT( !q.stale( 100, 150 ) );
+                ASSERT( q.stale( 0, 151 ) );
+                ASSERT( q.stale( 101, 50 ) );
+            }
+        };
+
+        class CachedPlanWriteVolume : public Base {
+        public:
+            void run() {
+                Helpers::ensureIndex( ns(), BSON( "a" << 1 ), false, "a_1" );
+                Helpers::ensureIndex( ns(), BSON( "b" << 1 ), false, "b_1" );
+                DBDirectClient client;
+                for( int i = 0; i < 1000; ++i )
+                    client.insert( ns(), BSON( "a" << i << "b" << i ) );
+                nPlans( 3 );
+                runQuery();
+                nPlans( 1 );
+                // the cached plan running again is noted
+                runQuery();
+                ASSERT_EQUALS( 1, runs() );
+
+                // a few hundred writes don't change much in a thousand documents
+                for( int i = 0; i < 300; ++i )
+                    client.update( ns(), QUERY( "a" << i ), BSON( "a" << i << "b" << i + 1 ) );
+                nPlans( 1 );
+                // rewriting them all does
+                for( int i = 0; i < 1000; ++i )
+                    client.update( ns(), QUERY( "a" << i ), BSON( "a" << i << "b" << i ) );
+                nPlans( 3 );
+            }
+        private:
+            void nPlans( int n ) {
+                QueryPlanSet s( ns(), BSON( "a" << 4 ), BSON( "b" << 1 ) );
+                ASSERT_EQUALS( n, s.nPlans() );                
+            }
+            void runQuery() {
+                QueryPlanSet s( ns(), BSON( "a" << 4 ), BSON( "b" << 1 ) );
+                TestOp original;
+                s.runOp( original );
+            }
+            long long runs() {
+                BSONArrayBuilder b;
+                NamespaceDetailsTransient::_get( ns() ).appendQueryCache( b );
+                BSONObj shapes = b.arr();
+                ASSERT_EQUALS( 1, shapes.nFields() );
+                return shapes[ "0" ][ "runs" ].numberLong();
+            }
+            class TestOp : public QueryOp {
+            public:
+                virtual void init() {}
+                virtual void next() {
+                    setComplete();
+                }
+                virtual QueryOp *clone() const {
+                    return new TestOp();
+                }
+                virtual bool mayRecordPlan() const { return true; }
+            };
+        };
+        
         class TryAllPlansOnErr : public Base {
         public:
             void run() {
@@ -1148,6 +1316,57 @@ namespace QueryOptimizerTests {
             }
         };
 
+        class Intersection : public Base {
+        public:
+            void run() {
+                Helpers::ensureIndex( ns(), BSON( "a" << 1 ), false, "a_1" );
+                Helpers::ensureIndex( ns(), BSON( "b" << 1 ), false, "b_1" );
+                for( int i = 0; i < 100; ++i ) {
+                    BSONObj temp = BSON( "a" << i % 5 << "b" << i % 7 );
+                    theDataFileMgr.insertWithObjMod( ns(), temp );
+                }
+                QueryPlanSet s( ns(), BSON( "a" << 2 << "b" << 3 ), BSONObj() );
+                // a_1, b_1, their intersection, and a table scan
+                ASSERT_EQUALS( 4, s.nPlans() );
+                
+                vector< int > intersect;
+                intersect.push_back( 1 );
+                intersect.push_back( 2 );
+                QueryPlan qp( nsd(), intersect, s.fbs(), BSONObj() );
+                ASSERT_EQUALS( fromjson( "{$intersect:[{a:1},{b:1}]}" ), qp.indexKey() );
+                boost::shared_ptr<Cursor> c = qp.newCursor();
+                ASSERT_EQUALS( "IntersectCursor BtreeCursor a_1, BtreeCursor b_1", c->toString() );
+                int count = 0;
+                DiskLoc last;
+                for( ; c->ok(); c->advance(), ++count ) {
+                    ASSERT_EQUALS( 2, c->current().getIntField( "a" ) );
+                    ASSERT_EQUALS( 3, c->current().getIntField( "b" ) );
+                    ASSERT( last.isNull() || last < c->currLoc() );
+                    last = c->currLoc();
+                }
+                // 17, 52 and 87
+                ASSERT_EQUALS( 3, count );
+            }
+        };
+
+        class NoRedundantIntersection : public Base {
+        public:
+            void run() {
+                Helpers::ensureIndex( ns(), BSON( "a" << 1 ), false, "a_1" );
+                Helpers::ensureIndex( ns(), BSON( "a" << 1 << "b" << 1 ), false, "a_1_b_1" );
+                Helpers::ensureIndex( ns(), BSON( "c" << 1 ), false, "c_1" );
+                QueryPlanSet s( ns(), BSON( "a" << 2 << "b" << 3 << "c" << 4 ), BSONObj() );
+                // a_1, a_1_b_1, c_1, intersection of a_1_b_1 and c_1, and a table scan
+                ASSERT_EQUALS( 5, s.nPlans() );
+                QueryPlanSet t( ns(), BSON( "a" << 2 << "b" << BSON( "$gt" << 3 ) << "c" << 4 ), BSONObj() );
+                // a_1_b_1 no longer covers a single key, so a_1 and c_1 are intersected
+                ASSERT_EQUALS( 5, t.nPlans() );
+                QueryPlanSet u( ns(), BSON( "a" << 2 << "c" << 4 ), BSON( "a" << 1 ) );
+                // no intersection when sorting
+                ASSERT_EQUALS( 4, u.nPlans() );
+            }
+        };
+        
     } // namespace QueryPlanSetTests
     
     class All : public Suite {
@@ -1178,6 +1397,12 @@ namespace QueryOptimizerTests {
             add< FieldRangeTests::InLowerBound >();
             add< FieldRangeTests::InUpperBound >();
             add< FieldRangeTests::MultiBound >();
+            add< FieldRangeTests::Diff >();
+            add< FieldRangeTests::Contains >();
+            add< FieldRangeTests::NorRange >();
+            add< FieldRangeTests::NorOtherFieldsIncluded >();
+            add< FieldRangeTests::NorNotIncluded >();
+            add< FieldRangeTests::NorInexact >();
             add< QueryPlanTests::NoIndex >();
             add< QueryPlanTests::SimpleOrder >();
             add< QueryPlanTests::MoreIndexThanNeeded >();
@@ -1206,6 +1431,8 @@ namespace QueryOptimizerTests {
             add< QueryPlanSetTests::SingleException >();
             add< QueryPlanSetTests::AllException >();
             add< QueryPlanSetTests::SaveGoodIndex >();
+            add< QueryPlanSetTests::CachedPlans >();
+            add< QueryPlanSetTests::CachedPlanWriteVolume >();
             add< QueryPlanSetTests::TryAllPlansOnErr >();
             add< QueryPlanSetTests::FindOne >();
             add< QueryPlanSetTests::Delete >();
@@ -1213,6 +1440,8 @@ namespace QueryOptimizerTests {
             add< QueryPlanSetTests::DeleteOneIndex >();
             add< QueryPlanSetTests::TryOtherPlansBeforeFinish >();
             add< QueryPlanSetTests::InQueryIntervals >();
+            add< QueryPlanSetTests::Intersection >();
+            add< QueryPlanSetTests::NoRedundantIntersection >();
             add< QueryPlanSetTests::EqualityThenIn >();
             add< QueryPlanSetTests::NotEqualityThenIn >();
         }
@@ -24,6 +24,7 @@
 #include "../db/instance.h"
 #include "../db/json.h"
 #include "../db/lasterror.h"
+#include "../db/oplog.h"
 
 #include "dbtests.h"
 
@@ -503,6 +504,72 @@ namespace QueryTests {
         }
     };
 
+    class CoveredIndex : public ClientBase {
+    public:
+        ~CoveredIndex() {
+            client().dropCollection( ns() );
+        }
+        static const char *ns() { return "unittests.querytests.CoveredIndex"; }
+        void run() {
+            for( int i = 0; i < 10; ++i )
+                insert( ns(), BSON( "u" << i % 2 << "ts" << i << "big" << string( 1000, 'x' ) ) );
+            client().ensureIndex( ns(), BSON( "u" << 1 << "ts" << 1 ) );
+
+            BSONObj fields = BSON( "_id" << 0 << "ts" << 1 );
+            BSONObj e = client().findOne( ns(), Query( BSON( "u" << 1 ) ).explain(), &fields );
+            ASSERT( e[ "indexOnly" ].trueValue() );
+            ASSERT_EQUALS( 0, e[ "nscannedObjects" ].number() );
+            ASSERT_EQUALS( BSON( "ts" << 3 ), client().findOne( ns(), BSON( "u" << 1 << "ts" << 3 ), &fields ) );
+
+            BSONObj withId = BSON( "ts" << 1 );
+            e = client().findOne( ns(), Query( BSON( "u" << 1 ) ).explain(), &withId );
+            ASSERT( !e[ "indexOnly" ].trueValue() );
+            e = client().findOne( ns(), Query( BSON( "u" << 1 << "big" << "x" ) ).explain(), &fields );
+            ASSERT( !e[ "indexOnly" ].trueValue() );
+
+            // a null in the key might be a missing field
+            insert( ns(), BSON( "u" << 5 ) );
+            ASSERT_EQUALS( BSONObj(), client().findOne( ns(), BSON( "u" << 5 ), &fields ) );
+
+            insert( ns(), BSON( "u" << 6 << "ts" << BSON_ARRAY( 1 << 2 ) ) );
+            ASSERT_EQUALS( BSON( "ts" << BSON_ARRAY( 1 << 2 ) ), client().findOne( ns(), BSON( "u" << 6 ), &fields ) );
+            e = client().findOne( ns(), Query( BSON( "u" << 1 ) ).explain(), &fields );
+            ASSERT( !e[ "indexOnly" ].trueValue() );
+        }
+    };
+
+    class CoveredIndexOldFormat : public ClientBase {
+    public:
+        ~CoveredIndexOldFormat() {
+            client().dropCollection( ns() );
+        }
+        static const char *ns() { return "unittests.querytests.CoveredIndexOldFormat"; }
+        void run() {
+            client().ensureIndex( ns(), BSON( "a" << 1 ) );
+            insert( ns(), BSON( "a" << 4 ) );
+            insert( ns(), BSON( "a" << BSON_ARRAY( 5 ) ) );
+            {
+                // as an index built before single element arrays marked it multikey
+                dblock lk;
+                Client::Context ctx( ns() );
+                NamespaceDetails *d = nsdetails( ns() );
+                d->multiKeyIndexBits = 0;
+                d->multiKeyExactBits = 0;
+            }
+            BSONObj fields = BSON( "_id" << 0 << "a" << 1 );
+            BSONObj e = client().findOne( ns(), Query( BSON( "a" << 4 ) ).explain(), &fields );
+            ASSERT( !e[ "indexOnly" ].trueValue() );
+            ASSERT_EQUALS( BSON( "a" << BSON_ARRAY( 5 ) ), client().findOne( ns(), BSON( "a" << 5 ), &fields ) );
+
+            // rebuilt, the index knows about the array
+            client().remove( ns(), BSON( "a" << 5 ) );
+            client().reIndex( ns() );
+            e = client().findOne( ns(), Query( BSON( "a" << 4 ) ).explain(), &fields );
+            ASSERT( e[ "indexOnly" ].trueValue() );
+            ASSERT_EQUALS( BSON( "a" << 4 ), client().findOne( ns(), BSON( "a" << 4 ), &fields ) );
+        }
+    };
+
     class AutoResetIndexCache : public ClientBase {
     public:
         ~AutoResetIndexCache() {
@@ -1049,6 +1116,48 @@ namespace QueryTests {
     private:
         int _old;
     };
+
+    /* as FindingStart, with Timestamp ts so the scan starts from an OplogTsIndex sample */
+    class FindingStartByTs : public CollectionBase {
+    public:
+        FindingStartByTs() : CollectionBase( "findingstartbyts" ) {}
+        ~FindingStartByTs() {
+            OplogTsIndex::forget( ns() );
+        }
+        
+        void run() {
+            BSONObj info;
+            ASSERT( client().runCommand( "unittests", BSON( "create" << "querytests.findingstartbyts" << "capped" << true << "size" << 1000 << "$nExtents" << 5 << "autoIndexId" << false ), info ) );
+            shared_ptr<OplogTsIndex> index = OplogTsIndex::get( ns() );
+            
+            unsigned i = 1;
+            for( int oldCount = -1;
+                count() != oldCount;
+                oldCount = count(), client().insert( ns(), ts( "ts", i++ ) ) );
+
+            for( int k = 0; k < 5; ++k ) {
+                client().insert( ns(), ts( "ts", i++ ) );
+                unsigned min = OpTime( client().query( ns(), Query().sort( BSON( "$natural" << 1 ) ) )->next()[ "ts" ].date() ).getSecs();
+                for( unsigned j = 0; j < i; ++j ) {
+                    BSONObjBuilder b;
+                    b.append( "ts", ts( "$gte", j ) );
+                    auto_ptr< DBClientCursor > c = client().query( ns(), b.obj(), 0, 0, 0, QueryOption_OplogReplay );
+                    ASSERT( c->more() );
+                    BSONObj next = c->next();
+                    ASSERT( !next[ "ts" ].eoo() );
+                    ASSERT_EQUALS( ( j > min ? j : min ), OpTime( next[ "ts" ].date() ).getSecs() );
+                }
+            }
+            // one per extent, and the first record
+            ASSERT( index->nSamples() >= 2 );
+        }
+    private:
+        static BSONObj ts( const char *name, unsigned secs ) {
+            BSONObjBuilder b;
+            b.appendTimestamp( name, OpTime( secs, 0 ).asDate() );
+            return b.obj();
+        }
+    };
         
     
     class WhatsMyUri : public CollectionBase {
@@ -1155,6 +1264,8 @@ namespace QueryTests {
             add< MultiNe >();
             add< EmbeddedNe >();
             add< EmbeddedNumericTypes >();
+            add< CoveredIndex >();
+            add< CoveredIndexOldFormat >();
             add< AutoResetIndexCache >();
             add< UniqueIndex >();
             add< UniqueIndexPreexistingData >();
@@ -1175,6 +1286,7 @@ namespace QueryTests {
             add< HelperByIdTest >();
             add< FindingStart >();
             add< FindingStartPartiallyFull >();
+            add< FindingStartByTs >();
             add< WhatsMyUri >();
             
             add< parsedtests::basic1 >();
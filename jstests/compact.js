@@ -0,0 +1,39 @@
+// compact moves live records into new extents and frees the old ones
+
+t = db.jstests_compact;
+t.drop();
+
+t.ensureIndex( {a:1} );
+for( i = 0; i < 2000; ++i ) {
+    t.save( {_id:i,a:i%100,s:new Array( 200 ).toString()} );
+}
+t.remove( {_id:{$mod:[4,1]}} );
+t.remove( {_id:{$mod:[4,2]}} );
+t.remove( {_id:{$mod:[4,3]}} );
+assert.eq.automsg( "500", "t.count()" );
+
+before = t.stats();
+res = db.runCommand( {compact:t.getName()} );
+assert( res.ok, tojson( res ) );
+assert.eq.automsg( "500", "res.moved" );
+assert.eq.automsg( "before.numExtents", "res.extentsFreed" );
+assert.lt.automsg( "t.stats().storageSize", "before.storageSize" );
+
+// data and indexes are intact
+assert.eq.automsg( "500", "t.count()" );
+assert.eq.automsg( "500", "t.find().itcount()" );
+assert.eq.automsg( "5", "t.find( {a:4} ).hint( {a:1} ).itcount()" );
+assert.eq.automsg( "1", "t.find( {_id:1996} ).hint( {_id:1} ).itcount()" );
+assert.eq.automsg( "0", "t.find( {_id:1997} ).itcount()" );
+assert( t.validate().valid );
+
+// still writable afterwards
+for( i = 2000; i < 2100; ++i ) {
+    t.save( {_id:i,a:i%100} );
+}
+assert.eq.automsg( "600", "t.count()" );
+
+assert( !db.runCommand( {compact:"jstests_compact_missing"} ).ok );
+db.createCollection( "jstests_compact_capped", {capped:true,size:4096} );
+assert( !db.runCommand( {compact:"jstests_compact_capped"} ).ok );
+db.jstests_compact_capped.drop();
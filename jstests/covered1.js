@@ -0,0 +1,70 @@
+// queries answered from the index key alone
+
+t = db.covered1
+t.drop();
+
+t.ensureIndex( { user_id : 1 , ts : 1 } );
+
+for ( i=0; i<20; i++ ){
+    t.insert( { user_id : i % 4 , ts : i , big : "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx" } );
+}
+
+function go( q , f , n , indexOnly ){
+    var e = t.find( q , f ).explain();
+    assert.eq( n , e.n , "n " + tojson( q ) + " " + tojson( f ) );
+    assert.eq( indexOnly , e.indexOnly == true , "indexOnly " + tojson( q ) + " " + tojson( f ) );
+    if ( indexOnly )
+        assert.eq( 0 , e.nscannedObjects , "nscannedObjects " + tojson( q ) + " " + tojson( f ) );
+}
+
+go( { user_id : 2 } , { _id : 0 , user_id : 1 , ts : 1 } , 5 , true );
+go( { user_id : 2 } , { _id : 0 , ts : 1 } , 5 , true );
+go( { user_id : 2 , ts : { $gt : 10 } } , { _id : 0 , ts : 1 } , 2 , true );
+go( { user_id : 2 } , { ts : 1 } , 5 , false ); // _id isn't in the index
+go( { user_id : 2 } , { _id : 0 , big : 1 } , 5 , false );
+go( { user_id : 2 , big : "x" } , { _id : 0 , ts : 1 } , 0 , false );
+go( { user_id : 2 } , null , 5 , false );
+
+// same results as from the documents
+a = t.find( { user_id : 2 } , { _id : 0 , ts : 1 } ).sort( { user_id : 1 , ts : 1 } ).toArray();
+assert.eq( 5 , a.length );
+for ( i=0; i<a.length; i++ )
+    assert.eq( { ts : 2 + 4 * i } , a[i] , "result " + i );
+
+// in memory sort of covered results
+a = t.find( { user_id : { $gte : 2 } } , { _id : 0 , user_id : 1 , ts : 1 } ).sort( { ts : -1 } ).toArray();
+assert.eq( 10 , a.length );
+assert.eq( { user_id : 3 , ts : 19 } , a[0] );
+
+// getMore
+a = t.find( { user_id : { $gte : 0 } } , { _id : 0 , ts : 1 } ).batchSize( 3 ).toArray();
+assert.eq( 20 , a.length );
+
+// a missing field is null in the key, so the document is used
+t.insert( { user_id : 5 } );
+assert.eq( [ { user_id : 5 } ] , t.find( { user_id : 5 } , { _id : 0 , user_id : 1 , ts : 1 } ).toArray() );
+
+// once there are arrays a key no longer has the whole value
+t.insert( { user_id : 6 , ts : [ 1 , 2 ] } );
+assert.eq( [ { user_id : 6 , ts : [ 1 , 2 ] } ] , t.find( { user_id : 6 } , { _id : 0 , user_id : 1 , ts : 1 } ).toArray() );
+go( { user_id : 2 } , { _id : 0 , ts : 1 } , 5 , false );
+
+// a single element array gives a single key, but the key still isn't the whole value
+t.drop();
+t.ensureIndex( { a : 1 } );
+t.insert( { a : [ 5 ] } );
+assert.eq( [ { a : [ 5 ] } ] , t.find( { a : 5 } , { _id : 0 , a : 1 } ).toArray() );
+go( { a : 5 } , { _id : 0 , a : 1 } , 1 , false );
+
+// the same for an index built over existing documents
+t.dropIndexes();
+t.ensureIndex( { a : 1 } );
+go( { a : 5 } , { _id : 0 , a : 1 } , 1 , false );
+
+// and for an update to such a value
+t.drop();
+t.ensureIndex( { a : 1 } );
+t.insert( { a : 5 } );
+go( { a : 5 } , { _id : 0 , a : 1 } , 1 , true );
+t.update( { a : 5 } , { $set : { a : [ 6 ] } } );
+assert.eq( [ { a : [ 6 ] } ] , t.find( { a : 6 } , { _id : 0 , a : 1 } ).toArray() );
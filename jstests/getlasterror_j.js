@@ -0,0 +1,22 @@
+// getLastError j:true waits for the next group commit of the data files
+
+t = db.getlasterror_j;
+t.drop();
+
+t.insert( { x : 1 } );
+res = db.runCommand( { getlasterror : 1 , j : true } );
+assert( res.ok , "A " + tojson( res ) );
+assert.isnull( res.err , "B" );
+assert( res.jwait >= 0 , "C " + tojson( res ) );
+assert.isnull( res.fsyncFiles , "C2 " + tojson( res ) );
+
+// repeated requests, each covered by a later flush
+last = res.syncs;
+for ( i=0; i<20; i++ ){
+    t.insert( { x : i } );
+    res = db.runCommand( { getlasterror : 1 , j : true } );
+    assert( res.ok , "D" );
+    assert.lt( last , res.syncs , "E " + tojson( res ) );
+    last = res.syncs;
+}
+assert.eq( 21 , t.count() , "F" );
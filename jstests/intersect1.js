@@ -0,0 +1,29 @@
+t = db.jstests_intersect1;
+t.drop();
+
+t.ensureIndex( {status:1} );
+t.ensureIndex( {region:1} );
+
+for( i = 0; i < 1000; ++i ) {
+    t.save( {status:( i % 10 == 0 ? "open" : "closed" ), region:i % 7} );
+}
+
+q = {status:"open",region:3};
+assert.eq.automsg( "15", "t.find( q ).itcount()" );
+assert.eq.automsg( "15", "t.count( q )" );
+
+e = t.find( q ).explain();
+assert.eq.automsg( "'IntersectCursor BtreeCursor status_1, BtreeCursor region_1'", "e.cursor" );
+assert.eq.automsg( "15", "e.n" );
+assert.eq.automsg( "4", "e.allPlans.length" );
+
+// the intersection plan is cached like any other
+assert.eq.automsg( "15", "t.find( q ).itcount()" );
+assert.eq.automsg( "'IntersectCursor BtreeCursor status_1, BtreeCursor region_1'", "t.find( q ).explain().cursor" );
+
+// records removed during a scan
+t.find( q ).forEach( function( o ) { t.remove( {_id:o._id} ); } );
+assert.eq.automsg( "0", "t.find( q ).itcount()" );
+
+// no intersection with a sort
+assert( !/^IntersectCursor/.test( t.find( q ).sort( {status:1} ).explain().cursor ) );
@@ -0,0 +1,16 @@
+// per database lock accounting in serverStatus
+
+t = db.lockstats1;
+t.drop();
+
+before = db._adminCommand( "serverStatus" ).locks[ db.getName() ];
+
+for ( i=0; i<10; i++ )
+    t.insert( { x : i } );
+assert.eq( 10 , t.find().itcount() , "A" );
+
+after = db._adminCommand( "serverStatus" ).locks[ db.getName() ];
+assert( after , "no lock stats for " + db.getName() );
+assert( after.w.acquireCount >= ( before ? before.w.acquireCount : 0 ) + 10 , "writes not counted: " + tojson( after ) );
+assert( after.r.acquireCount > ( before ? before.r.acquireCount : 0 ) , "reads not counted: " + tojson( after ) );
+assert( after.w.timeLockedMicros >= 0 , "B" );
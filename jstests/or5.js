@@ -0,0 +1,38 @@
+t = db.jstests_or5;
+t.drop();
+
+t.ensureIndex( {a:1} );
+t.ensureIndex( {b:1} );
+
+for( i = 0; i < 100; ++i ) {
+    t.save( {a:i,b:i%10} );
+}
+
+// second clause only needs to scan (50,60]
+q = {$or:[{a:{$gte:10,$lte:50}},{a:{$gte:40,$lte:60}}]};
+assert.eq.automsg( "51", "t.find( q ).itcount()" );
+assert.eq.automsg( "51", "t.count( q )" );
+assert.lt.automsg( "t.find( q ).explain().nscanned", "60" );
+
+// second clause covered entirely by the first
+q = {$or:[{a:{$gte:10,$lte:50}},{a:{$in:[10,20,30]}}]};
+assert.eq.automsg( "41", "t.find( q ).itcount()" );
+assert.lt.automsg( "t.find( q ).explain().nscanned", "44" );
+
+// overlapping clauses on different indexes
+q = {$or:[{a:{$lt:5}},{b:1},{a:{$in:[1,2,3,4,5,6]}}]};
+assert.eq.automsg( "16", "t.find( q ).itcount()" );
+assert.eq.automsg( "16", "t.count( q )" );
+
+// narrowed on one field when the others are within the earlier clause
+q = {$or:[{a:{$lte:50},b:1},{a:{$gte:0,$lte:90},b:1}]};
+assert.eq.automsg( "9", "t.find( q ).itcount()" );
+
+// string ranges aren't exact, so nothing may be skipped
+t.save( {a:'a'} );
+t.save( {a:'b'} );
+t.save( {a:{}} );
+q = {$or:[{a:{$gt:'a'}},{a:{$gte:'a'}}]};
+assert.eq.automsg( "2", "t.find( q ).itcount()" );
+q = {$or:[{a:{$gte:'a',$lt:'b'}},{a:{$gte:'a',$lte:'b'}}]};
+assert.eq.automsg( "2", "t.find( q ).itcount()" );
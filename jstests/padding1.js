@@ -0,0 +1,28 @@
+// growing documents raise the collection's padding, so later documents stop moving
+
+t = db.jstests_padding1;
+t.drop();
+
+t.ensureIndex( {a:1} );
+for( i = 0; i < 1000; ++i ) {
+    t.save( {_id:i,a:i,c:[]} );
+}
+assert.eq.automsg( "1", "t.stats().paddingFactor" );
+assert.eq.automsg( "0", "t.stats().updateMoves" );
+
+for( i = 0; i < 1000; ++i ) {
+    t.update( {_id:i}, {$push:{c:"abcdefghijklmnopqrstuvwxyz"}} );
+}
+assert.lt.automsg( "0", "t.stats().updateMoves" );
+assert.lt.automsg( "1", "t.stats().paddingFactor" );
+
+// new documents are allocated with room for the same growth
+moves = t.stats().updateMoves;
+for( i = 1000; i < 2000; ++i ) {
+    t.save( {_id:i,a:i,c:[]} );
+}
+for( i = 1000; i < 2000; ++i ) {
+    t.update( {_id:i}, {$push:{c:"abcdefghijklmnopqrstuvwxyz"}} );
+}
+assert.gt.automsg( "500", "t.stats().updateMoves - moves" );
+assert.eq.automsg( "2000", "t.find( {c:'abcdefghijklmnopqrstuvwxyz'} ).itcount()" );
@@ -0,0 +1,53 @@
+// planCache command
+
+t = db.plancache1;
+t.drop();
+
+t.ensureIndex( { a : 1 } );
+t.ensureIndex( { b : 1 } );
+for ( i=0; i<100; i++ )
+    t.insert( { a : i , b : i % 10 } );
+
+function shapes(){
+    var res = db.runCommand( { planCache : t.getName() } );
+    assert( res.ok , tojson( res ) );
+    return res.shapes;
+}
+
+function ab(){
+    var s = shapes();
+    for ( var i=0; i<s.length; i++ )
+        if ( friendlyEqual( { a : "equality" , b : "equality" } , s[i].pattern.fields ) )
+            return s[i];
+    return null;
+}
+
+assert.eq( 0 , shapes().length , "A" );
+
+t.find( { a : 5 , b : 5 } ).toArray();
+s = shapes();
+assert.eq( 1 , s.length , "B1" );
+assert( ab() , "B2" );
+assert.eq( { a : 1 } , s[0].indexKey , "B3" );
+assert.eq( 0 , s[0].runs , "B4" );
+
+// later runs of the cached plan are recorded
+t.find( { a : 6 , b : 6 } ).toArray();
+t.find( { a : 7 , b : 7 } ).toArray();
+assert.eq( 2 , ab().runs , "C" );
+
+// a few writes don't throw it away
+for ( i=0; i<20; i++ )
+    t.update( { a : i } , { $inc : { c : 1 } } );
+assert( ab() , "D" );
+
+assert( db.runCommand( { planCache : t.getName() , clear : true } ).ok , "E1" );
+assert.eq( 0 , shapes().length , "E2" );
+
+// an index change does
+t.find( { a : 5 , b : 5 } ).toArray();
+assert.eq( 1 , shapes().length , "F1" );
+t.ensureIndex( { c : 1 } );
+assert.eq( 0 , shapes().length , "F2" );
+
+assert( ! db.runCommand( { planCache : "plancache1_missing" } ).ok , "G" );
@@ -0,0 +1,34 @@
+// records in a usePowerOf2Sizes collection are reused from the free lists without fragmenting
+
+t = db.jstests_powerof2;
+t.drop();
+
+db.createCollection( t.getName(), {usePowerOf2Sizes:true} );
+assert( t.stats().usePowerOf2Sizes );
+
+for( i = 0; i < 100; ++i ) {
+    t.save( {_id:i,s:new Array( 1 + i * 10 ).toString()} );
+}
+t.remove( {_id:{$mod:[2,0]}} );
+assert.eq.automsg( "50", "t.count()" );
+assert.lt.automsg( "0", "t.stats().deletedCount" );
+
+// objects of varying size reuse the freed slots
+before = t.stats().deletedCount;
+for( i = 0; i < 100; i += 2 ) {
+    t.save( {_id:i,s:new Array( 1 + i * 10 ).toString()} );
+}
+assert.eq.automsg( "100", "t.count()" );
+assert.gt.automsg( "before", "t.stats().deletedCount" );
+assert( t.stats().fragmentation >= 0 );
+assert.lt.automsg( "t.stats().fragmentation", "1" );
+
+// collMod toggles the setting
+res = db.runCommand( {collMod:t.getName(), usePowerOf2Sizes:false} );
+assert( res.ok );
+assert( res.usePowerOf2Sizes_old );
+assert( !res.usePowerOf2Sizes_new );
+assert( !t.stats().usePowerOf2Sizes );
+
+assert( !db.runCommand( {collMod:"jstests_powerof2_missing", usePowerOf2Sizes:true} ).ok );
+assert( !db.runCommand( {collMod:t.getName()} ).ok );
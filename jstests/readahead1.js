@@ -0,0 +1,20 @@
+// read ahead for table scans is reported in serverStatus
+
+t = db.readahead1;
+t.drop();
+
+for ( i=0; i<100; i++ )
+    t.insert( { x : i } );
+
+before = db._adminCommand( "serverStatus" ).readAhead;
+assert( before , "no readAhead section" );
+
+assert.eq( 100 , t.find().itcount() , "A" );
+assert.eq( 100 , t.find().sort( { $natural : -1 } ).itcount() , "B" );
+
+after = db._adminCommand( "serverStatus" ).readAhead;
+assert( after.advised > before.advised , "scan not advised: " + tojson( after ) );
+assert( after.bytes > before.bytes , "C" );
+
+// the whole collection is in one extent: each scan advises it once, not once per record near its end
+assert( after.advised - before.advised <= 4 , "advised too often: " + tojson( before ) + " " + tojson( after ) );
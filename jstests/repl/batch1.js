@@ -0,0 +1,35 @@
+// Test that a slave applies oplog entries in batches, in order
+
+var baseName = "jstests_repl_batch1test";
+
+rt = new ReplTest( "batch1tests" );
+
+m = rt.start( true );
+s = rt.start( false );
+
+am = m.getDB( baseName ).a;
+am.save( { _id: 0, n: 0 } );
+assert.soon( function() { return s.getDB( baseName ).a.find().count() == 1; } );
+
+// lots of small ops, several of them on the same document
+for( i = 1; i < 3000; ++i ) {
+    am.save( { _id: i, n: 0 } );
+    am.update( { _id: i % 10 }, { $inc: { n: 1 } } );
+}
+am.remove( { _id: 5 } );
+m.getDB( baseName ).getLastError();
+
+as = s.getDB( baseName ).a;
+assert.soon( function() { return as.find().count() == 2999; } );
+assert.soon( function() { return as.findOne( { _id: 9 } ).n == 300; } );
+assert.eq( 300, as.findOne( { _id: 1 } ).n );
+assert.eq( 299, as.findOne( { _id: 0 } ).n );
+assert.isnull( as.findOne( { _id: 5 } ) );
+
+stats = s.getDB( "admin" ).runCommand( { serverStatus: 1 } ).replApplyBatchStats;
+assert( stats, "no replApplyBatchStats" );
+assert.lte( 6000, stats.ops );
+assert.lt( 0, stats.batches );
+assert.lte( stats.largest_ops, 1000 );
+
+rt.stop();
@@ -0,0 +1,35 @@
+// Test that a slave started with --replcompress replicates over compressed replies
+
+var baseName = "jstests_repl_compress1test";
+
+rt = new ReplTest( "compress1tests" );
+
+m = rt.start( true );
+s = rt.start( false, { replcompress: null } );
+
+am = m.getDB( baseName ).a;
+am.save( { _id: -1 } );
+assert.soon( function() { return s.getDB( baseName ).a.find().count() == 1; } );
+
+for( i = 0; i < 5000; ++i )
+    am.save( { _id: i, name: "name" + i, description: "the same text in every document" } );
+m.getDB( baseName ).getLastError();
+
+as = s.getDB( baseName ).a;
+assert.soon( function() { return as.find().count() == 5001; } );
+assert.eq( "name4999", as.findOne( { _id: 4999 } ).name );
+
+sent = m.getDB( "admin" ).runCommand( { serverStatus: 1 } ).compression.sent;
+assert.lt( 0, sent.messages );
+assert.lt( sent.compressedBytes, sent.bytes );
+
+received = s.getDB( "admin" ).runCommand( { serverStatus: 1 } ).compression.received;
+assert.lt( 0, received.messages );
+assert.lt( received.compressedBytes, received.bytes );
+
+// the command on its own
+assert.commandWorked( m.getDB( "admin" ).runCommand( { setCompression: "none" } ) );
+assert( !m.getDB( "admin" ).runCommand( { setCompression: "zip" } ).ok );
+assert( !m.getDB( "test" ).runCommand( { setCompression: "none" } ).ok ); // admin only
+
+rt.stop();
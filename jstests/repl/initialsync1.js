@@ -0,0 +1,43 @@
+// Test that an initial sync of several collections, read ahead over connections of their own
+// with _id indexes built after the copy, gives the slave the master's data and indexes
+
+var baseName = "jstests_repl_initialsync1test";
+
+rt = new ReplTest( "initialsync1tests" );
+
+m = rt.start( true );
+md = m.getDB( baseName );
+
+for( c = 0; c < 6; ++c ) {
+    mc = md[ "c" + c ];
+    mc.ensureIndex( { b: 1 } );
+    for( i = 0; i < 2000; ++i )
+        mc.save( { _id: i, b: i % 7, s: "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx" } );
+}
+md.createCollection( "capped", { capped: true, size: 100000 } );
+md.capped.save( { a: 1 } );
+md.getLastError();
+
+s = rt.start( false );
+sd = s.getDB( baseName );
+
+// written while the slave is (probably) still cloning; replayed from the oplog afterwards
+for( c = 0; c < 6; ++c ) {
+    md[ "c" + c ].update( { _id: 5 }, { $set: { b: 100 } } );
+    md[ "c" + c ].remove( { _id: 6 } );
+}
+md.getLastError();
+
+assert.soon( function() { return sd.c5.find( { b: 100 } ).count() == 1; } );
+for( c = 0; c < 6; ++c ) {
+    mc = md[ "c" + c ];
+    sc = sd[ "c" + c ];
+    assert.soon( function() { return sc.find().count() == 1999; } );
+    assert.eq( mc.find().sort( { _id: 1 } ).toArray(), sc.find().sort( { _id: 1 } ).toArray() );
+    assert.eq( 2, sc.getIndexes().length, "indexes on " + sc );
+    assert.eq( 1, sc.find( { _id: 5 } ).hint( { _id: 1 } ).itcount() );
+    assert.eq( 286, sc.find( { b: 3 } ).hint( { b: 1 } ).itcount() );
+}
+assert.eq( 1, sd.capped.find().count() );
+
+rt.stop();
@@ -0,0 +1,43 @@
+// Test that prefetching documents and index keys ahead of applying master ops doesn't
+// change what the slave ends up with
+
+var baseName = "jstests_repl_prefetch1test";
+
+doTest = function( slaveOptions ) {
+
+    rt = new ReplTest( "prefetch1tests" );
+
+    m = rt.start( true );
+    s = rt.start( false, slaveOptions );
+
+    am = m.getDB( baseName ).a;
+    am.ensureIndex( { b: 1 } );
+    am.ensureIndex( { c: 1 } );
+    am.save( { _id: -1 } );
+    assert.soon( function() { return s.getDB( baseName ).a.find().count() == 1; } );
+
+    for( i = 0; i < 1000; ++i )
+        am.save( { _id: i, b: i, c: [ i, -i ] } );
+    am.update( { _id: { $gte: 500 } }, { $inc: { b: 1000 } }, false, true );
+    for( i = 0; i < 1000; i += 3 )
+        am.remove( { _id: i } );
+    am.update( { _id: 1 }, { $set: { c: "x" } } );
+    am.update( { b: 7 }, { $unset: { b: 1 } } ); // o2 is _id even though the query wasn't
+    m.getDB( baseName ).getLastError();
+
+    as = s.getDB( baseName ).a;
+    assert.soon( function() { return as.find().count() == am.find().count(); } );
+    assert.soon( function() { return as.findOne( { _id: 7 } ).b == null; } );
+    assert.eq( am.find().sort( { _id: 1 } ).toArray(), as.find().sort( { _id: 1 } ).toArray() );
+    assert.eq( 333, as.find( { b: { $gte: 1500 } } ).count() );
+    assert.eq( 1, as.find( { c: "x" } ).count() );
+    assert.eq( 0, as.find( { c: -3 } ).count() );
+
+    stats = s.getDB( "admin" ).runCommand( { serverStatus: 1 } ).replApplyBatchStats;
+    assert( stats.prefetch_ms != null, "no prefetch_ms" );
+
+    rt.stop();
+}
+
+doTest( {} );
+doTest( { noprefetch: null } );
@@ -0,0 +1,46 @@
+// a master handling connections with an event loop and a few worker threads, replicated from
+// as usual -- the slave's tailing getMore waits on a worker
+
+var baseName = "jstests_repl_workers1test";
+
+rt = new ReplTest( "workers1tests" );
+
+m = rt.start( true , { workers : 2 } );
+s = rt.start( false );
+
+// more connections than workers, used in turn
+conns = [];
+for ( i=0; i<6; i++ )
+    conns.push( new Mongo( "127.0.0.1:" + rt.getPort( true ) ) );
+
+for ( j=0; j<5; j++ ){
+    for ( i=0; i<conns.length; i++ ){
+        db = conns[i].getDB( baseName );
+        db.a.insert( { _id : i * 10 + j } );
+        assert.isnull( db.getLastError() , "gle " + i + " " + j );
+    }
+}
+assert.eq( 30 , conns[2].getDB( baseName ).a.count() , "count" );
+
+// getLastError is per connection, whichever thread handles it
+for ( i=0; i<conns.length; i++ ){
+    db = conns[i].getDB( baseName );
+    db.a.insert( { _id : i * 10 } );
+    conns[ ( i + 1 ) % conns.length ].getDB( baseName ).a.findOne();
+    assert( db.getLastError() , "dup " + i );
+}
+
+// a cursor opened on one thread is read on others
+c = conns[0].getDB( baseName ).a.find().batchSize( 2 );
+n = 0;
+while ( c.hasNext() ) {
+    c.next();
+    n++;
+    conns[1].getDB( baseName ).a.findOne();
+}
+assert.eq( 30 , n , "getMore" );
+
+sd = s.getDB( baseName );
+assert.soon( function() { return sd.a.find().count() == 30; } );
+
+rt.stop();
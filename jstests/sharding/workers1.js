@@ -0,0 +1,46 @@
+// mongos handling connections with an event loop and a few worker threads
+
+s = new ShardingTest( "workers1" , 2 , 0 , 1 );
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+
+m = startMongos( { port : 30999 , configdb : s._configDB , workers : 2 } );
+
+// more connections than workers, used in turn
+conns = [];
+for ( i=0; i<10; i++ )
+    conns.push( new Mongo( "localhost:30999" ) );
+
+for ( j=0; j<5; j++ ){
+    for ( i=0; i<conns.length; i++ ){
+        db = conns[i].getDB( "test" );
+        db.foo.insert( { _id : i * 10 + j , num : i * 10 + j } );
+        assert.isnull( db.getLastError() , "gle " + i + " " + j );
+    }
+}
+assert.eq( 50 , conns[3].getDB( "test" ).foo.count() , "count" );
+
+// getLastError goes to the connection the write went to, whichever thread handles it
+for ( i=0; i<conns.length; i++ ){
+    db = conns[i].getDB( "test" );
+    db.foo.insert( { _id : i * 10 , num : i * 10 } );
+    conns[ ( i + 1 ) % conns.length ].getDB( "test" ).foo.findOne();
+    assert( db.getLastError() , "dup " + i );
+}
+
+// a big message is read in pieces
+big = "";
+while ( big.length < 1024 * 1024 )
+    big += "0123456789abcdef";
+db = conns[0].getDB( "test" );
+db.foo.insert( { _id : 1000 , num : 1000 , big : big } );
+assert.isnull( db.getLastError() , "big" );
+assert.eq( big.length , db.foo.findOne( { _id : 1000 } ).big.length , "big read" );
+
+// closed connections go away, new ones still work
+conns = null;
+gc();
+assert.eq( 51 , new Mongo( "localhost:30999" ).getDB( "test" ).foo.count() , "after close" );
+
+stopMongoProgram( 30999 );
+s.stop();
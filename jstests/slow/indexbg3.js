@@ -0,0 +1,86 @@
+// Test background unique index creation when a key moves to a new document while building:
+// the new document is inserted before the old one is removed
+
+parallel = function() {
+    return db[ baseName + "_parallelStatus" ];
+}
+
+resetParallel = function() {
+    parallel().drop();
+}
+
+doParallel = function( work ) {
+    resetParallel();
+    startMongoProgramNoConnect( "mongo", "--eval", work + "; db." + baseName + "_parallelStatus.save( {done:1} );", db.getMongo().host );
+}
+
+doneParallel = function() {
+    return !!parallel().findOne();
+}
+
+waitParallel = function() {
+    assert.soon( function() { return doneParallel(); }, "parallel did not finish in time", 300000, 1000 );
+}
+
+doTest = function(dropDups) {
+
+    size = 10000;
+    while (1) { // if indexing finishes before we can run checks, try indexing w/ more data
+        print("size: " + size);
+        baseName = "jstests_indexbg3";
+        fullName = "db." + baseName;
+        t = db[baseName];
+        t.drop();
+
+        db.eval(function(size) {
+            for (i = 0; i < size; ++i) {
+                db.jstests_indexbg3.save({ i: i });
+            }
+        },
+            size);
+        assert.eq(size, t.count());
+
+        doParallel(fullName + ".ensureIndex( {i:1}, {background:true, unique:true, dropDups:" + dropDups + "} )");
+        try {
+            // wait for indexing to start
+            assert.soon(function() { return 2 == db.system.indexes.count({ ns: "test." + baseName }) }, "no index created", 30000, 50);
+            // a duplicate key error means the index was already built
+            for (j = 0; j < 10; ++j) {
+                t.save({ i: j, n: true });
+                assert.isnull(db.getLastError());
+                t.remove({ i: j, n: { $exists: false } });
+            }
+            t.save({ i: size - 1, n: true });
+            assert.isnull(db.getLastError());
+            t.remove({ i: size - 1, n: { $exists: false } });
+            db.getLastError();
+        } catch (e) {
+            // only a failure if we're still indexing
+            // wait for parallel status to update to reflect indexing status
+            sleep(1000);
+            if (!doneParallel()) {
+                throw e;
+            }
+        }
+        if (!doneParallel()) {
+            break;
+        }
+        print("indexing finished too soon, retrying...");
+        size *= 2;
+        assert(size < 5000000, "unable to run checks in parallel with index creation");
+    }
+
+    waitParallel();
+
+    // no duplicates were left, so the index builds and keeps the new documents
+    assert.eq(2, t.getIndexes().length, "index not built");
+    assert.eq(size, t.count(), "count");
+    assert.eq(size, t.find().hint({ i: 1 }).itcount(), "index count");
+    assert.eq(11, t.find({ n: true }).count(), "new documents");
+    for (j = 0; j < 10; ++j)
+        assert(t.findOne({ i: j }).n, "document " + j);
+    assert(t.findOne({ i: size - 1 }).n, "last document");
+}
+
+doTest( "false" );
+doTest( "true" );
@@ -0,0 +1,36 @@
+// sorts with no index: a bounded heap for limits, spilling to disk when the keys don't fit in memory
+
+t = db.sort7;
+t.drop();
+
+big = "";
+while ( big.length < 200 )
+    big += "x";
+
+N = 10000; // ~2MB of keys, over ScanAndOrder's in memory limit
+for ( i=0; i<N; i++ ){
+    t.insert( { _id : i , a : ( i * 7 ) % N , s : big + ( ( i * 7 ) % N ) } );
+}
+db.getLastError();
+
+// limit: only the best few are kept
+a = t.find().sort( { a : -1 } ).limit( 5 ).toArray();
+assert.eq( 5 , a.length , "A1" );
+for ( i=0; i<5; i++ )
+    assert.eq( N - 1 - i , a[i].a , "A2 " + i );
+
+a = t.find().sort( { a : 1 } ).skip( 10 ).limit( 3 ).toArray();
+assert.eq( [ 10 , 11 , 12 ] , a.map( function(z){ return z.a; } ) , "B" );
+
+// no limit, big keys: spills to disk rather than failing
+a = t.find( {} , { _id : 0 , a : 1 } ).sort( { s : 1 } ).skip( N - 20 ).toArray();
+assert.eq( 20 , a.length , "C1" );
+for ( i=1; i<a.length; i++ )
+    assert.lt( big + a[i-1].a , big + a[i].a , "C2 " + i );
+
+assert.eq( N , t.find().sort( { s : -1 } ).explain().n , "D" );
+
+// $diskLoc comes from the kept DiskLoc
+a = t.find().sort( { a : 1 } ).limit( 2 ).showDiskLoc().toArray();
+assert( a[0].$diskLoc , "E1" );
+assert.eq( 1 , a[1].a , "E2" );
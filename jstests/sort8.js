@@ -0,0 +1,46 @@
+// sorts with no index whose results are more than one reply holds come back through a cursor
+
+t = db.sort8;
+t.drop();
+
+big = "";
+while ( big.length < 1000 )
+    big += "x";
+
+N = 6000; // ~6MB of documents, over the 4MB a reply takes
+for ( i=0; i<N; i++ ){
+    t.insert( { _id : i , a : ( i * 7 ) % N , s : big + ( ( i * 7 ) % N ) } );
+}
+db.getLastError();
+
+function check( a , n , first , msg ){
+    assert.eq( n , a.length , msg + " length" );
+    for ( i=0; i<a.length; i++ )
+        assert.eq( first + i , a[i].a , msg + " " + i );
+}
+
+// small keys, sorted in memory
+check( t.find().sort( { a : 1 } ).toArray() , N , 0 , "A" );
+check( t.find().sort( { a : 1 } ).skip( 100 ).limit( 5000 ).toArray() , 5000 , 100 , "B" );
+check( t.find().sort( { a : 1 } ).batchSize( 1000 ).toArray() , N , 0 , "C" );
+
+// big keys, spilled to disk
+a = t.find().sort( { s : 1 } ).toArray();
+assert.eq( N , a.length , "D1" );
+for ( i=1; i<a.length; i++ )
+    assert.lt( a[i-1].s , a[i].s , "D2 " + i );
+a = t.find( {} , { _id : 0 , a : 1 } ).sort( { s : -1 } ).limit( 5500 ).toArray();
+assert.eq( 5500 , a.length , "E1" );
+assert.isnull( a[5000]._id , "E2" );
+
+// the rest of the results don't go away with their documents
+c = t.find().sort( { a : 1 } );
+for ( i=0; i<10; i++ )
+    c.next();
+t.remove( {} );
+n = 10;
+while ( c.hasNext() ) {
+    assert.eq( n , c.next().a , "F " + n );
+    n++;
+}
+assert.eq( N , n , "F" );
@@ -56,6 +56,7 @@ namespace mongo {
         out() << " -v+  verbose 1: general 2: more 3: per request 4: more\n";
         out() << " --port <portno>\n";
         out() << " --configdb <configdbname>,[<configdbname>,<configdbname>]\n";
+        out() << " --workers <n>  handle connections on n threads (linux)\n";
         out() << endl;
     }
 
@@ -71,10 +72,12 @@ namespace mongo {
     
     class ShardedMessageHandler : public MessageHandler {
     public:
+        ShardedMessageHandler() : _mutex( "ShardedMessageHandler" ){}
         virtual ~ShardedMessageHandler(){}
 
         virtual void process( Message& m , AbstractMessagingPort* p ){
             assert( p );
+            ThreadConnections tc( *this , p );
             Request r( m , p );
 
             LastError * le = lastError.startRequest( m , r.getClientId() );
@@ -102,7 +105,47 @@ namespace mongo {
         virtual void disconnected( AbstractMessagingPort* p ){
             ClientInfo::disconnect( p->getClientId() );
             lastError.disconnect( p->getClientId() );
+
+            ClientConnections * cc = 0;
+            {
+                scoped_lock lk( _mutex );
+                map<AbstractMessagingPort*,ClientConnections*>::iterator i = _connections.find( p );
+                if ( i != _connections.end() ){
+                    cc = i->second;
+                    _connections.erase( i );
+                }
+            }
+            ShardConnection::deleteConnections( cc );
         }
+
+    private:
+        class ThreadConnections;
+        friend class ThreadConnections;
+
+        /* a client's shard connections go with it, as its next request may be handled on another
+           thread, and getLastError has to go to the connections its writes went to */
+        class ThreadConnections : boost::noncopyable {
+        public:
+            ThreadConnections( ShardedMessageHandler& h , AbstractMessagingPort* p ) : _h( h ) , _p( p ){
+                ClientConnections * cc;
+                {
+                    scoped_lock lk( _h._mutex );
+                    cc = _h._connections[p];
+                }
+                ShardConnection::attachThreadConnections( cc );
+            }
+            ~ThreadConnections(){
+                ClientConnections * cc = ShardConnection::releaseThreadConnections();
+                scoped_lock lk( _h._mutex );
+                _h._connections[_p] = cc;
+            }
+        private:
+            ShardedMessageHandler& _h;
+            AbstractMessagingPort* _p;
+        };
+
+        mongo::mutex _mutex;
+        map<AbstractMessagingPort*,ClientConnections*> _connections;
     };
 
     void sighandler(int sig){
@@ -168,6 +211,7 @@ int main(int argc, char* argv[], char *envp[] ) {
         ( "test" , "just run unit tests" )
         ( "upgrade" , "upgrade meta data version" )
         ( "chunkSize" , po::value<int>(), "maximum amount of data per chunk" )
+        ( "workers" , po::value<int>(), "handle connections with an event loop and this many threads instead of a thread each (linux)" )
         ;
     
 
@@ -264,6 +308,8 @@ int main(int argc, char* argv[], char *envp[] ) {
     MessageServer::Options opts;
     opts.port = cmdLine.port;
     opts.ipList = params["bind_ip"].as<string>();
+    if ( params.count( "workers" ) )
+        opts.workers = params["workers"].as<int>();
     start(opts);
 
     dbexit( EXIT_CLEAN );
@@ -24,6 +24,7 @@
 namespace mongo {
 
     class ShardConnection;
+    class ClientConnections;
     class ShardStatus;
 
     class Shard {
@@ -193,6 +194,13 @@ namespace mongo {
         }
 
         static void sync();
+
+        /* a client's connections follow it when its requests are handled on different threads 
+           (MessageServer::Options::workers).  release the calling thread's connections after a
+           request, attach them before the next one, and delete them once the client is gone. */
+        static ClientConnections * releaseThreadConnections();
+        static void attachThreadConnections( ClientConnections * cc );
+        static void deleteConnections( ClientConnections * cc );
         
     private:
         void _init();
@@ -184,6 +184,18 @@ namespace mongo {
         ClientConnections::get()->sync();
     }
 
+    ClientConnections * ShardConnection::releaseThreadConnections(){
+        return ClientConnections::_perThread.release();
+    }
+
+    void ShardConnection::attachThreadConnections( ClientConnections * cc ){
+        ClientConnections::_perThread.reset( cc ); // deletes any the thread had
+    }
+
+    void ShardConnection::deleteConnections( ClientConnections * cc ){
+        delete cc;
+    }
+
     ShardConnection::~ShardConnection() {
         if ( _conn ){
             if ( ! _conn->isFailed() ) {
@@ -0,0 +1,169 @@
+// util/compress.cpp
+
+/*    Copyright 2009 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "pch.h"
+#include "compress.h"
+#include "../db/jsobj.h"
+
+namespace mongo {
+    namespace lz {
+
+        typedef unsigned char byte;
+
+        enum { MinMatch = 4,
+               HashLog = 12,
+               MaxOffset = 65535,
+               LastLiterals = 5 // a block always ends with at least this many literals
+        };
+
+        inline unsigned hash4( const byte *p ) {
+            unsigned v;
+            memcpy( &v, p, 4 );
+            return ( v * 2654435761U ) >> ( 32 - HashLog );
+        }
+
+        inline byte* putLength( byte *op, int len ) {
+            for( ; len >= 255; len -= 255 )
+                *op++ = 255;
+            *op++ = (byte) len;
+            return op;
+        }
+
+        /* literals, then (unless last) a match of matchLen at offset back */
+        inline byte* putSequence( byte *op, const byte *lit, int litLen, int offset, int matchLen, bool last ) {
+            byte *token = op++;
+            int m = matchLen - MinMatch;
+            *token = (byte) ( ( litLen < 15 ? litLen : 15 ) << 4 );
+            if ( litLen >= 15 )
+                op = putLength( op, litLen - 15 );
+            memcpy( op, lit, litLen );
+            op += litLen;
+            if ( last )
+                return op;
+            *token |= (byte) ( m < 15 ? m : 15 );
+            *op++ = (byte) ( offset & 0xff );
+            *op++ = (byte) ( offset >> 8 );
+            if ( m >= 15 )
+                op = putLength( op, m - 15 );
+            return op;
+        }
+
+        int compress( const char *in, int len, char *out ) {
+            const byte *base = (const byte *) in;
+            const byte *ip = base;
+            const byte *anchor = base;
+            const byte *end = base + len;
+            const byte *matchLimit = end - LastLiterals;
+            byte *op = (byte *) out;
+
+            int table[ 1 << HashLog ];
+            for( int i = 0; i < ( 1 << HashLog ); i++ )
+                table[ i ] = -1;
+
+            while( len >= MinMatch + LastLiterals && ip + MinMatch <= matchLimit ) {
+                unsigned h = hash4( ip );
+                int ref = table[ h ];
+                table[ h ] = ip - base;
+                if ( ref < 0 || ( ip - base ) - ref > MaxOffset || memcmp( base + ref, ip, MinMatch ) != 0 ) {
+                    ip++;
+                    continue;
+                }
+                const byte *m = base + ref;
+                int matchLen = MinMatch;
+                while( ip + matchLen < matchLimit && m[ matchLen ] == ip[ matchLen ] )
+                    matchLen++;
+                op = putSequence( op, anchor, ip - anchor, ip - m, matchLen, false );
+                ip += matchLen;
+                anchor = ip;
+            }
+            op = putSequence( op, anchor, end - anchor, 0, 0, true );
+            return op - (byte *) out;
+        }
+
+        /* a length extended by 255 bytes as in putLength.  false if in runs out */
+        inline bool getLength( const byte *&ip, const byte *end, int &len ) {
+            while( 1 ) {
+                if ( ip >= end )
+                    return false;
+                byte b = *ip++;
+                len += b;
+                if ( len < 0 )
+                    return false; // garbage
+                if ( b != 255 )
+                    return true;
+            }
+        }
+
+        bool uncompress( const char *in, int len, char *out, int outLen ) {
+            const byte *ip = (const byte *) in;
+            const byte *end = ip + len;
+            byte *op = (byte *) out;
+            byte *opEnd = op + outLen;
+
+            while( ip < end ) {
+                byte token = *ip++;
+                int litLen = token >> 4;
+                if ( litLen == 15 && !getLength( ip, end, litLen ) )
+                    return false;
+                if ( litLen > end - ip || litLen > opEnd - op )
+                    return false;
+                memcpy( op, ip, litLen );
+                ip += litLen;
+                op += litLen;
+                if ( ip == end )
+                    break; // the last sequence
+                if ( end - ip < 2 )
+                    return false;
+                int offset = ip[ 0 ] | ( ip[ 1 ] << 8 );
+                ip += 2;
+                int matchLen = token & 15;
+                if ( matchLen == 15 && !getLength( ip, end, matchLen ) )
+                    return false;
+                matchLen += MinMatch;
+                if ( offset == 0 || offset > op - (byte *) out || matchLen > opEnd - op )
+                    return false;
+                // may overlap what it writes, so byte by byte
+                const byte *m = op - offset;
+                for( int i = 0; i < matchLen; i++ )
+                    *op++ = *m++;
+            }
+            return op == opEnd;
+        }
+
+    }
+
+    void CompressionCounters::append( BSONObjBuilder& b ) {
+        scoped_lock lk( _mutex );
+        {
+            BSONObjBuilder s( b.subobjStart( "sent" ) );
+            s.appendNumber( "messages" , _sent );
+            s.appendNumber( "bytes" , _sentBytes );
+            s.appendNumber( "compressedBytes" , _sentCompressed );
+            s.done();
+        }
+        {
+            BSONObjBuilder r( b.subobjStart( "received" ) );
+            r.appendNumber( "messages" , _received );
+            r.appendNumber( "bytes" , _receivedBytes );
+            r.appendNumber( "compressedBytes" , _receivedCompressed );
+            r.done();
+        }
+    }
+
+    CompressionCounters globalCompressionCounters;
+
+}
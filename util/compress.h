@@ -0,0 +1,83 @@
+// util/compress.h
+
+/*    Copyright 2009 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include "concurrency/mutex.h"
+
+namespace mongo {
+
+    /* a small LZ77 block codec in the style of LZ4, for compressing replies on the wire
+       (see Message::compress()).  fast rather than tight -- what it's good at is the field
+       names and values that repeat from one document to the next in a reply.
+
+       a block is a series of sequences:
+         token        high 4 bits literal count, low 4 bits match length - 4.  15 means
+                      more follows: bytes added on while they are 255
+         literals
+         offset       2 bytes little endian, back from here.  the last sequence has none
+         match length bytes, if the token's low bits were 15
+    */
+    namespace lz {
+
+        /* most a block of len bytes can compress to */
+        inline int maxCompressedLength( int len ) {
+            return len + len / 255 + 16;
+        }
+
+        /* @return bytes written to out, which must have room for maxCompressedLength( len ) */
+        int compress( const char *in, int len, char *out );
+
+        /* @return false if in isn't a block that decompresses to exactly outLen bytes */
+        bool uncompress( const char *in, int len, char *out, int outLen );
+
+    }
+
+    /* messages through Message::compress() / uncompress(), for serverStatus */
+    class CompressionCounters {
+    public:
+        CompressionCounters() : _mutex("CompressionCounters"), _sent(), _sentBytes(), _sentCompressed(),
+                                _received(), _receivedBytes(), _receivedCompressed() { }
+
+        void sent( int bytes , int compressed ) {
+            scoped_lock lk( _mutex );
+            _sent++;
+            _sentBytes += bytes;
+            _sentCompressed += compressed;
+        }
+        void received( int bytes , int compressed ) {
+            scoped_lock lk( _mutex );
+            _received++;
+            _receivedBytes += bytes;
+            _receivedCompressed += compressed;
+        }
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        mongo::mutex _mutex;
+        long long _sent;
+        long long _sentBytes; // before compression
+        long long _sentCompressed;
+        long long _received;
+        long long _receivedBytes; // after decompression
+        long long _receivedCompressed;
+    };
+
+    extern CompressionCounters globalCompressionCounters;
+
+}
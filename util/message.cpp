@@ -23,6 +23,7 @@
 #include <time.h>
 #include "../util/goodies.h"
 #include "../util/background.h"
+#include "../util/compress.h"
 #include <fcntl.h>
 #include <errno.h>
 #include "../db/cmdline.h"
@@ -270,7 +271,7 @@ namespace mongo {
         ports.closeAll();
     }
 
-    MessagingPort::MessagingPort(int _sock, const SockAddr& _far) : sock(_sock), piggyBackData(0), farEnd(_far), _timeout() {
+    MessagingPort::MessagingPort(int _sock, const SockAddr& _far) : sock(_sock), piggyBackData(0), farEnd(_far), _timeout(), _acceptCompressed(false) {
         _logLevel = 0;
         ports.insert(this);
     }
@@ -281,6 +282,7 @@ namespace mongo {
         sock = -1;
         piggyBackData = 0;
         _timeout = timeout;
+        _acceptCompressed = false;
     }
 
     void MessagingPort::shutdown() {
@@ -364,25 +366,10 @@ namespace mongo {
             int lft = 4;
             recv( lenbuf, lft );
             
-            if ( len < 0 || len > 16000000 ) {
-                if ( len == -1 ) {
-                    // Endian check from the database, after connecting, to see what mode server is running in.
-                    unsigned foo = 0x10203040;
-                    send( (char *) &foo, 4, "endian" );
+            bool retry = false;
+            if ( ! checkLength( len , retry ) ) {
+                if ( retry )
                     goto again;
-                }
-                
-                if ( len == 542393671 ){
-                    // an http GET
-                    log(_logLevel) << "looks like you're trying to access db over http on native driver port.  please add 1000 for webserver" << endl;
-                    string msg = "You are trying to access MongoDB on the native driver port. For http diagnostic access, add 1000 to the port number\n";
-                    stringstream ss;
-                    ss << "HTTP/1.0 200 OK\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: " << msg.size() << "\r\n\r\n" << msg;
-                    string s = ss.str();
-                    send( s.c_str(), s.size(), "http" );
-                    return false;
-                }
-                log(_logLevel) << "bad recv() len: " << len << '\n';
                 return false;
             }
             
@@ -402,7 +389,7 @@ namespace mongo {
             recv( p, left );
             
             m.setData(md, true);
-            return true;
+            return unwrap(m);
 
         } catch ( const SocketException & ) {
             m.reset();
@@ -410,6 +397,115 @@ namespace mongo {
         }
     }
     
+    bool MessagingPort::unwrap( Message& m ) {
+        if ( m.operation() != dbCompressed )
+            return true;
+        if ( !_acceptCompressed ) {
+            log(_logLevel) << "compressed message from " << farEnd.toString() << " which wasn't asked to compress" << endl;
+            m.reset();
+            return false;
+        }
+        if ( !m.uncompress() ) {
+            log(_logLevel) << "bad compressed message from " << farEnd.toString() << endl;
+            m.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool MessagingPort::checkLength( int len , bool& again ) {
+        again = false;
+        if ( goodLength( len ) )
+            return true;
+
+        if ( len == -1 ) {
+            // Endian check from the database, after connecting, to see what mode server is running in.
+            unsigned foo = 0x10203040;
+            send( (char *) &foo, 4, "endian" );
+            again = true;
+            return false;
+        }
+        
+        if ( len == 542393671 ){
+            // an http GET
+            log(_logLevel) << "looks like you're trying to access db over http on native driver port.  please add 1000 for webserver" << endl;
+            string msg = "You are trying to access MongoDB on the native driver port. For http diagnostic access, add 1000 to the port number\n";
+            stringstream ss;
+            ss << "HTTP/1.0 200 OK\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: " << msg.size() << "\r\n\r\n" << msg;
+            string s = ss.str();
+            send( s.c_str(), s.size(), "http" );
+            return false;
+        }
+        log(_logLevel) << "bad recv() len: " << len << '\n';
+        return false;
+    }
+    
+    bool Message::compress( int minLen ) {
+        if ( empty() || operation() != opReply || header()->len < minLen )
+            return false;
+
+        // the body, in one piece
+        int len = header()->len;
+        char *src = (char *) _buf;
+        if ( src == 0 ) {
+            src = (char *) malloc( len );
+            char *p = src;
+            for( vector< pair< char *, int > >::const_iterator i = _data.begin(); i != _data.end(); ++i ) {
+                memcpy( p, i->first, i->second );
+                p += i->second;
+            }
+        }
+        int bodyLen = len - MsgDataHeaderSize;
+
+        const int prefix = MsgDataHeaderSize + 2 * sizeof( int );
+        MsgData *c = (MsgData *) malloc( prefix + lz::maxCompressedLength( bodyLen ) );
+        int n = lz::compress( src + MsgDataHeaderSize, bodyLen, ( (char *) c ) + prefix );
+        bool smaller = prefix + n < len;
+        if ( smaller ) {
+            c->len = prefix + n;
+            c->setOperation( dbCompressed );
+            int *ints = (int *) c->_data;
+            ints[ 0 ] = opReply;
+            ints[ 1 ] = bodyLen;
+            globalCompressionCounters.sent( len , c->len );
+        }
+        if ( src != (char *) _buf )
+            free( src );
+        if ( !smaller ) {
+            free( c );
+            return false;
+        }
+        reset();
+        _setData( c, true );
+        return true;
+    }
+
+    bool Message::uncompress() {
+        assert( operation() == dbCompressed );
+        MsgData *c = singleData();
+        const int prefix = MsgDataHeaderSize + 2 * sizeof( int );
+        if ( c->len < prefix )
+            return false;
+        int *ints = (int *) c->_data;
+        int op = ints[ 0 ];
+        int bodyLen = ints[ 1 ];
+        if ( op == dbCompressed || bodyLen < 0 || bodyLen > 16000000 )
+            return false;
+        MsgData *md = (MsgData *) malloc( MsgDataHeaderSize + bodyLen );
+        if ( !lz::uncompress( ( (char *) c ) + prefix, c->len - prefix, md->_data, bodyLen ) ) {
+            free( md );
+            return false;
+        }
+        md->len = MsgDataHeaderSize + bodyLen;
+        md->id = c->id;
+        md->responseTo = c->responseTo;
+        md->setOperation( op );
+        globalCompressionCounters.received( md->len , c->len );
+        reset();
+        _setData( md, true );
+        return true;
+    }
+
     void MessagingPort::reply(Message& received, Message& response) {
         say(/*received.from, */response, received.header()->id);
     }
@@ -100,6 +100,18 @@ namespace mongo {
 
         // recv len or throw SocketException
         void recv( char * data , int len );
+
+        /* checks a message length just read off the wire, answering an endian check (len -1) or an
+           http GET.  @return true if a message of len bytes follows.  otherwise the connection should
+           be closed, unless 'again' is set, in which case the next length should be read instead.
+        */
+        bool checkLength( int len , bool& again );
+        static bool goodLength( int len ) { return len >= 0 && len <= 16000000; }
+
+        /* for a message just read off this port: decompresses it if it came in as dbCompressed and
+           we asked for those.  @return false if it's bad or unasked for; the connection should be
+           closed then. */
+        bool unwrap( Message& m );
         
         int unsafe_recv( char *buf, int max );
     private:
@@ -109,6 +121,8 @@ namespace mongo {
         SockAddr farEnd;
         int _timeout;
         int _logLevel; // passed to log() when logging errors
+        bool _acceptCompressed; // dbCompressed messages are taken, not refused.  only set on a client
+                                // connection that asked for compressed replies, see replCompression()
 
         friend class PiggyBackData;
     };
@@ -125,7 +139,8 @@ namespace mongo {
         dbQuery = 2004,
         dbGetMore = 2005,
         dbDelete = 2006,
-        dbKillCursors = 2007
+        dbKillCursors = 2007,
+        dbCompressed = 2012 /* another message, compressed -- see Message::compress() */
     };
 
     bool doesOpGetAResponse( int op );
@@ -141,6 +156,7 @@ namespace mongo {
         case dbGetMore: return "getmore";
         case dbDelete: return "remove";
         case dbKillCursors: return "killcursors";
+        case dbCompressed: return "compressed";
         default: 
             PRINT(op);
             assert(0); 
@@ -312,6 +328,13 @@ namespace mongo {
             return _freeIt;
         }
 
+        /* replace a reply of at least minLen bytes with a dbCompressed message, if that comes
+           out smaller.  its body is the original operation, the original body's length, then
+           the body compressed with lz::compress().  @return true if compressed */
+        bool compress( int minLen );
+        /* the reverse, for a message that came in as dbCompressed.  @return false if it's bad */
+        bool uncompress();
+
         void send( MessagingPort &p, const char *context ) {
             if ( empty() ) {
                 return;
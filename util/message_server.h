@@ -26,6 +26,14 @@
 
 namespace mongo {
     
+    /* thrown by MessageHandler::process for a message that can't be answered yet, e.g. a getMore
+       waiting for data.  the server calls process with it again after millis; with an event loop, 
+       no thread is held meanwhile.  the connection's next message waits until it's answered. */
+    struct MessageDeferred {
+        MessageDeferred( int m ) : millis( m ) { }
+        int millis;
+    };
+
     class MessageHandler {
     public:
         virtual ~MessageHandler(){}
@@ -38,8 +46,10 @@ namespace mongo {
         struct Options {
             int port;                   // port to bind to
             string ipList;             // addresses to bind to
+            int workers;               // 0: a thread per connection.  otherwise an event loop reads
+                                       //    messages and this many threads handle them (linux only)
 
-            Options() : port(0), ipList(""){} 
+            Options() : port(0), ipList(""), workers(0){} 
         };
 
         virtual ~MessageServer(){}
@@ -23,6 +23,12 @@
 #include "message_server.h"
 
 #include "../db/cmdline.h"
+#include "concurrency/thread_pool.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
 namespace mongo {
 
@@ -54,7 +60,17 @@ namespace mongo {
                         break;
                     }
                     
-                    handler->process( m , p.get() );
+                    while ( 1 ) {
+                        try {
+                            handler->process( m , p.get() );
+                        }
+                        catch ( const MessageDeferred& d ) {
+                            // this thread is the connection's anyway
+                            sleepmillis( d.millis );
+                            continue;
+                        }
+                        break;
+                    }
                 }
             }
             catch ( const SocketException& ){
@@ -72,6 +88,228 @@ namespace mongo {
 
     }
 
+#if defined(__linux__)
+
+    /* reads the messages of every connection from one thread with epoll, and hands each complete one
+       to a pool of worker threads, which also write the replies.  so an idle connection costs its 
+       socket and a Conn rather than a thread.
+
+       a connection is out of the epoll set (EPOLLONESHOT) from when a message is complete until it
+       has been handled, so a client's messages are still handled one at a time, in order.  a message
+       that can't be answered yet (MessageDeferred) waits here, on a timer, rather than on a worker.
+
+       nothing on this thread may block on a connection: answers to lengths that aren't (an endian 
+       check, an http GET) are sent from a worker too.
+    */
+    class EventLoop : boost::noncopyable {
+    public:
+        EventLoop( MessageHandler * handler , int workers ) : _handler( handler ) , _workers( workers ) , 
+                                                              _deferredMutex( "EventLoop::deferred" ) {
+            _epfd = epoll_create( 1024 );
+            massert( 13291 , string( "epoll_create failed: " ) + errnoWithDescription() , _epfd >= 0 );
+            _wakefd = eventfd( 0 , EFD_NONBLOCK );
+            massert( 13305 , string( "eventfd failed: " ) + errnoWithDescription() , _wakefd >= 0 );
+            epoll_event e;
+            e.events = EPOLLIN;
+            e.data.ptr = 0; // not a Conn
+            massert( 13306 , string( "epoll_ctl failed: " ) + errnoWithDescription() , 
+                     epoll_ctl( _epfd , EPOLL_CTL_ADD , _wakefd , &e ) == 0 );
+            boost::thread thr( boost::bind( &EventLoop::run , this ) );
+        }
+
+        /* takes p, which holds a connection ticket */
+        void add( MessagingPort * p , int sock ) {
+            Conn * c = new Conn( p , sock );
+            if ( ! arm( c , EPOLL_CTL_ADD ) )
+                close( c );
+        }
+
+    private:
+        struct Conn {
+            Conn( MessagingPort * p , int s ) : port( p ) , sock( s ) , len( 0 ) , got( 0 ) , md( 0 ){}
+            MessagingPort * port;
+            int sock;
+            int len;     // of the message being read, once got >= 4
+            int got;     // bytes of it read so far
+            MsgData * md;
+        };
+
+        bool arm( Conn * c , int op ) {
+            epoll_event e;
+            e.events = EPOLLIN | EPOLLONESHOT;
+            e.data.ptr = c;
+            if ( epoll_ctl( _epfd , op , c->sock , &e ) == 0 )
+                return true;
+            log() << "epoll_ctl failed for " << c->port->farEnd.toString() << ' ' << errnoWithDescription() << endl;
+            return false;
+        }
+
+        void run() {
+            setThreadName( "eventLoop" );
+            epoll_event events[256];
+            while ( ! inShutdown() ) {
+                int n = epoll_wait( _epfd , events , 256 , resumeDeferred() );
+                if ( n < 0 ) {
+                    if ( errno == EINTR )
+                        continue;
+                    problem() << "epoll_wait failed, no more messages will be read " << errnoWithDescription() << endl;
+                    return;
+                }
+                for ( int i = 0; i < n; i++ ) {
+                    if ( events[i].data.ptr == 0 ) {
+                        unsigned long long x;
+                        while ( ::read( _wakefd , &x , sizeof( x ) ) > 0 );
+                        continue;
+                    }
+                    read( (Conn *) events[i].data.ptr );
+                }
+            }
+        }
+
+        /* hands the deferred messages that are due to workers.  @return ms until the next is due, 
+           for epoll_wait */
+        int resumeDeferred() {
+            unsigned long long now = jsTime();
+            scoped_lock lk( _deferredMutex );
+            while ( ! _deferred.empty() && _deferred.begin()->first <= now ) {
+                _workers.schedule( &EventLoop::handle , this , _deferred.begin()->second );
+                _deferred.erase( _deferred.begin() );
+            }
+            if ( _deferred.empty() )
+                return 1000;
+            return (int) min( _deferred.begin()->first - now , 1000ULL );
+        }
+
+        /* on a worker: c's message is handled again after millis */
+        void defer( Conn * c , int millis ) {
+            {
+                scoped_lock lk( _deferredMutex );
+                _deferred.insert( make_pair( (unsigned long long) jsTime() + millis , c ) );
+            }
+            unsigned long long one = 1;
+            if ( ::write( _wakefd , &one , sizeof( one ) ) < 0 )
+                log() << "eventfd write failed " << errnoWithDescription() << endl; // resumed within a second anyway
+        }
+
+        /* reads what is there of c's next message, and hands it to a worker once it's all there */
+        void read( Conn * c ) {
+            while ( 1 ) {
+                char * buf = c->md ? (char *) c->md + c->got : (char *) &c->len + c->got;
+                int want = c->md ? c->len - c->got : 4 - c->got;
+                int ret = ::recv( c->sock , buf , want , MSG_DONTWAIT | MSG_NOSIGNAL );
+                if ( ret == 0 ) {
+                    if( !cmdLine.quiet )
+                        log() << "end connection " << c->port->farEnd.toString() << endl;
+                    _workers.schedule( &EventLoop::close , this , c );
+                    return;
+                }
+                if ( ret < 0 ) {
+                    int x = errno;
+                    if ( x == EINTR )
+                        continue;
+                    if ( x == EAGAIN || x == EWOULDBLOCK ) {
+                        if ( ! arm( c , EPOLL_CTL_MOD ) )
+                            _workers.schedule( &EventLoop::close , this , c );
+                        return;
+                    }
+                    log() << "MessagingPort recv() " << errnoWithDescription( x ) << ' ' << c->port->farEnd.toString() << endl;
+                    _workers.schedule( &EventLoop::close , this , c );
+                    return;
+                }
+                c->got += ret;
+
+                if ( ! c->md && c->got == 4 ) {
+                    if ( ! MessagingPort::goodLength( c->len ) || c->len < 4 ) {
+                        _workers.schedule( &EventLoop::badLength , this , c );
+                        return;
+                    }
+                    c->md = (MsgData *) malloc( ( c->len + 1023 ) & 0xfffffc00 );
+                    assert( c->md );
+                    c->md->len = c->len;
+                }
+
+                if ( c->md && c->got == c->len ) {
+                    _workers.schedule( &EventLoop::handle , this , c );
+                    return;
+                }
+            }
+        }
+
+        /* on a worker, as answering may block: c->len isn't a message length.  reads on after an
+           endian check, otherwise closes c */
+        void badLength( Conn * c ) {
+            bool again = false;
+            try {
+                if ( c->port->checkLength( c->len , again ) ) // 0 to 3
+                    again = false;
+            }
+            catch ( const SocketException& ) {
+                again = false;
+            }
+            c->got = 0;
+            if ( again && arm( c , EPOLL_CTL_MOD ) )
+                return;
+            close( c );
+        }
+
+        /* on a worker: handle c's message, then wait for its next one */
+        void handle( Conn * c ) {
+            Message m;
+            m.setData( c->md , false ); // c keeps it in case the message is deferred
+            if ( ! c->port->unwrap( m ) ) {
+                close( c );
+                return;
+            }
+            try {
+                _handler->process( m , c->port );
+            }
+            catch ( const MessageDeferred& d ) {
+                defer( c , d.millis );
+                return;
+            }
+            catch ( const SocketException& ){
+                log() << "unclean socket shutdown from: " << c->port->farEnd.toString() << endl;
+                close( c );
+                return;
+            }
+            catch ( const std::exception& e ){
+                problem() << "uncaught exception (" << e.what() << ")(" << demangleName( typeid(e) ) <<") in EventLoop::handle, closing connection" << endl;
+                close( c );
+                return;
+            }
+            catch ( ... ){
+                problem() << "uncaught exception in EventLoop::handle, closing connection" << endl;
+                close( c );
+                return;
+            }
+            m.reset();
+            free( c->md );
+            c->md = 0;
+            c->got = 0;
+            if ( ! arm( c , EPOLL_CTL_MOD ) )
+                close( c );
+        }
+
+        void close( Conn * c ) {
+            c->port->shutdown();
+            _handler->disconnected( c->port );
+            delete c->port;
+            if ( c->md )
+                free( c->md );
+            delete c;
+            connTicketHolder.release();
+        }
+
+        MessageHandler * _handler;
+        ThreadPool _workers;
+        int _epfd;
+        int _wakefd; // written by defer() so epoll_wait picks up the new timeout
+        mongo::mutex _deferredMutex;
+        multimap< unsigned long long , Conn * > _deferred; // by when they're due, see jsTime()
+    };
+
+#endif
+
     class PortMessageServer : public MessageServer , public Listener {
     public:
             PortMessageServer(  const MessageServer::Options& opts, MessageHandler * handler ) :
@@ -79,8 +317,34 @@ namespace mongo {
             
             uassert( 10275 ,  "multiple PortMessageServer not supported" , ! pms::handler );
             pms::handler = handler;
+            if ( opts.workers > 0 ) {
+#if defined(__linux__)
+                log() << "handling connections with an event loop and " << opts.workers << " worker threads" << endl;
+                _loop.reset( new EventLoop( handler , opts.workers ) );
+#else
+                log() << "worker threads are only supported on linux, using a thread per connection" << endl;
+#endif
+            }
         }
         
+#if defined(__linux__)
+        virtual void accepted(int sock, const SockAddr& from) {
+            if ( ! _loop.get() ) {
+                Listener::accepted( sock , from );
+                return;
+            }
+
+            MessagingPort * p = new MessagingPort( sock , from );
+            if ( ! connTicketHolder.tryAcquire() ){
+                log() << "connection refused because too many open connections" << endl;
+                delete p;
+                sleepmillis(2);
+                return;
+            }
+            _loop->add( p , sock );
+        }
+#endif
+
         virtual void accepted(MessagingPort * p) {
             assert( ! pms::grab );
             pms::grab = p;
@@ -114,6 +378,11 @@ namespace mongo {
             initAndListen();
         }
 
+#if defined(__linux__)
+    private:
+        auto_ptr<EventLoop> _loop;
+#endif
+
     };
 
 
@@ -108,6 +108,71 @@ namespace mongo {
         return num;
     }
 
+    static mongo::mutex syncMutex("syncAll");
+    static boost::condition syncDone;
+    static unsigned long long syncsStarted = 0;
+    static unsigned long long syncsFinished = 0;
+    static bool syncInProgress = false;
+    static boost::condition syncRequested;
+    static unsigned long long syncsRequested = 0; // the flush awaitSync() callers are waiting for
+
+    /* runs one flush on behalf of everyone waiting.  syncMutex held, and no flush in progress */
+    static void leadSync( scoped_lock& lk ){
+        syncInProgress = true;
+        unsigned long long mine = ++syncsStarted;
+        lk.boost().unlock();
+        try {
+            MongoFile::flushAll( true );
+        }
+        catch ( ... ){
+            lk.boost().lock();
+            syncInProgress = false;
+            syncDone.notify_all();
+            throw;
+        }
+        lk.boost().lock();
+        syncsFinished = mine;
+        syncInProgress = false;
+        syncDone.notify_all();
+    }
+
+    /*static*/ unsigned long long MongoFile::syncAll(){
+        scoped_lock lk( syncMutex );
+        // a flush already running may have passed over our writes, we need one that starts after now
+        unsigned long long needed = syncsStarted + 1;
+        while ( syncsFinished < needed ){
+            if ( syncInProgress )
+                syncDone.wait( lk.boost() );
+            else
+                leadSync( lk );
+        }
+        return syncsFinished;
+    }
+
+    /*static*/ unsigned long long MongoFile::awaitSync(){
+        scoped_lock lk( syncMutex );
+        unsigned long long needed = syncsStarted + 1;
+        if ( syncsRequested < needed ){
+            syncsRequested = needed;
+            syncRequested.notify_all();
+        }
+        while ( syncsFinished < needed ){
+            if ( syncDone.timed_wait( lk.boost() , boost::posix_time::seconds( 1 ) ) )
+                continue;
+            // nobody picked it up (no sync thread, or it is shutting down): flush ourselves
+            if ( !syncInProgress && syncsStarted < needed )
+                leadSync( lk );
+        }
+        return syncsFinished;
+    }
+
+    /*static*/ bool MongoFile::waitForSyncRequest( int millis ){
+        scoped_lock lk( syncMutex );
+        if ( syncsRequested <= syncsStarted && millis > 0 )
+            syncRequested.timed_wait( lk.boost() , boost::posix_time::milliseconds( millis ) );
+        return syncsRequested > syncsStarted;
+    }
+
     void MongoFile::created(){
         rwlock lk( mmmutex , true );
         mmfiles.insert(this);
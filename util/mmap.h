@@ -36,6 +36,23 @@ namespace mongo {
         };
 
         static int flushAll( bool sync ); // returns n flushed
+
+        /** group commit: returns once a flushAll(true) that started after the call has finished.
+            callers arriving while a flush is running wait for the next one, which one of them
+            runs on behalf of all of them - so a burst of requests costs a couple of msync passes
+            rather than one each.
+            @return the sequence number of the flush that covered us
+        */
+        static unsigned long long syncAll();
+        /** waits for the next group commit without running it: the thread that calls syncAll()
+            periodically (DataFileSync in mongod) is woken to run it now, and every caller that 
+            arrives before it starts shares that one pass.
+            @return the sequence number of the flush that covered us
+        */
+        static unsigned long long awaitSync();
+        /** for the syncing thread: waits up to millis for an awaitSync() caller.
+            @return true if one is waiting for a flush that hasn't started */
+        static bool waitForSyncRequest( int millis );
         static long long totalMappedLength();
         static void closeAllFiles( stringstream &message );
 
@@ -121,6 +138,14 @@ namespace mongo {
 
         void flush(bool sync);
 
+        /* hint that [p, p+len) of a mapped view will be read soon, so the OS can start reading it in
+           with large requests rather than one page fault at a time.  returns immediately. */
+        static void willNeed(const void *p, size_t len);
+
+        /* true if all of [p, p+len) is in physical memory, so reading it won't wait on the disk.
+           true as well if that can't be determined.  one mincore() call for the whole range. */
+        static bool resident(const void *p, size_t len);
+
         /*void* viewOfs() {
             return view;
         }*/
@@ -42,6 +42,14 @@ namespace mongo {
         return view;
     }
 
+    void MemoryMappedFile::willNeed(const void *p, size_t len) {
+        // all in memory already
+    }
+
+    bool MemoryMappedFile::resident(const void *p, size_t len) {
+        return true;
+    }
+
     void MemoryMappedFile::flush(bool sync) {
     }
     
@@ -24,6 +24,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 namespace mongo {
 
@@ -93,6 +94,51 @@ namespace mongo {
         return view;
     }
     
+    static size_t pageSize() {
+        static size_t sz = sysconf( _SC_PAGESIZE );
+        return sz;
+    }
+
+    void MemoryMappedFile::willNeed(const void *p, size_t len) {
+#if !defined(__sunos__)
+        char *start = (char *) ( (size_t) p & ~( pageSize() - 1 ) );
+        len += (char *) p - start;
+        if ( madvise( start , len , MADV_WILLNEED ) ){
+            RARELY out() << " madvise willneed failed " << errnoWithDescription() << endl;
+        }
+#endif
+    }
+
+    bool MemoryMappedFile::resident(const void *p, size_t len) {
+#if defined(__sunos__)
+        return true;
+#else
+#if defined(__linux__)
+        typedef unsigned char VecElt;
+#else
+        typedef char VecElt;
+#endif
+        char *start = (char *) ( (size_t) p & ~( pageSize() - 1 ) );
+        len += (const char *) p - start;
+        size_t pages = ( len + pageSize() - 1 ) / pageSize();
+        // one mincore() for the whole range; records up to 256KB don't need the heap for its answer
+        VecElt local[ 64 ];
+        vector< VecElt > big;
+        VecElt *vec = local;
+        if ( pages > 64 ) {
+            big.resize( pages );
+            vec = &big[ 0 ];
+        }
+        if ( mincore( start , len , vec ) )
+            return true; // e.g. no longer mapped -- can't tell
+        for( size_t i = 0; i < pages; i++ ) {
+            if ( !( vec[ i ] & 0x1 ) )
+                return false;
+        }
+        return true;
+#endif
+    }
+
     void MemoryMappedFile::flush(bool sync) {
         if ( view == 0 || fd == 0 )
             return;
@@ -100,6 +100,14 @@ namespace mongo {
         return view;
     }
 
+    void MemoryMappedFile::willNeed(const void *p, size_t len) {
+        // no read ahead hint here; the OS's own sequential detection applies
+    }
+
+    bool MemoryMappedFile::resident(const void *p, size_t len) {
+        return true; // can't tell
+    }
+
     void MemoryMappedFile::flush(bool sync) {
         uassert(13056, "Async flushing not supported on windows", sync);
 